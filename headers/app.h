@@ -14,22 +14,38 @@
 #include <model.h>
 #include <blimp.h>
 #include <light.h>
+#include <benchmark.h>
+#include <uniformBuffers.h>
+#include <staticBatch.h>
+#include <instancing.h>
+#include <clusteredLighting.h>
+#include <simulation.h>
 
 #include <iostream>
 
 
 class App {
 public:
-	App();
+	App(const BenchSettings& bench = BenchSettings());
 
 	int run();
 
 private:
 	GLFWwindow* window;
 
+	// Headless benchmark mode
+	BenchSettings bench;
+	unsigned int benchFBO = 0;
+	unsigned int benchColorRBO = 0;
+	unsigned int benchDepthRBO = 0;
+
 	// Settings
 	unsigned int SCR_WIDTH = 800;
 	unsigned int SCR_HEIGHT = 600;
+	// Size of the framebuffer drawn to, in pixels. Differs from the window size on HiDPI displays and follows
+	// window resizes; the projection and the light clusters use it.
+	unsigned int framebufferWidth = SCR_WIDTH;
+	unsigned int framebufferHeight = SCR_HEIGHT;
 
 	// Camera
 	Camera camera;
@@ -41,11 +57,20 @@ private:
 	float deltaTime = 0.0f;
 	float lastFrame = 0.0f;
 
+	// Simulation thread (--sim-thread), null when the simulation runs in the render loop
+	Simulation* simulation = nullptr;
+
+	bool initWindow();
+	void renderScene(Benchmark* benchmark);
+	bool createOffscreenTarget();
+	void destroyOffscreenTarget();
+	static void updateBenchCamera(Camera& camera, float time);
+
 	static void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 	static void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 	static void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
+	static void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
 	void processInput(GLFWwindow* window);
-	void setSpotLightUniforms(const Shader& shader, const SpotLight& light, int index);
 };
 
 
@@ -0,0 +1,52 @@
+#ifndef ASSET_REGISTRY_H
+#define ASSET_REGISTRY_H
+
+#include <textureLoader.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+using namespace std;
+
+class ModelAsset;
+
+// A GL texture shared by all meshes and models that reference the same image
+struct TextureAsset {
+	unsigned int id = 0;
+	uint64_t contentHash = 0;	// Hash of the image file, 0 if the file could not be read
+	string canonicalPath;
+
+	TextureAsset() = default;
+	~TextureAsset();
+	TextureAsset(const TextureAsset&) = delete;
+	TextureAsset& operator=(const TextureAsset&) = delete;
+};
+
+// Process-wide, reference-counted registry of loaded models and textures.
+// Models are keyed by canonical file path; textures by canonical path and by content hash, so the same
+// image copied under another name is only decoded and uploaded once. Entries are held weakly: an asset is
+// freed (and its GL objects deleted) when the last Model/ModelAsset using it goes away.
+// Only used from the GL thread.
+class AssetRegistry {
+public:
+	static AssetRegistry& instance();
+
+	// Returns the shared asset for a model file, loading it on first use. 'shared' is set to true if it was already loaded.
+	shared_ptr<ModelAsset> loadModel(const string& path, bool gamma, TextureBatch* sceneTextures, bool* shared = nullptr);
+
+	// Returns the shared texture for an image file, queueing it in 'batch' on first use
+	shared_ptr<TextureAsset> loadTexture(const string& path, const string& directory, bool gamma, TextureBatch& batch);
+
+	size_t modelCount() const { return models.size(); }
+	size_t textureCount() const { return texturesByPath.size(); }
+
+private:
+	AssetRegistry() = default;
+
+	unordered_map<string, weak_ptr<ModelAsset>> models;
+	unordered_map<string, weak_ptr<TextureAsset>> texturesByPath;
+	unordered_map<uint64_t, weak_ptr<TextureAsset>> texturesByHash;
+};
+
+#endif
@@ -0,0 +1,110 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+#include <frameInfo.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Settings for the headless benchmark mode (--bench)
+struct BenchSettings {
+	bool enabled = false;
+	int frames = 600;					// Number of measured frames
+	int warmupFrames = 30;				// Frames rendered before measuring starts
+	float timestep = 1.0f / 60.0f;		// Fixed simulation timestep in seconds
+	unsigned int width = 1280;			// Offscreen framebuffer size
+	unsigned int height = 720;
+	string outputPath = "bench_output.json";
+	int instances = 0;					// Extra car instances spread over the road, drawn instanced
+	int lights = 2;						// Spot lights: the two blimp lights, then street lamps over the road
+	bool jobScaling = false;			// Run the CPU-only job system scaling benchmark instead (--job-scaling)
+	int jobScalingObjects = 50000;		// Objects of its synthetic scene
+};
+
+// Startup cost of one model: scene pack (warm) vs Assimp import (cold)
+struct ModelLoadRecord {
+	string path;
+	bool fromPack;
+	bool shared;		// Already loaded by another Model and shared through the asset registry
+	double loadMs;
+	double assimpMs;	// Assimp import time, measured when the pack was cooked
+};
+
+// Records CPU/GPU frame times and load times, and writes them out as JSON.
+// GPU times are measured with GL_TIME_ELAPSED queries and shaded samples with GL_SAMPLES_PASSED queries,
+// which are read back a few frames late so that the CPU never waits on the GPU while recording.
+class Benchmark {
+public:
+	explicit Benchmark(const BenchSettings& settings);
+	~Benchmark();
+
+	// Load timing (shader compilation, model loading, ...)
+	void beginLoad();
+	void endLoad();
+	void recordModelLoad(const ModelLoadRecord& record) { modelLoads.push_back(record); }
+
+	// Frame timing. Frames started while 'measuring' is false are not recorded.
+	void beginFrame(bool measuring);
+	void endFrame(const RenderStats& stats);
+
+	// GL_SAMPLES_PASSED query of the current frame for the render queue, or 0 if the frame is not measured
+	unsigned int samplesQuery() const { return currentMeasured ? samplesQueries[queryCursor] : 0; }
+
+	// Reads back all pending GPU queries. Call once after the last frame.
+	void finish();
+
+	bool writeJson(const string& path) const;
+
+	double loadMs() const { return loadTimeMs; }
+
+private:
+	static const int QUERY_LATENCY = 4;
+
+	BenchSettings settings;
+
+	chrono::steady_clock::time_point loadStart;
+	chrono::steady_clock::time_point frameStart;
+	double loadTimeMs = 0.0;
+	vector<ModelLoadRecord> modelLoads;
+
+	bool currentMeasured = false;
+	vector<double> cpuFrameMs;
+	vector<double> gpuFrameMs;
+	vector<double> shadedSamples;
+	vector<double> trianglesSubmitted;
+	vector<double> trianglesAvailable;
+	vector<double> drawCalls;
+	vector<double> textureBinds;
+	vector<double> programSwitches;
+	vector<double> vaoSwitches;
+	vector<double> depthPrepassDraws;
+	vector<double> submitMs;
+	vector<double> meshesTested;
+	vector<double> meshesCulled;
+	vector<double> meshesDrawn;
+	vector<double> meshesOccluded;
+	vector<double> occlusionMs;
+	vector<double> lightAssignMs;
+	vector<double> clusterLightIndices;
+	vector<double> worldMatrixUpdates;
+
+	// GPU query ring: queries[i] belongs to measured frame queryFrame[i] (-1 if unused)
+	unsigned int queries[QUERY_LATENCY] = {};
+	unsigned int samplesQueries[QUERY_LATENCY] = {};
+	int queryFrame[QUERY_LATENCY] = {};
+	int queryCursor = 0;
+
+	void collectQuery(int slot);
+};
+
+// Job system scaling benchmark: times the frame preparation of a synthetic scene of animated objects
+// (transforms, bounds, frustum test, per-object uniforms, visible list) with 1 to N threads, without a window
+// or GL context, and writes the timings to settings.outputPath. Returns false if the output could not be written.
+bool RunJobScalingBenchmark(const BenchSettings& settings);
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef BLIMP_PATH_H
+#define BLIMP_PATH_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+#include <cmath>
+
+// Elliptical flight path of a blimp. Plain data, so the simulation thread can advance it without touching
+// the model (see simulation.h).
+struct BlimpPath {
+	float angle = 0.0f;
+	float speed = 0.5f;
+	float semi_major_axis = 1.0f;	// x axis
+	float semi_minor_axis = 2.0f;	// z axis
+	glm::vec3 center = glm::vec3(0.0f, 1.5f, 0.0f);
+
+	void advance(float deltaTime) {
+		angle += speed * deltaTime;
+		if (angle > 2 * glm::pi<float>())
+			angle -= 2 * glm::pi<float>();
+	}
+
+	glm::vec3 position() const {
+		return glm::vec3(
+			center.x + semi_major_axis * std::cos(angle),
+			center.y,
+			center.z + semi_minor_axis * std::sin(angle)
+		);
+	}
+
+	// To make the blimp face the direction it is moving, we need to rotate it so that its
+	// forward direction aligns with the tangent of its elliptical path at each frame.
+	// -----------------------------------------------------------------------------------
+	float yaw() const {
+		// 1. Compute tangent vector (derivative of position)
+		float dx = -semi_major_axis * std::sin(angle);
+		float dz = semi_minor_axis * std::cos(angle);
+		glm::vec3 dir = glm::normalize(glm::vec3(dx, 0.0f, dz));
+
+		// 2. Compute yaw rotation from direction vector
+		return glm::degrees(std::atan2(dir.x, dir.z));	// yaw = rotation around y-axis
+	}
+};
+
+#endif
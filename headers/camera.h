@@ -111,6 +111,21 @@ public:
 			Zoom = 45.0f;
 	}
 
+	// Sets the Euler angles directly, e.g. from an interpolated simulation state (see simulation.h)
+	void SetOrientation(float yaw, float pitch) {
+		Yaw = yaw;
+		Pitch = pitch;
+		updateCameraVectors();
+	}
+
+	// Points the camera at a target position. Used by scripted camera paths (e.g. the benchmark fly-through).
+	void LookAt(vec3 target) {
+		vec3 direction = normalize(target - Position);
+		Yaw = degrees(atan2(direction.z, direction.x));
+		Pitch = degrees(asin(direction.y));
+		updateCameraVectors();
+	}
+
 private:
 	// Calculates the front vector from the Camera's (updated) Eulers angles
 	void updateCameraVectors() {
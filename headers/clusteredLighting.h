@@ -0,0 +1,90 @@
+#ifndef CLUSTERED_LIGHTING_H
+#define CLUSTERED_LIGHTING_H
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include <culling.h>
+#include <light.h>
+#include <uniformBuffers.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+using namespace std;
+
+// Cluster grid: screen tiles along x and y, exponential depth slices between the near and far plane
+const int CLUSTERS_X = 16;
+const int CLUSTERS_Y = 9;
+const int CLUSTERS_Z = 24;
+const int CLUSTER_COUNT = CLUSTERS_X * CLUSTERS_Y * CLUSTERS_Z;
+
+// Light indices are stored as 16-bit texels
+const size_t MAX_CLUSTERED_LIGHTS = 65536;
+
+// A light stops affecting anything once its attenuation drops below this
+const float LIGHT_ATTENUATION_CUTOFF = 1.0f / 256.0f;
+
+// Distance at which the light's attenuation reaches LIGHT_ATTENUATION_CUTOFF
+float SpotLightRange(const SpotLight& light);
+
+// Clustered forward lighting
+// --------------------------
+// The view frustum is split into CLUSTERS_X x CLUSTERS_Y x CLUSTERS_Z clusters. Every frame each spot
+// light's cone is bounded by a sphere, and the light is added to every cluster whose view space box the
+// sphere touches. The depth slices are split over the thread pool, so the assignment runs in parallel
+// without locks. Three texture buffers are uploaded:
+//   clusterLights   7 RGBA32F texels per light (GpuSpotLight)
+//   clusterGrid     RG32UI per cluster: first index and number of lights
+//   clusterIndices  R16UI light indices, the lists of all clusters back to back
+// and the fragment shader only loops over the lights of its own cluster.
+class ClusteredLighting {
+public:
+	ClusteredLighting();
+	~ClusteredLighting();
+	ClusteredLighting(const ClusteredLighting&) = delete;
+	ClusteredLighting& operator=(const ClusteredLighting&) = delete;
+
+	// Assign the lights to the clusters of this view and upload the buffers. Fills the light count and the
+	// cluster parameters of 'uniforms'.
+	void update(const vector<SpotLight>& lights, const glm::mat4& view, const glm::mat4& projection,
+		float nearPlane, float farPlane, int width, int height, LightUniforms& uniforms);
+
+	// Bind the texture buffers to their shared units (see SharedTextureUnit in shader.h)
+	void bind() const;
+
+	// CPU time of the last update() and the total length of its cluster lists
+	double assignMs() const { return lastAssignMs; }
+	size_t indexCount() const { return indices.size(); }
+
+private:
+	// A light's bounding sphere in view space and the clusters it may touch
+	struct LightBounds {
+		glm::vec3 center;
+		float radius;
+		int minX, maxX, minY, maxY, minZ, maxZ;
+		bool active;
+	};
+
+	GLuint buffers[3] = {};		// Lights, grid, indices
+	GLuint textures[3] = {};
+
+	// View space boxes of the clusters, rebuilt when the projection or the viewport changes
+	vector<Aabb> clusterBoxes;
+	glm::mat4 boxesProjection = glm::mat4(0.0f);
+	int boxesWidth = 0, boxesHeight = 0;
+
+	vector<GpuSpotLight> gpuLights;
+	vector<LightBounds> bounds;
+	vector<vector<uint16_t>> clusterLights;		// Per cluster, filled by the workers
+	vector<glm::uvec2> grid;
+	vector<uint16_t> indices;
+	double lastAssignMs = 0.0;
+
+	void buildClusterBoxes(const glm::mat4& projection, float nearPlane, float farPlane, int width, int height);
+	void assignSlices(int firstSlice, int lastSlice);
+};
+
+#endif
@@ -0,0 +1,141 @@
+#ifndef CULLING_H
+#define CULLING_H
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+using namespace std;
+
+// Plane tests run 4 boxes at a time with SSE where available, and fall back to scalar code elsewhere
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CULLING_SSE 1
+#endif
+
+// Skip meshes outside the view frustum (default), or submit everything
+void SetFrustumCulling(bool enabled);
+bool FrustumCullingEnabled();
+
+// Axis-aligned bounding box
+struct Aabb {
+	glm::vec3 min = glm::vec3(0.0f);
+	glm::vec3 max = glm::vec3(0.0f);
+
+	glm::vec3 center() const { return (min + max) * 0.5f; }
+	glm::vec3 extents() const { return (max - min) * 0.5f; }
+
+	void expand(const Aabb& other) {
+		min = glm::min(min, other.min);
+		max = glm::max(max, other.max);
+	}
+};
+
+// Box of 'box' after the transform (Arvo's method: exact for the transformed box, not its corners' hull)
+Aabb TransformAabb(const Aabb& box, const glm::mat4& transform);
+
+enum FrustumTest {
+	FRUSTUM_OUTSIDE,
+	FRUSTUM_INTERSECTS,
+	FRUSTUM_INSIDE
+};
+
+// View frustum as six planes (left, right, bottom, top, near, far). A point p is inside a plane
+// when dot(plane.xyz, p) + plane.w >= 0. Plane normals are normalized.
+struct Frustum {
+	glm::vec4 planes[6];
+
+	// Gribb/Hartmann plane extraction from projection * view
+	static Frustum FromMatrix(const glm::mat4& viewProjection);
+
+	FrustumTest test(const Aabb& box) const;
+};
+
+// Test 'count' boxes, writing 1 (visible) or 0 (outside) for each into 'visible'
+void CullAabbs(const Frustum& frustum, const Aabb* boxes, size_t count, uint8_t* visible);
+
+// Culling work of a frame, reported by the benchmark
+struct CullingStats {
+	size_t tested = 0;		// Boxes tested against the planes one by one
+	size_t culled = 0;		// Meshes outside the frustum, including those rejected with a whole BVH node
+	size_t occluded = 0;	// Meshes in the frustum hidden behind the occluders (see occlusion.h)
+	size_t drawn = 0;		// Meshes submitted
+};
+
+// Bounding volume hierarchy
+// -------------------------
+// A binary tree of boxes over a fixed set of items (built once, e.g. for static geometry). Inner nodes are
+// split at the median of their longest axis; leaves hold up to BVH_LEAF_SIZE items, which are tested
+// together with one CullAabbs call. Nodes fully inside the frustum accept their whole subtree untested
+// and nodes outside reject it, so large scenes cull in sub-linear time.
+const uint32_t BVH_LEAF_SIZE = 4;
+
+class Bvh {
+public:
+	void build(const vector<Aabb>& boxes);
+
+	// Call visit(item) for every item that is not outside the frustum
+	template <typename Visit>
+	void query(const Frustum& frustum, CullingStats& stats, Visit visit) const;
+
+	size_t size() const { return items.size(); }
+	bool empty() const { return nodes.empty(); }
+
+private:
+	struct Node {
+		Aabb bounds;
+		uint32_t firstItem;		// Items of the whole subtree are contiguous in 'items'
+		uint32_t itemCount;
+		uint32_t left;			// Child nodes are left and left + 1; 0 for leaves
+	};
+
+	vector<Node> nodes;
+	vector<uint32_t> items;		// Item indices, in tree order
+	vector<Aabb> itemBoxes;		// Boxes of 'items', in the same order
+
+	void buildNode(uint32_t index, uint32_t first, uint32_t count);
+};
+
+template <typename Visit>
+void Bvh::query(const Frustum& frustum, CullingStats& stats, Visit visit) const {
+	if (nodes.empty())
+		return;
+
+	uint32_t stack[64];
+	int top = 0;
+	stack[top++] = 0;
+	uint8_t visible[BVH_LEAF_SIZE];
+
+	while (top > 0) {
+		const Node& node = nodes[stack[--top]];
+		FrustumTest result = frustum.test(node.bounds);
+
+		if (result == FRUSTUM_OUTSIDE) {
+			stats.culled += node.itemCount;
+		}
+		else if (result == FRUSTUM_INSIDE) {
+			for (uint32_t i = 0; i < node.itemCount; i++)
+				visit(items[node.firstItem + i]);
+			stats.drawn += node.itemCount;
+		}
+		else if (node.left == 0) {
+			CullAabbs(frustum, &itemBoxes[node.firstItem], node.itemCount, visible);
+			stats.tested += node.itemCount;
+			for (uint32_t i = 0; i < node.itemCount; i++) {
+				if (visible[i]) {
+					visit(items[node.firstItem + i]);
+					stats.drawn++;
+				}
+				else {
+					stats.culled++;
+				}
+			}
+		}
+		else {
+			stack[top++] = node.left;
+			stack[top++] = node.left + 1;
+		}
+	}
+}
+
+#endif
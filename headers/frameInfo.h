@@ -0,0 +1,56 @@
+#ifndef FRAME_INFO_H
+#define FRAME_INFO_H
+
+#include <glm/glm.hpp>
+
+#include <culling.h>
+#include <occlusion.h>
+
+#include <cstddef>
+#include <cstdint>
+using namespace std;
+
+class Shader;
+
+// Per-frame view state handed to the draw calls, e.g. for LOD selection
+struct FrameInfo {
+	glm::mat4 view = glm::mat4(1.0f);
+	glm::mat4 projection = glm::mat4(1.0f);
+	glm::vec3 viewPos = glm::vec3(0.0f);
+	float viewportHeight = 1.0f;	// In pixels
+	float nearPlane = 0.1f;
+	float farPlane = 100.0f;
+	float lodPixelError = 0.0f;		// Allowed projected LOD error in pixels, 0 always draws LOD 0
+	Frustum frustum;				// World space view frustum
+	bool frustumCulling = false;	// Skip draws outside 'frustum'
+	OcclusionCuller* occlusion = nullptr;	// Rendered for this frame's view, or null when occlusion culling is off
+	const Shader* depthShader = nullptr;	// Depth pre-pass program, or null when the pre-pass is off
+	uint32_t shaderFeatureMask = ~0u;		// ANDed with every material's ShaderFeature bits, e.g. to drop SPOT_LIGHTS
+
+	// Pixels covered by one world space unit at the given distance from the camera
+	float pixelsPerUnit(float distance) const {
+		// projection[1][1] is 1 / tan(fovY / 2)
+		return projection[1][1] * 0.5f * viewportHeight / distance;
+	}
+};
+
+// What was drawn in a frame, reported by the benchmark
+struct RenderStats {
+	unsigned int drawCalls = 0;
+	unsigned int textureBinds = 0;
+	unsigned int programSwitches = 0;
+	unsigned int vaoSwitches = 0;
+	unsigned int depthPrepassDraws = 0;	// Draw calls of the depth pre-pass, included in drawCalls
+	size_t trianglesSubmitted = 0;	// Triangles of the LODs that were drawn
+	size_t trianglesAvailable = 0;	// Triangles the same draws would have at LOD 0
+	double submitMs = 0.0;			// CPU time spent preparing, sorting and issuing the draws
+	CullingStats culling;
+	double occlusionMs = 0.0;		// CPU time of the occlusion culler (rasterization and tests)
+	double lightAssignMs = 0.0;		// CPU time of the clustered light assignment and upload
+	size_t clusterLightIndices = 0;	// Total length of the cluster light lists
+	size_t worldMatrixUpdates = 0;	// Scene node world matrices recomputed (see sceneNode.h)
+
+	void reset() { *this = RenderStats(); }
+};
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef INSTANCING_H
+#define INSTANCING_H
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include <culling.h>
+#include <frameInfo.h>
+#include <renderQueue.h>
+#include <uniformBuffers.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+using namespace std;
+
+class ModelAsset;
+class ShaderVariants;
+
+// Draw repeated models with one instanced draw per mesh (default), or submit every instance like a normal model
+void SetInstancing(bool enabled);
+bool InstancingEnabled();
+
+// Per-instance data, read by the INSTANCED variant of vertex_shader.vert through attributes with divisor 1:
+// the model matrix on locations 5-8 and the normal matrix on locations 9-11. The transform of the mesh's node
+// within the model is applied below it from the mesh's object uniforms.
+struct InstanceData {
+	glm::mat4 model;
+	glm::mat3 normalMatrix;
+};
+
+const GLuint INSTANCE_ATTRIBUTE_MODEL = 5;
+const GLuint INSTANCE_ATTRIBUTE_NORMAL_MATRIX = 9;
+
+// Instance batch
+// --------------
+// All instances of one shared model asset in a frame. The transforms are collected with add(), prepare()
+// culls them against the frustum and uploads the visible ones into the instance buffer with a single
+// orphaning glBufferData, and submit() queues one
+// glDrawElementsInstanced per mesh, so the draw count does not depend on the number of instances.
+// With instancing disabled every instance gets its own object uniforms and draws instead, for comparison.
+// The instance buffer is attached to the VAOs of the asset's meshes, so use one batch per asset.
+class InstanceBatch {
+public:
+	explicit InstanceBatch(shared_ptr<ModelAsset> asset);
+	~InstanceBatch();
+	InstanceBatch(const InstanceBatch&) = delete;
+	InstanceBatch& operator=(const InstanceBatch&) = delete;
+
+	void clear();
+	void add(const glm::mat4& model);
+	// Add many instances at once, their normal matrices computed in parallel jobs
+	void add(const vector<glm::mat4>& models);
+	size_t size() const { return instances.size(); }
+
+	// Cull this frame's instances and upload the visible ones, or push their object uniforms when instancing
+	// is disabled
+	void prepare(UniformRing& objectUniforms, const FrameInfo& frame, RenderStats& stats);
+
+	// Submit the meshes, drawn with the INSTANCED variant of their material's shader or one by one with the
+	// plain variant. All instances share the LOD picked for the one closest to the camera.
+	void submit(RenderQueue& queue, ShaderVariants& shaders, const FrameInfo& frame, RenderStats& stats);
+
+private:
+	shared_ptr<ModelAsset> asset;
+	Aabb assetBounds;				// Union of the mesh boxes, in object space
+	vector<ObjectUniforms> meshObjects;		// Node transform of every mesh, in the asset's imported pose
+	vector<InstanceData> instances;
+	vector<InstanceData> visibleInstances;		// Set by prepare()
+	float maxScale = 0.0f;		// Largest scale of any instance this frame, for the LOD distance
+
+	GLuint buffer = 0;
+	size_t capacity = 0;		// In instances
+	bool instanced = true;		// How prepare() set up this frame
+	vector<uint32_t> objectOffsets;		// Per mesh when instanced, else per visible instance and mesh
+
+	// Culling scratch
+	vector<Aabb> instanceBoxes;
+	vector<uint8_t> instanceVisible;
+
+	// LOD each mesh was drawn with last frame, for hysteresis
+	vector<unsigned int> meshLods;
+};
+
+#endif
@@ -0,0 +1,126 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+using namespace std;
+
+class JobSystem;
+
+// Number of jobs still to finish in a group. run() adds to it, every finished job of the group takes one off.
+// Jobs can be made to start only once a counter reaches zero (JobSystem::runAfter), which is how dependencies
+// between groups are expressed. A counter must outlive the jobs counted by it and everything waiting for it.
+class JobCounter {
+public:
+	JobCounter() = default;
+	JobCounter(const JobCounter&) = delete;
+	JobCounter& operator=(const JobCounter&) = delete;
+
+	bool done() const { return pending.load(memory_order_acquire) == 0; }
+
+private:
+	friend class JobSystem;
+
+	struct Continuation {
+		function<void()> job;
+		JobCounter* counter;
+	};
+
+	atomic<int> pending{ 0 };
+	mutex continuationMutex;
+	vector<Continuation> continuations;		// Jobs waiting for this counter to reach zero
+};
+
+// Job system
+// ----------
+// Work-stealing scheduler. Every worker thread owns a deque: jobs it spawns go to the back of its own deque
+// and it takes them back from there (newest first, while their data is still in the cache), and idle workers
+// steal from the front of the others' deques (oldest first, usually the biggest pieces of work). Jobs run()
+// from any other thread (the GL thread, the simulation thread) go into a shared injection deque.
+// A thread that waits for a counter runs queued jobs in the meantime instead of blocking, so jobs may wait
+// for jobs they spawned, and the calling thread adds its own core to the workers'.
+// Jobs must not touch OpenGL: the GL context is only current on the main thread.
+class JobSystem {
+public:
+	// 'workerCount' threads besides the calling ones. With none, every job runs inline in run().
+	explicit JobSystem(unsigned int workerCount);
+	~JobSystem();
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	// Process-wide system, one worker per core besides the main thread
+	static JobSystem& shared();
+
+	// Threads that execute jobs, counting the one waiting for them
+	unsigned int threadCount() const { return static_cast<unsigned int>(workers.size()) + 1; }
+
+	void run(function<void()> job, JobCounter* counter = nullptr);
+
+	// Run 'job' once 'dependency' has reached zero
+	void runAfter(JobCounter& dependency, function<void()> job, JobCounter* counter = nullptr);
+
+	// Execute queued jobs until 'counter' reaches zero
+	void wait(JobCounter& counter);
+
+	// Call body(first, last) for consecutive ranges of [begin, end) of at most 'grain' elements, in parallel,
+	// and return once all are done. A grain of 0 splits the range into a few pieces per thread.
+	template <typename Body>
+	void parallelFor(size_t begin, size_t end, size_t grain, const Body& body) {
+		if (begin >= end)
+			return;
+		size_t count = end - begin;
+		if (grain == 0)
+			grain = std::max(size_t(1), count / (threadCount() * 4));
+		if (count <= grain || workers.empty()) {
+			body(begin, end);
+			return;
+		}
+
+		JobCounter counter;
+		for (size_t first = begin + grain; first < end; first += grain) {
+			size_t last = std::min(first + grain, end);
+			run([&body, first, last] { body(first, last); }, &counter);
+		}
+		// The calling thread takes the first range itself
+		body(begin, begin + grain);
+		wait(counter);
+	}
+
+private:
+	struct Job {
+		function<void()> work;
+		JobCounter* counter = nullptr;
+	};
+
+	struct alignas(64) WorkQueue {
+		mutex lock;
+		deque<Job> jobs;
+	};
+
+	vector<thread> workers;
+	// One deque per worker, then the injection deque of all other threads
+	vector<unique_ptr<WorkQueue>> queues;
+
+	atomic<int> queued{ 0 };
+	mutex wakeMutex;
+	condition_variable wakeCondition;
+	bool stopping = false;
+
+	void push(Job job);
+	bool pop(size_t queue, Job& job);
+	bool steal(size_t thief, Job& job);
+	bool take(Job& job);
+	void execute(Job& job);
+	void finish(JobCounter& counter);
+	void workerLoop(size_t index);
+};
+
+#endif
@@ -19,4 +19,10 @@ struct SpotLight {
 	float quadratic;
 };
 
+// Light from an infinitely far source, e.g. the moon
+struct DirectionalLight {
+	vec3 direction;		// Towards the light
+	vec3 color;
+};
+
 #endif
\ No newline at end of file
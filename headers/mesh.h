@@ -8,8 +8,16 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include <shader.h>
-
+#include <vertexFormat.h>
+#include <meshOptimizer.h>
+#include <meshSimplifier.h>
+#include <renderQueue.h>
+#include <culling.h>
+#include <textureLoader.h>
+
+#include <cstring>
 #include <string>
+#include <unordered_map>
 #include <vector>
 using namespace std;
 
@@ -42,61 +50,139 @@ public:
 	vector<unsigned int> indices;
 	vector<Texture> textures;
 	unsigned int VAO;
-
-	// Constructor
-	Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, const string& meshName)
-		: name(meshName)
+	uint32_t layout = VERTEX_LAYOUT_FULL;	// GPU vertex layout (see vertexFormat.h)
+	GLenum indexType = GL_UNSIGNED_INT;		// GL_UNSIGNED_SHORT for meshes with up to 65536 vertices
+	vector<MeshLod> lods;					// Index ranges of the LODs, LOD 0 first (see meshSimplifier.h)
+	uint32_t materialId = 0;				// Texture set, see renderQueue.h
+	uint32_t shaderFeatures = SHADER_FEATURE_SPOT_LIGHTS;	// ShaderFeature bits the material needs, see shader.h
+
+	// Bounding box and sphere in object space
+	Aabb bounds;
+	glm::vec3 boundsCenter = glm::vec3(0.0f);
+	float boundsRadius = 0.0f;
+
+	// Constructor. 'indices' holds the index ranges of all LODs; without LODs the whole list is LOD 0.
+	Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, const string& meshName, vector<MeshLod> lods = vector<MeshLod>(),
+		uint32_t shaderFeatures = SHADER_FEATURE_SPOT_LIGHTS)
+		: name(meshName), shaderFeatures(shaderFeatures)
 	{
-		this->vertices = vertices;
-		this->indices = indices;
-		this->textures = textures;
+		this->vertices = std::move(vertices);
+		this->indices = std::move(indices);
+		this->textures = std::move(textures);
+		this->lods = std::move(lods);
+		if (this->lods.empty()) {
+			this->lods.push_back(MeshLod());
+			this->lods[0].indexCount = static_cast<uint32_t>(this->indices.size());
+		}
+
+		// Pick the compact vertex layout this mesh needs and convert the vertices to it
+		layout = ChooseVertexLayout(this->vertices.data(), this->vertices.size(), hasTexture("texture_normal"));
+		vector<unsigned char> vertexData = PackVertices(this->vertices.data(), this->vertices.size(), layout);
+		size_t indexSize = IndexSize(this->vertices.size());
+		vector<unsigned char> indexData = PackIndices(this->indices.data(), this->indices.size(), indexSize);
 
 		// Set the vertex buffer and its attribute pointers
-		setupMesh();
+		setupMesh(vertexData.data(), this->vertices.size(), indexData.data(), this->indices.size(), indexSize);
 	}
 
-	// Render the mesh
-	void Draw(Shader& shader) {
-		// bind appropriate textures
-		unsigned int diffuseNr = 1;
-		unsigned int specularNr = 1;
-		unsigned int normalNr = 1;
-		unsigned int heightNr = 1;
-		for (unsigned int i = 0; i < textures.size(); i++) {
-			glActiveTexture(GL_TEXTURE0 + i);		// activate proper texture unit before binding
-			// retreive texture number (the N in diffuse_textureN)
-			string number;
-			string name = textures[i].type;
-			if (name == "texture_diffuse")
-				number = to_string(diffuseNr++);
-			else if (name == "texture_specular")
-				number = to_string(specularNr++);
-			else if (name == "texture_normal")
-				number = to_string(normalNr++);
-			else if (name == "texture_height")
-				number = to_string(heightNr++);
-
-			// Set the sampler to the correct texture unit
-			glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
-			// Bind the texture
-			glBindTexture(GL_TEXTURE_2D, textures[i].id);
+	// Constructor for data that is owned elsewhere (e.g. a memory-mapped scene pack) and already in its GPU layout.
+	// The arrays are uploaded straight to the GPU without keeping a CPU copy. indexSize is 2 or 4 bytes.
+	Mesh(const unsigned char* vertexData, size_t vertexCount, uint32_t vertexLayout, const void* indexData, size_t indexCount, size_t indexSize, vector<MeshLod> lods, vector<Texture> textures, const string& meshName,
+		uint32_t shaderFeatures)
+		: name(meshName), shaderFeatures(shaderFeatures)
+	{
+		this->textures = std::move(textures);
+		this->lods = std::move(lods);
+		layout = vertexLayout;
+
+		setupMesh(vertexData, vertexCount, indexData, indexCount, indexSize);
+	}
+
+	bool hasTexture(const string& type) const {
+		for (const Texture& texture : textures) {
+			if (texture.type == type)
+				return true;
 		}
+		return false;
+	}
 
-		// Draw Mesh
-		glBindVertexArray(VAO);
-		glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
+	unsigned int triangleCount(unsigned int lod = 0) const {
+		return lods[lod].indexCount / 3;
+	}
+
+	// Byte offset of a LOD's index range in the index buffer
+	size_t indexByteOffset(unsigned int lod) const {
+		return size_t(lods[lod].indexOffset) * indexSize;
+	}
+
+	// Read the uploaded vertex bytes (in this mesh's layout) and all indices back from the GPU.
+	// Used once when building static batches, since meshes loaded from a pack keep no CPU copy.
+	void readBack(vector<unsigned char>& vertexData, vector<unsigned int>& indexData) const {
+		vertexData.resize(vertexCount * VertexStride(layout));
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		glGetBufferSubData(GL_ARRAY_BUFFER, 0, vertexData.size(), vertexData.data());
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		vector<unsigned char> indexBytes(indexCount * indexSize);
 		glBindVertexArray(0);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+		glGetBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, indexBytes.size(), indexBytes.data());
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+		indexData.resize(indexCount);
+		for (size_t i = 0; i < indexCount; i++) {
+			if (indexSize == 2) {
+				uint16_t index;
+				memcpy(&index, indexBytes.data() + i * 2, 2);
+				indexData[i] = index;
+			}
+			else {
+				memcpy(&indexData[i], indexBytes.data() + i * 4, 4);
+			}
+		}
+	}
 
-		// Set everything back to default
-		glActiveTexture(GL_TEXTURE0);
+	// Delete the GPU buffers. Called by the owner once the mesh is no longer used.
+	void release() {
+		glDeleteVertexArrays(1, &VAO);
+		glDeleteBuffers(1, &VBO);
+		glDeleteBuffers(1, &EBO);
+		VAO = VBO = EBO = 0;
 	}
 
 private:
 	// Render data
 	unsigned int VBO, EBO;
+	unsigned int indexSize = sizeof(unsigned int);
+	size_t vertexCount = 0;
+	size_t indexCount = 0;		// All LODs
+
+	// Work out the sampler name of every texture (the N in texture_diffuseN) and the unit it is bound to.
+	// Textures whose type has no sampler convention are not bound. Every shader variant samples
+	// texture_diffuse1, so a material without a diffuse map gets the white texture there instead.
+	void assignMaterial() {
+		vector<TextureBinding> bindings;
+		unordered_map<string, unsigned int> typeCount;
+		for (const Texture& texture : textures) {
+			unsigned int number = ++typeCount[texture.type];
+			int unit = Shader::MaterialSamplerUnit(texture.type + to_string(number));
+			if (unit >= 0)
+				bindings.push_back({ static_cast<GLuint>(unit), texture.id });
+		}
+		if (typeCount["texture_diffuse"] == 0)
+			bindings.push_back({ static_cast<GLuint>(TEXTURE_UNIT_DIFFUSE), WhiteTexture() });
+		materialId = InternMaterial(bindings);
+	}
 
 	// Initializes all the buffer objects/arrays
-	void setupMesh() {
+	void setupMesh(const unsigned char* vertexData, size_t vertexCount, const void* indexData, size_t indexCount, size_t indexSize) {
+		this->indexSize = static_cast<unsigned int>(indexSize);
+		this->vertexCount = vertexCount;
+		this->indexCount = indexCount;
+		assignMaterial();
+		indexType = indexSize == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+		computeBounds(vertexData, vertexCount);
+
 		// Create buffers/arrays
 		glGenVertexArrays(1, &VAO);
 		glGenBuffers(1, &VBO);
@@ -105,34 +191,42 @@ private:
 		glBindVertexArray(VAO);
 		// Load data into vertex buffers
 		glBindBuffer(GL_ARRAY_BUFFER, VBO);
-		// Struct memory layout is sequential.
-		// The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
-		// again translate to 3/2 floats which tanslates to a byte array
-		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+		// The vertex data is already laid out as the GPU expects it (see PackVertices)
+		glBufferData(GL_ARRAY_BUFFER, vertexCount * VertexStride(layout), vertexData, GL_STATIC_DRAW);
 
 
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * indexSize, indexData, GL_STATIC_DRAW);
 
 		// Set the vertex attribute pointers
-		// Vertex positions
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-		// Vertex normals
-		glEnableVertexAttribArray(1);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-		// Vertex texture coordinates
-		glEnableVertexAttribArray(2);
-		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-		// Vertex tangent
-		glEnableVertexAttribArray(3);
-		glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-		// Vertex bitangent
-		glEnableVertexAttribArray(4);
-		glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+		SetupVertexAttributes(layout);
+		RecordMeshUpload(vertexCount, layout, indexCount * indexSize);
 
 		glBindVertexArray(0);
 	}
+
+	// Box of the vertex positions and the bounding sphere around it. Every vertex layout starts with the position.
+	void computeBounds(const unsigned char* vertexData, size_t vertexCount) {
+		if (vertexCount == 0)
+			return;
+		size_t stride = VertexStride(layout);
+		glm::vec3 minimum(0.0f), maximum(0.0f);
+		for (size_t i = 0; i < vertexCount; i++) {
+			glm::vec3 position;
+			memcpy(&position, vertexData + i * stride, sizeof(position));
+			minimum = i ? glm::min(minimum, position) : position;
+			maximum = i ? glm::max(maximum, position) : position;
+		}
+		bounds.min = minimum;
+		bounds.max = maximum;
+		boundsCenter = (minimum + maximum) * 0.5f;
+		boundsRadius = 0.0f;
+		for (size_t i = 0; i < vertexCount; i++) {
+			glm::vec3 position;
+			memcpy(&position, vertexData + i * stride, sizeof(position));
+			boundsRadius = glm::max(boundsRadius, glm::length(position - boundsCenter));
+		}
+	}
 };
 
 
@@ -0,0 +1,47 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+using namespace std;
+
+struct Vertex;
+
+// Post-import mesh optimization
+// -----------------------------
+// Run on every mesh after Assimp import, before it is uploaded and cooked into the scene pack:
+//   1. weld bit-identical vertices
+//   2. reorder triangles for the post-transform vertex cache (Forsyth's linear-speed algorithm)
+//   3. reorder clusters of triangles front-to-back from the mesh centre to reduce overdraw, as long as the
+//      cache efficiency does not get more than 5% worse (Tipsify-style)
+//   4. reorder vertices in order of first use for fetch locality
+// The index type (16 or 32 bit) is chosen at upload time, see Mesh.
+
+struct MeshOptimizationStats {
+	size_t verticesBefore = 0;
+	size_t verticesAfter = 0;
+	float acmrBefore = 0.0f;	// Average cache miss ratio: transformed vertices per triangle (0.5 - 3.0)
+	float acmrAfter = 0.0f;
+	size_t indexBytesBefore = 0;
+	size_t indexBytesAfter = 0;
+};
+
+// Runs the whole pipeline in place and prints the before/after statistics of the mesh
+MeshOptimizationStats OptimizeMesh(vector<Vertex>& vertices, vector<unsigned int>& indices, const string& meshName);
+
+void WeldVertices(vector<Vertex>& vertices, vector<unsigned int>& indices);
+void OptimizeVertexCache(vector<unsigned int>& indices, size_t vertexCount);
+void OptimizeOverdraw(vector<unsigned int>& indices, const vector<Vertex>& vertices, float threshold = 1.05f);
+void OptimizeVertexFetch(vector<Vertex>& vertices, vector<unsigned int>& indices);
+
+// Average cache miss ratio of an index buffer for a FIFO cache of the given size
+float ComputeACMR(const vector<unsigned int>& indices, size_t vertexCount, unsigned int cacheSize = 16);
+
+// Bytes per index for a mesh with this many vertices: 16-bit indices up to 65536 vertices, 32-bit otherwise
+size_t IndexSize(size_t vertexCount);
+
+// Convert indices into the byte stream of the given index size (2 or 4)
+vector<unsigned char> PackIndices(const unsigned int* indices, size_t count, size_t indexSize);
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef MESH_SIMPLIFIER_H
+#define MESH_SIMPLIFIER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+using namespace std;
+
+struct Vertex;
+
+// Level of detail chain
+// ---------------------
+// Every mesh keeps all of its LODs in one index buffer: LOD 0 is the optimized full-resolution index
+// range, followed by the simplified ones. All LODs share the vertex buffer.
+// The simplified ranges are made with quadric error metric edge collapses (Garland & Heckbert), where
+// vertices on borders and UV/normal seams are locked so the mesh never opens up.
+struct MeshLod {
+	uint32_t indexOffset = 0;	// First index of the range, in indices
+	uint32_t indexCount = 0;
+	float error = 0.0f;			// Largest geometric deviation from LOD 0, in object space units
+};
+
+// Projected error (in pixels) a LOD may have before a finer one is used
+const float LOD_PIXEL_ERROR = 1.0f;
+// Switching to a coarser LOD needs the error to be this much below the threshold, so meshes close to a
+// threshold do not pop back and forth every frame
+const float LOD_HYSTERESIS = 0.75f;
+
+// Use distance-based LOD selection (default), or always draw LOD 0
+void SetLodSelection(bool enabled);
+bool LodSelectionEnabled();
+
+// Simplify a mesh down to targetIndexCount indices, without exceeding targetError (object space distance).
+// Returns the error of the result; the simplified index list is written to 'result'.
+float SimplifyMesh(const vector<Vertex>& vertices, const vector<unsigned int>& indices, size_t targetIndexCount, float targetError, vector<unsigned int>& result);
+
+// Build the LOD chain of an optimized mesh. The simplified index ranges are appended to 'indices' and the
+// ranges of all LODs (LOD 0 first) are returned.
+vector<MeshLod> BuildLodChain(const vector<Vertex>& vertices, vector<unsigned int>& indices, const string& meshName);
+
+// Pick the LOD to draw given how many pixels one object space unit covers at the mesh.
+// 'current' is the LOD drawn last frame and is used for hysteresis.
+unsigned int SelectLod(const vector<MeshLod>& lods, float pixelsPerUnit, float pixelError, unsigned int current);
+
+#endif
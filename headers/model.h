@@ -6,6 +6,7 @@
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
 #include <stb_image.h>
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
@@ -14,56 +15,121 @@
 #include <shader.h>
 #include <mesh.h>
 #include <textureLoader.h>
+#include <scenePack.h>
+#include <assetRegistry.h>
+#include <frameInfo.h>
+#include <uniformBuffers.h>
+#include <renderQueue.h>
+#include <sceneNode.h>
+#include <profiler.h>
+#include <jobSystem.h>
 
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <unordered_map>
 #include <vector>
 #include <filesystem>
+#include <chrono>
 using namespace std;
 
+// How a model was loaded, reported by the benchmark
+struct ModelLoadStats {
+	bool fromPack = false;	// Loaded from the cooked scene pack instead of Assimp
+	double loadMs = 0.0;	// Time spent in loadModel
+	double assimpMs = 0.0;	// Time the Assimp import took (measured when the pack was cooked)
+	bool shared = false;	// The model was already loaded and is shared through the asset registry
+};
 
-class Model {
+
+// Shared, immutable data of a loaded model: the GPU meshes and the textures they reference.
+// Owned by the AssetRegistry; every Model instance of the same file points to one ModelAsset.
+class ModelAsset {
 public:
 	// Mode data
-	vector<Texture> textures_loaded;
 	vector<Mesh> meshes;
+	// Node hierarchy of the imported file, parents first, and the node every mesh is attached to
+	vector<ModelNode> nodes;
+	vector<uint32_t> meshNodes;
+	// Transform of every mesh's node relative to the model's root, in the imported pose
+	vector<glm::mat4> meshTransforms;
 	string directory;
 	bool gammaCorrection;
-
-	// Model Coordinates
-	glm::vec3 position = glm::vec3(0.0f);
-	glm::vec3 rotation = glm::vec3(0.0f);
-	glm::vec3 scale = glm::vec3(1.0f);
+	ModelLoadStats loadStats;
 
 	// Constructor, expects a filepath to a 3D model.
-	Model(string const& path, bool gamma = false)
+	// Textures are decoded in parallel. If a scene-wide texture batch is given, the textures are only queued
+	// and the caller loads the whole batch once all models are created; otherwise they are loaded right away.
+	ModelAsset(string const& path, bool gamma = false, TextureBatch* sceneTextures = nullptr)
 		: gammaCorrection(gamma)
 	{
+		TextureBatch ownTextures;
+		textureBatch = sceneTextures ? sceneTextures : &ownTextures;
 		loadModel(path);
+		if (!sceneTextures)
+			ownTextures.load();
+		textureBatch = nullptr;
+		computeMeshTransforms();
 	}
 
-	// Draw the model
-	void Draw(Shader& shader) {
-		glm::mat4 model = glm::mat4(1.0f);
-		model = glm::translate(model, position);
-		model = glm::rotate(model, glm::radians(rotation.x), glm::vec3(1, 0, 0));
-		model = glm::rotate(model, glm::radians(rotation.y), glm::vec3(0, 1, 0));
-		model = glm::rotate(model, glm::radians(rotation.z), glm::vec3(0, 0, 1));
-		model = glm::scale(model, scale);
-
-		shader.setMat4("model", model);
-
-		for (unsigned int i = 0; i < meshes.size(); i++) {
-			meshes[i].Draw(shader);
-		}
+	~ModelAsset() {
+		for (Mesh& mesh : meshes)
+			mesh.release();
 	}
 
+	ModelAsset(const ModelAsset&) = delete;
+	ModelAsset& operator=(const ModelAsset&) = delete;
+
 private:
+	// A mesh of the Assimp scene and the node it hangs from, in the order the nodes are visited
+	struct ImportedMesh {
+		aiMesh* mesh;
+		uint32_t node;
+	};
+
+	struct MeshGeometry {
+		vector<Vertex> vertices;
+		vector<unsigned int> indices;
+		vector<MeshLod> lods;
+	};
+
+	// Where texture loads are queued while the model is being loaded
+	TextureBatch* textureBatch = nullptr;
+	// Keeps the shared textures used by the meshes alive, keyed by material path
+	unordered_map<string, shared_ptr<TextureAsset>> textures_loaded;
+
 	// Load a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
+	// The result is cooked into a binary scene pack next to the source file, which is used instead of Assimp
+	// on later launches for as long as the source files are unchanged.
 	void loadModel(string const& path) {
+		PROFILE_ZONE("Model::loadModel");
+		auto loadStart = chrono::steady_clock::now();
+		// Retrieve the directory path of the filepath
+		// directory = path.substr(0, path.find_last_not_of('/'));
+		directory = std::filesystem::path(path).parent_path().string();	// Supposed to be Mac ans Win compatible
+
+		// Warm start: load straight from the mapped pack
+		string packPath = path + ".pack";
+		uint64_t sourceHash = HashModelSource(path);
+		if (sourceHash != 0) {
+			// Cook settings are part of the key: a pack cooked with another vertex layout mode is stale
+			bool compact = CompactVerticesEnabled();
+			sourceHash = HashBytes(&compact, sizeof(compact), sourceHash);
+		}
+		{
+			ScenePack pack;
+			if (pack.open(packPath, sourceHash)) {
+				loadFromPack(pack);
+				loadStats.fromPack = true;
+				loadStats.loadMs = chrono::duration<double, milli>(chrono::steady_clock::now() - loadStart).count();
+				loadStats.assimpMs = pack.cookMs();
+				return;
+			}
+		}
+
 		// read file via ASSIMP
 		Assimp::Importer importer;
 		//const aiScene* scene = importer.ReadFile(path,
@@ -75,43 +141,127 @@ private:
 		//	aiProcess_OptimizeMeshes |         // Combine small meshes
 		//	aiProcess_ValidateDataStructure    // Check for correctness
 		//);
-		const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+		// Duplicate vertices are welded by OptimizeMesh in extractGeometry
+		const aiScene* scene;
+		{
+			PROFILE_ZONE("Assimp import");
+			scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+		}
 		// chek for errors
 		if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
 			cout << "ERROR::ASSIMP::" << importer.GetErrorString() << endl;
 			return;
 		}
-		// Retrieve the directory path of the filepath
-		// directory = path.substr(0, path.find_last_not_of('/'));
-		directory = std::filesystem::path(path).parent_path().string();	// Supposed to be Mac ans Win compatible
 
-		// Process ASSIMP's root node recursively
-		processNode(scene->mRootNode, scene);
+		// Process ASSIMP's root node recursively, collecting the meshes of every node
+		vector<ImportedMesh> imported;
+		processNode(scene->mRootNode, scene, imported);
+
+		// Build the geometry of all meshes in parallel, then create the meshes and their materials on this
+		// thread, which owns the GL context
+		vector<MeshGeometry> geometry(imported.size());
+		JobSystem::shared().parallelFor(0, imported.size(), 1, [&imported, &geometry](size_t first, size_t last) {
+			for (size_t i = first; i < last; i++)
+				geometry[i] = extractGeometry(imported[i].mesh);
+		});
+		for (size_t i = 0; i < imported.size(); i++) {
+			aiMesh* mesh = imported[i].mesh;
+			meshes.push_back(processMesh(mesh, scene, mesh->mName.C_Str(), geometry[i]));
+			meshNodes.push_back(imported[i].node);
+		}
+
+		loadStats.fromPack = false;
+		loadStats.loadMs = chrono::duration<double, milli>(chrono::steady_clock::now() - loadStart).count();
+		loadStats.assimpMs = loadStats.loadMs;
+
+		// Cook the pack for the next launch
+		if (sourceHash != 0)
+			writePack(packPath, sourceHash);
+	}
+
+	// Create the meshes from a mapped scene pack. Vertex and index arrays are uploaded directly from the mapping.
+	void loadFromPack(const ScenePack& pack) {
+		nodes = pack.nodes();
+		for (const PackMesh& packMesh : pack.meshes()) {
+			meshNodes.push_back(packMesh.node);
+			vector<Texture> textures;
+			for (const PackTexture& packTexture : packMesh.textures)
+				textures.push_back(loadTexture(packTexture.path, packTexture.type));
+			meshes.push_back(Mesh(packMesh.vertexData, packMesh.vertexCount, packMesh.vertexLayout, packMesh.indexData, packMesh.indexCount, packMesh.indexSize, packMesh.lods, textures, packMesh.name,
+				packMesh.shaderFeatures));
+		}
+	}
+
+	// Write the meshes produced by the Assimp import to a scene pack
+	void writePack(const string& packPath, uint64_t sourceHash) {
+		vector<PackMesh> packMeshes(meshes.size());
+		vector<vector<unsigned char>> vertexData(meshes.size());
+		vector<vector<unsigned char>> indexData(meshes.size());
+		for (size_t i = 0; i < meshes.size(); i++) {
+			const Mesh& mesh = meshes[i];
+			PackMesh& packMesh = packMeshes[i];
+			packMesh.name = mesh.name;
+			vertexData[i] = PackVertices(mesh.vertices.data(), mesh.vertices.size(), mesh.layout);
+			packMesh.vertexData = vertexData[i].data();
+			packMesh.vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+			packMesh.vertexLayout = mesh.layout;
+			packMesh.indexSize = static_cast<uint32_t>(IndexSize(mesh.vertices.size()));
+			indexData[i] = PackIndices(mesh.indices.data(), mesh.indices.size(), packMesh.indexSize);
+			packMesh.indexData = indexData[i].data();
+			packMesh.indexCount = static_cast<uint32_t>(mesh.indices.size());
+			packMesh.lods = mesh.lods;
+			packMesh.shaderFeatures = mesh.shaderFeatures;
+			packMesh.node = meshNodes[i];
+			for (const Texture& texture : mesh.textures)
+				packMesh.textures.push_back({ texture.type, texture.path });
+		}
+		if (ScenePack::write(packPath, sourceHash, loadStats.assimpMs, packMeshes, nodes))
+			cout << "Cooked scene pack: " << packPath << endl;
 	}
 
 	// Process a node in a recursive fashion. Processes each individual mesh located at the node and repeat this process on its children nodes (if any).
-	void processNode(aiNode* node, const aiScene* scene) {
+	// The node itself is kept with its transform, so every Model can move its sub-parts on their own.
+	void processNode(aiNode* node, const aiScene* scene, vector<ImportedMesh>& imported, int32_t parent = -1) {
+		ModelNode modelNode;
+		modelNode.name = node->mName.C_Str();
+		modelNode.parent = parent;
+		// aiMatrix4x4 is row major
+		modelNode.transform = glm::transpose(glm::make_mat4(&node->mTransformation.a1));
+		int32_t index = static_cast<int32_t>(nodes.size());
+		nodes.push_back(modelNode);
+
 		// Process each mesh located at the current node
 		for (unsigned int i = 0; i < node->mNumMeshes; i++) {
 			// The node object only contains indices to index the actual objects in the scene.
 			// The scene contains all the datam node is just to keep stuff organized (like relations between nodes).
 			// string meshName = node->mName.C_Str(); // name of the current node
 			
-			aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-			string meshName = mesh->mName.C_Str();
-			meshes.push_back(processMesh(mesh, scene, meshName));
+			imported.push_back({ scene->mMeshes[node->mMeshes[i]], static_cast<uint32_t>(index) });
 		}
 		// After we've processed all the meshes (if any) we then recursively process each of the children nodes.
 		for (unsigned int i = 0; i < node->mNumChildren; i++) {
-			processNode(node->mChildren[i], scene);
+			processNode(node->mChildren[i], scene, imported, index);
 		}
 	}
 
-	Mesh processMesh(aiMesh* mesh, const aiScene* scene, const string& meshName) {
-		// Data to fill
-		vector<Vertex> vertices;
-		vector<unsigned int> indices;
-		vector<Texture> textures;
+	// Concatenate the node transforms down the hierarchy
+	void computeMeshTransforms() {
+		vector<glm::mat4> nodeTransforms(nodes.size());
+		for (size_t i = 0; i < nodes.size(); i++)
+			nodeTransforms[i] = nodes[i].parent < 0 ? nodes[i].transform : nodeTransforms[nodes[i].parent] * nodes[i].transform;
+		meshTransforms.resize(meshes.size());
+		for (size_t i = 0; i < meshes.size(); i++)
+			meshTransforms[i] = nodeTransforms[meshNodes[i]];
+	}
+
+	// Vertices and indices of one imported mesh, welded and optimized, with its LOD chain. Touches neither GL
+	// nor the model, so the meshes of a model are built in parallel.
+	static MeshGeometry extractGeometry(const aiMesh* mesh) {
+		PROFILE_ZONE("Model::extractGeometry");
+		string meshName = mesh->mName.C_Str();
+		MeshGeometry geometry;
+		vector<Vertex>& vertices = geometry.vertices;
+		vector<unsigned int>& indices = geometry.indices;
 
 		// Walk through each of the mesh's vertices
 		for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
@@ -154,11 +304,22 @@ private:
 		}
 		// Walk through each of the mesh's faces and retrieve the corresponding vertex indices
 		for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
-			aiFace face = mesh->mFaces[i];
+			const aiFace& face = mesh->mFaces[i];
 			// Retrieve all indices of the face and store them in the indices vector
 			for (unsigned int j = 0; j < face.mNumIndices; j++)
 				indices.push_back(face.mIndices[j]);
 		}
+		// Weld and reorder the mesh for the vertex cache, overdraw and vertex fetch before it is uploaded and cooked
+		OptimizeMesh(vertices, indices, meshName);
+		// Append the simplified LODs to the index list
+		geometry.lods = BuildLodChain(vertices, indices, meshName);
+		return geometry;
+	}
+
+	Mesh processMesh(aiMesh* mesh, const aiScene* scene, const string& meshName, MeshGeometry& geometry) {
+		PROFILE_ZONE("Model::processMesh");
+		vector<Texture> textures;
+
 		// Process materials
 		aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
 		// we assume a convention for sampler names in the shader. Each diffuse texture should be named
@@ -206,8 +367,21 @@ private:
 		vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
 		textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
 
+		// Shader variant of the material: only the features it actually has textures for
+		uint32_t shaderFeatures = SHADER_FEATURE_SPOT_LIGHTS;
+		if (!specularMaps.empty())
+			shaderFeatures |= SHADER_FEATURE_SPECULAR_MAP;
+		if (!normalMaps.empty())
+			shaderFeatures |= SHADER_FEATURE_NORMAL_MAP;
+		// Cut-out materials (an opacity map or less than full opacity) are alpha tested against the diffuse alpha.
+		// Without a diffuse map there is no alpha to test (the white fallback is opaque), so they stay opaque.
+		float opacity = 1.0f;
+		material->Get(AI_MATKEY_OPACITY, opacity);
+		if (!diffuseMaps.empty() && (material->GetTextureCount(aiTextureType_OPACITY) > 0 || opacity < 1.0f))
+			shaderFeatures |= SHADER_FEATURE_ALPHA_TEST;
+
 		// Return a mesh object created from the extracted mesh data
-		return Mesh(vertices, indices, textures, meshName);
+		return Mesh(std::move(geometry.vertices), std::move(geometry.indices), textures, meshName, std::move(geometry.lods), shaderFeatures);
 	}
 
 	// Check all material textures of a given type and load the texture if they'r re not loaded yet.
@@ -218,29 +392,174 @@ private:
 		for (unsigned int i = 0; i < mat->GetTextureCount(type); i++) {
 			aiString str;
 			mat->GetTexture(type, i, &str);
-			// Check if texture was loaded before and if so, continue to next iteration.
-			bool skip = false;
-			for (unsigned int j = 0; j < textures_loaded.size(); j++) {
-				if (strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0) {
-					textures.push_back(textures_loaded[j]);
-					skip = true;
-					break;
-				}
-			}
-			if (!skip) {
-				// If texture hasn't been loaded already, loade it
-				Texture texture;
-				texture.id = TextureFromFile(str.C_Str(), this->directory);
-				texture.type = typeName;
-				texture.path = str.C_Str();
-				textures.push_back(texture);
-				textures_loaded.push_back(texture);
-			}
+			textures.push_back(loadTexture(str.C_Str(), typeName));
 		}
 
 		return textures;
 	}
-	
+
+	// Load a single texture through the asset registry, so it is shared with every other model using it
+	Texture loadTexture(const string& path, const string& typeName) {
+		shared_ptr<TextureAsset>& asset = textures_loaded[path];
+		if (!asset)
+			asset = AssetRegistry::instance().loadTexture(path, directory, gammaCorrection, *textureBatch);
+
+		Texture texture;
+		texture.id = asset->id;
+		texture.type = typeName;
+		texture.path = path;
+		return texture;
+	}
+};
+
+
+// A placed instance of a model: a lightweight handle to the shared ModelAsset plus its own transforms
+class Model {
+public:
+	shared_ptr<ModelAsset> asset;
+	ModelLoadStats loadStats;	// For this instance; 'shared' is set if the asset was already loaded
+
+	// Placement of the whole model. The asset's node hierarchy is instantiated below it, so a part
+	// (see part()) can be moved on its own and everything else keeps its cached matrices.
+	SceneNode node;
+
+	// Static models never move after loading; with static batching on, their meshes are merged into a
+	// StaticBatch (see staticBatch.h) and drawn from there instead of being submitted one by one
+	bool isStatic = false;
+
+	// Static models that hide a lot of the scene are drawn into the depth buffer first, so their colour pass
+	// only shades the visible fragments (see RenderPass in renderQueue.h). Ignored for dynamic models and for
+	// alpha-tested meshes, whose cut-outs the depth-only shader cannot see.
+	bool depthPrepass = false;
+
+	// Constructor, expects a filepath to a 3D model. Files that are already loaded are shared, not reloaded.
+	Model(string const& path, bool gamma = false, TextureBatch* sceneTextures = nullptr) {
+		auto start = chrono::steady_clock::now();
+		bool shared = false;
+		asset = AssetRegistry::instance().loadModel(path, gamma, sceneTextures, &shared);
+		loadStats = asset->loadStats;
+		if (shared) {
+			loadStats.shared = true;
+			loadStats.loadMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+		}
+
+		for (const ModelNode& assetNode : asset->nodes) {
+			parts.push_back(make_unique<SceneNode>(assetNode.name));
+			parts.back()->setLocalMatrix(assetNode.transform);
+			SceneNode* parent = assetNode.parent < 0 ? &node : parts[assetNode.parent].get();
+			parent->addChild(parts.back().get());
+		}
+	}
+
+	Model(const Model&) = delete;
+	Model& operator=(const Model&) = delete;
+
+	// Node of the imported hierarchy with the given name (e.g. a wheel), or null if there is none.
+	// The imported transform is the node's base matrix: setPosition/setRotation/setScale on a part move it
+	// relative to its imported placement (in the part's own imported frame), which they never replace.
+	SceneNode* part(const string& name) {
+		for (unique_ptr<SceneNode>& part : parts) {
+			if (part->name == name)
+				return part.get();
+		}
+		return nullptr;
+	}
+
+	// World transform of a mesh: the transform of the node it is attached to
+	const glm::mat4& meshTransform(size_t mesh) const {
+		return parts[asset->meshNodes[mesh]]->worldMatrix();
+	}
+
+	// Push the per-object uniforms of every node that has meshes. The world and normal matrices come from the
+	// node cache, so only nodes that moved are recomputed.
+	void prepare(UniformRing& objectUniforms) {
+		partOffsets.assign(parts.size(), NO_OFFSET);
+		for (uint32_t nodeIndex : asset->meshNodes) {
+			if (partOffsets[nodeIndex] != NO_OFFSET)
+				continue;
+			const SceneNode& part = *parts[nodeIndex];
+			ObjectUniforms object;
+			object.model = part.worldMatrix();
+			object.normalMatrix = glm::mat4(part.normalMatrix());
+			partOffsets[nodeIndex] = objectUniforms.push(&object);
+		}
+	}
+
+	// Submit the meshes to the render queue, using the data pushed by prepare().
+	// Meshes outside the frustum are skipped; the others are drawn at the LOD that suits their projected size,
+	// each with the shader variant of its material.
+	void submit(RenderQueue& queue, ShaderVariants& shaders, const FrameInfo& frame, RenderStats& stats) {
+		PROFILE_ZONE("Model::submit");
+		size_t meshCount = asset->meshes.size();
+
+		// Test the world space boxes of all meshes in one batch, first against the frustum, then the occluders
+		meshVisible.assign(meshCount, 1);
+		if (frame.frustumCulling || frame.occlusion) {
+			meshBoxes.resize(meshCount);
+			for (size_t i = 0; i < meshCount; i++)
+				meshBoxes[i] = TransformAabb(asset->meshes[i].bounds, meshTransform(i));
+		}
+		if (frame.frustumCulling) {
+			CullAabbs(frame.frustum, meshBoxes.data(), meshCount, meshVisible.data());
+			stats.culling.tested += meshCount;
+			for (uint8_t visible : meshVisible)
+				stats.culling.culled += visible ? 0 : 1;
+		}
+		if (frame.occlusion)
+			stats.culling.occluded += frame.occlusion->cull(meshBoxes.data(), meshCount, meshVisible.data());
+
+		meshLods.resize(meshCount, 0);
+		for (unsigned int i = 0; i < meshCount; i++) {
+			Mesh& mesh = asset->meshes[i];
+			if (!meshVisible[i])
+				continue;
+			stats.culling.drawn++;
+			uint32_t nodeIndex = asset->meshNodes[i];
+			const SceneNode& part = *parts[nodeIndex];
+			float maxScale = part.maxScale();
+
+			// Distance from the camera to the closest point of the bounding sphere
+			glm::vec3 center = glm::vec3(part.worldMatrix() * glm::vec4(mesh.boundsCenter, 1.0f));
+			float distance = glm::length(center - frame.viewPos) - mesh.boundsRadius * maxScale;
+			distance = glm::max(distance, 0.1f);
+			meshLods[i] = SelectLod(mesh.lods, frame.pixelsPerUnit(distance) * maxScale, frame.lodPixelError, meshLods[i]);
+
+			DrawItem item;
+			item.program = shaders.get(mesh.shaderFeatures & frame.shaderFeatureMask).ID;
+			item.materialId = mesh.materialId;
+			item.vao = mesh.VAO;
+			item.indexType = mesh.indexType;
+			item.indexCount = static_cast<GLsizei>(mesh.lods[meshLods[i]].indexCount);
+			item.indexOffset = mesh.indexByteOffset(meshLods[i]);
+			item.objectOffset = partOffsets[nodeIndex];
+			if (isStatic && depthPrepass && frame.depthShader && !(mesh.shaderFeatures & SHADER_FEATURE_ALPHA_TEST)) {
+				// The depth shader only reads the position attribute of the mesh's VAO
+				DrawItem depthItem = item;
+				depthItem.program = frame.depthShader->ID;
+				depthItem.materialId = EmptyMaterial();
+				depthItem.pass = RENDER_PASS_DEPTH;
+				queue.submit(depthItem, glm::length(center - frame.viewPos), frame.farPlane);
+				item.pass = RENDER_PASS_DEPTH_EQUAL;
+			}
+			queue.submit(item, glm::length(center - frame.viewPos), frame.farPlane);
+
+			stats.trianglesSubmitted += mesh.triangleCount(meshLods[i]);
+			stats.trianglesAvailable += mesh.triangleCount(0);
+		}
+	}
+
+private:
+	static const uint32_t NO_OFFSET = ~0u;
+
+	// One node per node of the asset, in the same order
+	vector<unique_ptr<SceneNode>> parts;
+	// LOD each mesh of this instance was drawn with last frame, for hysteresis
+	vector<unsigned int> meshLods;
+	// Culling scratch
+	vector<Aabb> meshBoxes;
+	vector<uint8_t> meshVisible;
+	// Object uniforms of every part, set by prepare() every frame
+	vector<uint32_t> partOffsets;
 };
 
 
@@ -0,0 +1,85 @@
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+
+#include <glm/glm.hpp>
+
+#include <culling.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+using namespace std;
+
+class Model;
+
+// Skip meshes hidden behind the occluders (default), or only cull against the frustum. Can be switched at
+// runtime (O key).
+void SetOcclusionCulling(bool enabled);
+bool OcclusionCullingEnabled();
+
+// Simplified world space geometry of a large static mesh, rasterized as an occluder
+struct Occluder {
+	vector<glm::vec3> positions;
+	vector<uint32_t> indices;
+	Aabb bounds;
+};
+
+// Pick the meshes of the given static models with the largest boxes as occluders, up to a count and a triangle
+// budget. An occluder must never cover more of the screen than its mesh, or visible objects behind it get
+// culled. Each proxy is therefore the finest LOD of its mesh that fits the remaining budget. A simplified LOD
+// can bulge past the real surface by up to its error, so its vertices are pushed inward along their normals
+// by that error. LODs with an error above OCCLUDER_MAX_LOD_ERROR of the mesh's size are not used: eroding
+// them would leave little of the mesh.
+const size_t OCCLUDER_MAX_COUNT = 32;
+const size_t OCCLUDER_TRIANGLE_BUDGET = 16384;
+const float OCCLUDER_MAX_LOD_ERROR = 0.05f;		// Fraction of the largest extent of the mesh's box
+
+vector<Occluder> BuildOccluders(const vector<const Model*>& models, size_t maxCount = OCCLUDER_MAX_COUNT,
+	size_t triangleBudget = OCCLUDER_TRIANGLE_BUDGET);
+
+// Occlusion culler
+// ----------------
+// A CPU-only occlusion test, so it works without a GPU. Every frame the occluders are rasterized into a
+// small depth buffer (4 pixels at a time with SSE) and a hierarchical-Z pyramid is built from it, each
+// level holding the farthest depth of 2x2 texels below. A box is occluded when the nearest depth of its
+// screen rectangle is behind the farthest occluder depth over that rectangle, which is read from the
+// pyramid level where the rectangle covers at most 2x2 texels.
+// Occluder triangles crossing the near plane are skipped, which only makes the test more conservative.
+const int OCCLUSION_WIDTH = 256;		// Multiple of 4
+const int OCCLUSION_HEIGHT = 128;
+
+class OcclusionCuller {
+public:
+	OcclusionCuller();
+
+	void setOccluders(vector<Occluder> occluders);
+	size_t occluderCount() const { return occluders.size(); }
+
+	// Rasterize the occluders for this frame's view and build the pyramid
+	void render(const glm::mat4& viewProjection);
+
+	// Clear visible[i] for the boxes hidden behind the occluders; entries already 0 are skipped.
+	// Returns the number of boxes occluded.
+	size_t cull(const Aabb* boxes, size_t count, uint8_t* visible);
+
+	// CPU time spent rendering and testing since the last render() call
+	double frameMs() const { return elapsedMs; }
+
+private:
+	vector<Occluder> occluders;
+	glm::mat4 viewProjection = glm::mat4(1.0f);
+
+	// Depth in [0, 1], 1 where no occluder was drawn. Level 0 is the rasterized buffer.
+	vector<vector<float>> levels;
+	vector<glm::ivec2> levelSizes;
+
+	// Occluder vertices in screen space (x, y in pixels, z depth), or w <= 0 behind the near plane
+	vector<glm::vec4> projected;
+
+	double elapsedMs = 0.0;
+
+	void rasterizeTriangle(glm::vec3 a, glm::vec3 b, glm::vec3 c);
+	bool boxOccluded(const Aabb& box) const;
+};
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+using namespace std;
+
+// Profiler
+// --------
+// Scoped zones that record when a piece of CPU or GPU work started and how long it took, written out as a
+// Chrome trace (open it in chrome://tracing or https://ui.perfetto.dev).
+//   PROFILE_ZONE("name")      CPU zone until the end of the enclosing scope. Every thread appends its zones
+//                             to its own buffer, so recording takes no lock and never allocates.
+//   PROFILE_GPU_ZONE("name")  CPU zone plus a GPU zone measured with GL_TIMESTAMP queries around the same
+//                             commands. GL thread only. The queries are read back PROFILER_GPU_LATENCY frames
+//                             later, in ProfilerBeginFrame(), so the CPU never waits for them.
+// Zones only record between StartProfiler() and the end of the run (--trace <file>). Building with
+// -DPROFILER=OFF compiles every zone out.
+// Zone names must be string literals (or otherwise outlive the profiler): only the pointer is stored.
+
+const int PROFILER_GPU_LATENCY = 4;
+// Zones a thread can record before further ones are dropped
+const size_t PROFILER_EVENTS_PER_THREAD = size_t(1) << 18;
+
+// Start recording, the trace is written to 'tracePath' by WriteProfilerTrace()
+void StartProfiler(const string& tracePath);
+bool ProfilerRecording();
+
+// Name of the calling thread in the trace
+void SetProfilerThreadName(const string& name);
+
+// Read back the GPU zones of an old frame. Call once per frame on the GL thread.
+void ProfilerBeginFrame();
+
+// Read back all pending GPU zones and delete the queries (while the GL context is still alive), then write
+// the trace. Returns false if nothing was recorded or the file could not be written.
+bool WriteProfilerTrace();
+
+class ProfileZone {
+public:
+	explicit ProfileZone(const char* name);
+	~ProfileZone();
+	ProfileZone(const ProfileZone&) = delete;
+	ProfileZone& operator=(const ProfileZone&) = delete;
+
+private:
+	const char* name;
+	uint64_t start = 0;
+	bool active;
+};
+
+class GpuProfileZone {
+public:
+	explicit GpuProfileZone(const char* name);
+	~GpuProfileZone();
+	GpuProfileZone(const GpuProfileZone&) = delete;
+	GpuProfileZone& operator=(const GpuProfileZone&) = delete;
+
+private:
+	unsigned int endQuery = 0;
+};
+
+#define PROFILER_CONCAT_INNER(a, b) a##b
+#define PROFILER_CONCAT(a, b) PROFILER_CONCAT_INNER(a, b)
+
+#ifdef PROFILER_ENABLED
+#define PROFILE_ZONE(name) ProfileZone PROFILER_CONCAT(profileZone, __LINE__)(name)
+#define PROFILE_GPU_ZONE(name) \
+	ProfileZone PROFILER_CONCAT(profileZone, __LINE__)(name); \
+	GpuProfileZone PROFILER_CONCAT(gpuProfileZone, __LINE__)(name)
+#else
+#define PROFILE_ZONE(name) ((void)0)
+#define PROFILE_GPU_ZONE(name) ((void)0)
+#endif
+
+#endif
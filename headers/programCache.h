@@ -0,0 +1,60 @@
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Program binary cache
+// --------------------
+// Linked programs are saved with glGetProgramBinary to '<shader directory>/cache/<key>.glbin' and loaded
+// with glProgramBinary on later launches instead of compiling the GLSL again. The key is a hash of the
+// source text of every stage (with its defines injected) and the driver's vendor, renderer and version
+// strings, so edited shaders and driver updates miss the cache. Drivers may still reject a binary (e.g.
+// after an update that kept the version string); the caller then compiles from source and overwrites it.
+// Needs GL 4.1 or ARB_get_program_binary; without it every program is compiled.
+
+const uint32_t PROGRAM_CACHE_MAGIC = 0x4e494247;	// "GBIN"
+const uint32_t PROGRAM_CACHE_VERSION = 1;
+
+// Use the cache (default) or always compile from source
+void SetProgramCacheEnabled(bool enabled);
+bool ProgramCacheEnabled();
+
+// Whether the cache can be used with the current context
+bool ProgramCacheSupported();
+
+// Shader program startup cost, reported by the benchmark
+struct ProgramCacheStats {
+	unsigned int programs = 0;
+	unsigned int hits = 0;			// Loaded from a cached binary
+	unsigned int misses = 0;		// Compiled from source: no binary, cache disabled or unsupported
+	unsigned int rejected = 0;		// Cached binary refused by the driver and compiled instead (included in misses)
+	double loadMs = 0.0;			// Time spent creating all programs, from cache or source
+	double savedMs = 0.0;			// Compile time of the cache hits when they were compiled, minus their load time
+};
+
+const ProgramCacheStats& GetProgramCacheStats();
+
+// Cache key of a program from the preprocessed source of its stages and the driver strings
+uint64_t ProgramCacheKey(const vector<string>& sources);
+
+// Cache file of a program whose vertex shader is 'vertexPath'
+string ProgramCachePath(const string& vertexPath, uint64_t key);
+
+// Load a cached binary into 'program'. Returns false if there is no valid entry or the driver rejects it
+// ('rejected' is set then); the program must be compiled from source in that case. On success 'compileMs'
+// is the time the original compile and link took.
+bool LoadProgramBinary(GLuint program, const string& cachePath, uint64_t key, bool& rejected, double& compileMs);
+
+// Save a linked program, created with GL_PROGRAM_BINARY_RETRIEVABLE_HINT set
+bool SaveProgramBinary(GLuint program, const string& cachePath, uint64_t key, double compileMs);
+
+// Book-keeping and logging of one program creation
+void RecordProgramLoad(const string& name, bool hit, bool rejected, double loadMs, double compileMs);
+
+#endif
@@ -0,0 +1,106 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+#include <frameInfo.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+using namespace std;
+
+class UniformRing;
+
+// Materials
+// ---------
+// A material is the set of textures a mesh binds, each on the texture unit of its sampler (see
+// MaterialTextureUnit in shader.h). Identical sets share one id, so the render queue can sort by it and
+// skip texture binds between draws of the same material.
+struct TextureBinding {
+	GLuint unit;
+	GLuint texture;
+	GLenum target = GL_TEXTURE_2D;		// GL_TEXTURE_2D_ARRAY for texture arrays (see textureArrays.h)
+};
+
+uint32_t InternMaterial(const vector<TextureBinding>& bindings);
+const vector<TextureBinding>& GetMaterial(uint32_t materialId);
+
+// Material without textures, used by the depth pass
+uint32_t EmptyMaterial();
+
+// Draw static occluders into the depth buffer first and shade them with GL_EQUAL (default), or draw
+// everything in a single pass
+void SetDepthPrepass(bool enabled);
+bool DepthPrepassEnabled();
+
+// Passes of a frame, in the order they are drawn
+enum RenderPass : uint8_t {
+	RENDER_PASS_DEPTH = 0,			// Depth only: colour writes off (see depth_prepass.vert)
+	RENDER_PASS_DEPTH_EQUAL = 1,	// Colour of pre-passed meshes: GL_EQUAL depth test, depth writes off
+	RENDER_PASS_OPAQUE = 2			// Everything else: GL_LESS, depth writes on
+};
+
+// One indexed draw, with everything needed to issue it
+struct DrawItem {
+	GLuint program;
+	uint32_t materialId;
+	GLuint vao;
+	GLenum indexType;
+	GLsizei indexCount;
+	size_t indexOffset;			// In bytes
+	uint32_t objectOffset;		// Offset of the per-object uniforms in the object ring
+	GLint baseVertex = 0;
+	GLsizei instanceCount = 0;		// > 0 draws the item instanced (see instancing.h)
+	RenderPass pass = RENDER_PASS_OPAQUE;
+
+	// Set by submitMultiDraw: the ranges of one glMultiDrawElementsBaseVertex call, stored in the queue
+	uint32_t multiFirst = 0;
+	GLsizei multiCount = 0;
+};
+
+// Sorted render queue
+// -------------------
+// Models submit draw items during the frame; execute() sorts them by a 64-bit key and issues them,
+// skipping every program, texture, VAO and uniform range bind that is already in place.
+// Key layout, most significant first:
+//   pass      2 bits   (RenderPass; the depth state is switched once per pass)
+//   program  10 bits   (index of the program among those submitted since clear())
+//   material 24 bits
+//   VAO      16 bits
+//   depth    12 bits   (front to back, so equal state draws still benefit from early depth rejection)
+const size_t RENDER_QUEUE_MAX_PROGRAMS = 1 << 10;
+
+class RenderQueue {
+public:
+	void clear();
+
+	// 'viewDistance' is the distance of the draw from the camera, used for the depth part of the key
+	void submit(const DrawItem& item, float viewDistance, float farPlane);
+
+	// Submit several index ranges that share all state as one multi-draw. indexCount/indexOffset of the
+	// item are ignored; every range is drawn with the item's base vertex.
+	void submitMultiDraw(const DrawItem& item, const GLsizei* counts, const size_t* offsets, GLsizei rangeCount, float viewDistance, float farPlane);
+
+	// Sort and draw everything submitted since clear(). State changes are added to 'stats'. If 'samplesQuery'
+	// is given, it counts the samples passed by the shading passes (everything but RENDER_PASS_DEPTH).
+	void execute(const UniformRing& objectUniforms, RenderStats& stats, GLuint samplesQuery = 0);
+
+	size_t size() const { return items.size(); }
+
+private:
+	vector<DrawItem> items;
+	vector<pair<uint64_t, uint32_t>> keys;		// Sort key, item index
+	vector<GLuint> programs;					// Programs submitted since clear(), indexed by their key bits
+
+	// Ranges of the multi-draw items
+	vector<GLsizei> multiCounts;
+	vector<void*> multiOffsets;
+	vector<GLint> multiBaseVertices;
+
+	uint64_t makeKey(const DrawItem& item, float viewDistance, float farPlane);
+};
+
+#endif
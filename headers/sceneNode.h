@@ -0,0 +1,91 @@
+#ifndef SCENE_NODE_H
+#define SCENE_NODE_H
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+using namespace std;
+
+// A node of a model's imported hierarchy (Assimp's aiNode tree), as stored in the model asset and the scene pack.
+// Nodes are listed parents first, so a node's parent always has a smaller index.
+struct ModelNode {
+	string name;
+	int32_t parent = -1;					// Index of the parent node, -1 for the root
+	glm::mat4 transform = glm::mat4(1.0f);	// Relative to the parent
+};
+
+// Scene graph node
+// ----------------
+// A transform relative to the parent node: position/rotation/scale applied on top of an optional base matrix
+// (e.g. an Assimp node transform). The world and normal matrices are cached: changing a local transform marks the
+// node and its whole subtree dirty, and they are recomputed the next time they are read. Nodes that never
+// move (the static road and car) are computed once.
+// Nodes do not own each other; the owner keeps them alive for as long as they are linked.
+// Reading the cached matrices updates them, so separate hierarchies can be read from parallel jobs, but one
+// hierarchy only from one thread at a time.
+class SceneNode {
+public:
+	string name;
+
+	SceneNode() = default;
+	explicit SceneNode(const string& name) : name(name) {}
+	~SceneNode();
+	SceneNode(const SceneNode&) = delete;
+	SceneNode& operator=(const SceneNode&) = delete;
+
+	// Local transform: the base matrix, then position/rotation/scale on top of it (local = base * TRS).
+	// Rotation is in degrees, applied around x, then y, then z.
+	void setPosition(const glm::vec3& position);
+	void setRotation(const glm::vec3& degrees);
+	void setScale(const glm::vec3& scale);
+	// Base matrix (e.g. an imported node transform, which may hold any rotation or shear). Resets
+	// position/rotation/scale to identity, so they start out as offsets from the base.
+	void setLocalMatrix(const glm::mat4& matrix);
+
+	const glm::vec3& position() const { return localPosition; }
+	const glm::vec3& rotation() const { return localRotation; }
+	const glm::vec3& scale() const { return localScale; }
+	const glm::mat4& baseMatrix() const { return base; }
+	const glm::mat4& localMatrix() const { return local; }
+
+	// Hierarchy. A child is detached from its previous parent first.
+	void addChild(SceneNode* child);
+	void removeChild(SceneNode* child);
+	SceneNode* parent() const { return parentNode; }
+	const vector<SceneNode*>& children() const { return childNodes; }
+
+	// World transform, recomputed only if this node or one of its ancestors changed
+	const glm::mat4& worldMatrix() const;
+	// Inverse transpose of the world matrix's upper 3x3, for transforming normals
+	const glm::mat3& normalMatrix() const;
+	// Largest scale factor of the world matrix along any axis
+	float maxScale() const;
+
+	// World matrices recomputed so far, reported by the benchmark
+	static size_t WorldUpdates();
+
+private:
+	SceneNode* parentNode = nullptr;
+	vector<SceneNode*> childNodes;
+
+	glm::vec3 localPosition = glm::vec3(0.0f);
+	glm::vec3 localRotation = glm::vec3(0.0f);
+	glm::vec3 localScale = glm::vec3(1.0f);
+	glm::mat4 base = glm::mat4(1.0f);
+	glm::mat4 local = glm::mat4(1.0f);
+
+	// Cached world state, filled on demand
+	mutable glm::mat4 world = glm::mat4(1.0f);
+	mutable glm::mat3 normal = glm::mat3(1.0f);
+	mutable float worldMaxScale = 1.0f;
+	mutable bool dirty = true;
+
+	void updateLocal();
+	void markDirty();
+	void updateWorld() const;
+};
+
+#endif
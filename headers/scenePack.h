@@ -0,0 +1,161 @@
+#ifndef SCENE_PACK_H
+#define SCENE_PACK_H
+
+#include <mesh.h>
+#include <sceneNode.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Binary scene pack
+// -----------------
+// A cooked, memory-mappable copy of everything Model::loadModel produces from Assimp: the final
+// vertex arrays of every mesh (already in their GPU vertex layout, see vertexFormat.h), optimized 16/32-bit
+// index arrays with the ranges of every LOD (see meshOptimizer.h and meshSimplifier.h),
+// mesh names, material -> texture bindings, the shader features of every material and the node hierarchy
+// the meshes are attached to.
+// The pack records a hash of the source files, so it is only trusted while the source is unchanged.
+//
+// Layout (all offsets are absolute file offsets, array data is 16-byte aligned):
+//   PackHeader
+//   PackMeshRecord[meshCount]
+//   PackTextureRecord[...]          (textureCount per mesh, starting at textureFirst)
+//   PackLodRecord[...]              (lodCount per mesh, starting at lodFirst)
+//   PackNodeRecord[nodeCount]       (parents first)
+//   string data                     (names, texture types and paths, not null terminated)
+//   vertex/index arrays
+
+const uint32_t SCENE_PACK_MAGIC = 0x4B415053;	// "SPAK"
+const uint32_t SCENE_PACK_VERSION = 7;
+
+struct PackHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t sourceHash;
+	uint32_t vertexSize;		// sizeof(Vertex) when the pack was cooked
+	uint32_t meshCount;
+	uint32_t textureCount;
+	uint32_t lodCount;
+	uint32_t nodeCount;
+	uint32_t reserved;
+	double cookMs;				// Time the Assimp import took when the pack was cooked
+};
+
+struct PackString {
+	uint64_t offset;
+	uint32_t length;
+	uint32_t reserved;
+};
+
+struct PackMeshRecord {
+	PackString name;
+	uint64_t vertexOffset;
+	uint64_t indexOffset;
+	uint32_t vertexCount;
+	uint32_t indexCount;
+	uint32_t textureFirst;
+	uint32_t textureCount;
+	uint32_t vertexLayout;
+	uint32_t indexSize;			// 2 or 4 bytes
+	uint32_t lodFirst;
+	uint32_t lodCount;
+	uint32_t shaderFeatures;	// ShaderFeature bits of the material
+	uint32_t node;				// Node the mesh is attached to
+};
+
+struct PackTextureRecord {
+	PackString type;
+	PackString path;
+};
+
+struct PackLodRecord {
+	uint32_t indexOffset;		// In indices, relative to the mesh's index array
+	uint32_t indexCount;
+	float error;
+	uint32_t reserved;
+};
+
+struct PackNodeRecord {
+	PackString name;
+	int32_t parent;				// -1 for the root
+	uint32_t reserved;
+	float transform[16];		// Relative to the parent, column major
+};
+
+// Read-only memory mapping of a whole file
+class MappedFile {
+public:
+	MappedFile() = default;
+	~MappedFile();
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool open(const string& path);
+	void close();
+
+	const unsigned char* data() const { return bytes; }
+	size_t size() const { return length; }
+
+private:
+	const unsigned char* bytes = nullptr;
+	size_t length = 0;
+#ifdef _WIN32
+	void* fileHandle = nullptr;
+	void* mappingHandle = nullptr;
+#endif
+};
+
+// A texture binding of a mesh
+struct PackTexture {
+	string type;	// "texture_diffuse", "texture_specular", ...
+	string path;	// As referenced by the material
+};
+
+// View of one mesh, either pointing into a mapped pack or into a Mesh's own arrays
+struct PackMesh {
+	string name;
+	const unsigned char* vertexData = nullptr;	// vertexCount * VertexStride(vertexLayout) bytes
+	uint32_t vertexCount = 0;
+	uint32_t vertexLayout = VERTEX_LAYOUT_FULL;
+	const void* indexData = nullptr;			// indexCount * indexSize bytes
+	uint32_t indexCount = 0;
+	uint32_t indexSize = sizeof(unsigned int);
+	vector<MeshLod> lods;
+	vector<PackTexture> textures;
+	uint32_t shaderFeatures = 0;
+	uint32_t node = 0;
+};
+
+// An opened scene pack. The mesh views stay valid as long as the ScenePack is alive.
+class ScenePack {
+public:
+	// Map a pack and validate it against the hash of the current source files.
+	// Returns false (and leaves the pack empty) if the pack is missing, corrupt, stale or from another version.
+	bool open(const string& path, uint64_t expectedSourceHash);
+
+	const vector<PackMesh>& meshes() const { return packMeshes; }
+	const vector<ModelNode>& nodes() const { return packNodes; }
+	double cookMs() const { return cookTimeMs; }
+
+	// Write a pack for the given meshes and node hierarchy
+	static bool write(const string& path, uint64_t sourceHash, double cookMs, const vector<PackMesh>& meshes,
+		const vector<ModelNode>& nodes);
+
+private:
+	MappedFile file;
+	vector<PackMesh> packMeshes;
+	vector<ModelNode> packNodes;
+	double cookTimeMs = 0.0;
+};
+
+// 64-bit FNV-1a style hash over a byte range (processes 8-byte words for speed)
+uint64_t HashBytes(const void* data, size_t size, uint64_t seed = 14695981039346656037ull);
+
+// Hash of a model source file plus the material libraries its mtllib statements name (OBJ). Returns 0 if the
+// source cannot be read.
+uint64_t HashModelSource(const string& path);
+
+#endif
@@ -5,17 +5,98 @@
 #include <GL/glew.h>
 #include <glm/glm.hpp>
 
+#include <programCache.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <memory>
+#include <unordered_map>
+#include <vector>
 using namespace std;
 
+// Typed handle of a uniform, resolved once after linking so hot paths set uniforms without any name lookup.
+// set() writes to the program that is currently in use. Inactive uniforms have location -1, which GL ignores.
+template <typename T>
+struct Uniform {
+	GLint location = -1;
+
+	void set(const T& value) const;
+	bool valid() const { return location >= 0; }
+};
+
+template <> inline void Uniform<bool>::set(const bool& value) const { glUniform1i(location, (int)value); }
+template <> inline void Uniform<int>::set(const int& value) const { glUniform1i(location, value); }
+template <> inline void Uniform<float>::set(const float& value) const { glUniform1f(location, value); }
+template <> inline void Uniform<glm::vec2>::set(const glm::vec2& value) const { glUniform2fv(location, 1, &value[0]); }
+template <> inline void Uniform<glm::vec3>::set(const glm::vec3& value) const { glUniform3fv(location, 1, &value[0]); }
+template <> inline void Uniform<glm::vec4>::set(const glm::vec4& value) const { glUniform4fv(location, 1, &value[0]); }
+template <> inline void Uniform<glm::mat2>::set(const glm::mat2& value) const { glUniformMatrix2fv(location, 1, GL_FALSE, &value[0][0]); }
+template <> inline void Uniform<glm::mat3>::set(const glm::mat3& value) const { glUniformMatrix3fv(location, 1, GL_FALSE, &value[0][0]); }
+template <> inline void Uniform<glm::mat4>::set(const glm::mat4& value) const { glUniformMatrix4fv(location, 1, GL_FALSE, &value[0][0]); }
+
+// Active uniform of a linked program, as reported by glGetActiveUniform
+struct UniformInfo {
+	GLint location;
+	GLenum type;
+	GLint size;		// Array length, 1 for non-arrays
+};
+
+// Texture units of the material samplers. A sampler named <type>N (e.g. texture_specular1) is bound to
+// unit TEXTURE_UNIT_<type> + (N - 1) * MATERIAL_TEXTURE_TYPES once at link time, so drawing a mesh only
+// has to bind its textures to the right units.
+enum MaterialTextureUnit {
+	TEXTURE_UNIT_DIFFUSE = 0,
+	TEXTURE_UNIT_SPECULAR = 1,
+	TEXTURE_UNIT_NORMAL = 2,
+	TEXTURE_UNIT_HEIGHT = 3,
+	MATERIAL_TEXTURE_TYPES = 4
+};
+// Texture units of the samplers every program shares, bound once per frame rather than per draw
+enum SharedTextureUnit {
+	TEXTURE_UNIT_CLUSTER_LIGHTS = 12,		// clusterLights, see clusteredLighting.h
+	TEXTURE_UNIT_CLUSTER_GRID = 13,			// clusterGrid
+	TEXTURE_UNIT_CLUSTER_INDICES = 14		// clusterIndices
+};
+// Other samplers get units from here on, in the order they are reported
+const int FIRST_OTHER_TEXTURE_UNIT = 15;
+
+// Binding points of the shared uniform blocks (see uniformBuffers.h). Every program that declares one of
+// these blocks has it bound at link time, so one buffer per block serves all programs.
+enum UniformBlockBinding {
+	UBO_BINDING_FRAME = 0,
+	UBO_BINDING_LIGHTS = 1,
+	UBO_BINDING_OBJECT = 2
+};
+
+// Shader features
+// ---------------
+// Optional parts of vertex_shader.vert/fragment_shader.frag, each compiled in with a #define. Every mesh is
+// drawn with the variant for exactly the features its material needs (see ShaderVariants), so e.g. meshes
+// without a specular map never sample one.
+enum ShaderFeature : uint32_t {
+	SHADER_FEATURE_SPECULAR_MAP = 1 << 0,	// SPECULAR_MAP: specular term from texture_specular1, none without it
+	SHADER_FEATURE_NORMAL_MAP = 1 << 1,		// NORMAL_MAP: normals from texture_normal1 and the vertex tangents
+	SHADER_FEATURE_SPOT_LIGHTS = 1 << 2,	// SPOT_LIGHTS: clustered spot lights; without it ambient and moonlight only
+	SHADER_FEATURE_INSTANCED = 1 << 3,		// INSTANCED: transforms from the instance buffer (see instancing.h)
+	SHADER_FEATURE_ALPHA_TEST = 1 << 4,		// ALPHA_TEST: discard fragments whose diffuse alpha is below 0.5
+	SHADER_FEATURE_TEXTURE_ARRAY = 1 << 5	// TEXTURE_ARRAY: material samplers are texture arrays, layers per vertex (see textureArrays.h)
+};
+
+const int SHADER_FEATURE_COUNT = 6;
+
 class Shader {
 public:
 	unsigned int ID;
 
-	Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr) {
+
+	// 'defines' are injected as #define lines right after the #version line of every stage, e.g. { "INSTANCED" }.
+	// The linked program is cached as a binary (see programCache.h) and loaded from there on later launches.
+	Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr, const vector<string>& defines = vector<string>()) {
 		// 1. Retrieve the vertex/fragment source code from file path
 		string vertexCode;
 		string fragmentCode;
@@ -53,6 +134,33 @@ public:
 		catch (istream::failure& e) {
 			cout << "ERROR::SHADER::FILE_NOT_SUCCESSDULLY_READ: " << e.what() << endl;
 		}
+		vertexCode = injectDefines(vertexCode, defines);
+		fragmentCode = injectDefines(fragmentCode, defines);
+		geometryCode = injectDefines(geometryCode, defines);
+
+		// Try the program binary cache first
+		auto loadStart = chrono::steady_clock::now();
+		string programName = vertexPath;
+		for (const string& define : defines)
+			programName += " " + define;
+		bool useCache = ProgramCacheEnabled() && ProgramCacheSupported();
+		uint64_t cacheKey = 0;
+		string cachePath;
+		bool rejected = false;
+		if (useCache) {
+			cacheKey = ProgramCacheKey({ vertexCode, fragmentCode, geometryCode });
+			cachePath = ProgramCachePath(vertexPath, cacheKey);
+			ID = glCreateProgram();
+			double compileMs = 0.0;
+			if (LoadProgramBinary(ID, cachePath, cacheKey, rejected, compileMs)) {
+				RecordProgramLoad(programName, true, false, elapsedMs(loadStart), compileMs);
+				introspect();
+				bindUniformBlocks();
+				return;
+			}
+			glDeleteProgram(ID);
+		}
+
 		const char* vShaderCode = vertexCode.c_str();
 		const char* fShaderCode = fragmentCode.c_str();
 		// 2. compile shaders
@@ -83,76 +191,240 @@ public:
 		// If geometry shader exists
 		if (geometryPath != nullptr)
 			glAttachShader(ID, geometry);
+		if (useCache)
+			glProgramParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 		glLinkProgram(ID);
-		checkCompileErrors(ID, "PROGRAM");
+		bool linked = checkCompileErrors(ID, "PROGRAM");
 		// Delete the shaders as they're linked into the shader program and now no longer necessary
 		glDeleteShader(vertex);
 		glDeleteShader(fragment);
 		if (geometryPath != nullptr)
 			glDeleteShader(geometry);
+
+		double compileMs = elapsedMs(loadStart);
+		if (useCache && linked)
+			SaveProgramBinary(ID, cachePath, cacheKey, compileMs);
+		RecordProgramLoad(programName, false, rejected, compileMs, compileMs);
+
+		// 3. Resolve all uniform locations, bind the samplers to their texture units and the uniform blocks
+		// to their binding points
+		introspect();
+		bindUniformBlocks();
 	}
 
+	~Shader() {
+		glDeleteProgram(ID);
+	}
+
+	Shader(const Shader&) = delete;
+	Shader& operator=(const Shader&) = delete;
+
 	// Activate Shader
 	// ---------------
 	void use() {
 		glUseProgram(ID);
 	}
 
-	// Utility uniform funtions
+	// Typed handle of a uniform. Resolve handles once (e.g. after loading the shader), not per frame.
+	template <typename T>
+	Uniform<T> uniform(const string& name) const {
+		Uniform<T> handle;
+		handle.location = location(name);
+		return handle;
+	}
+
+	// Location of an active uniform from the table built at link time, -1 if it is not active
+	GLint location(const string& name) const {
+		auto it = uniforms.find(name);
+		return it != uniforms.end() ? it->second.location : -1;
+	}
+
+	const unordered_map<string, UniformInfo>& activeUniforms() const { return uniforms; }
+
+	// Texture unit a material sampler name (texture_diffuse1, texture_normal2, ...) is bound to, -1 if the
+	// name does not follow the <type>N convention
+	static int MaterialSamplerUnit(const string& name) {
+		static const char* const types[MATERIAL_TEXTURE_TYPES] = { "texture_diffuse", "texture_specular", "texture_normal", "texture_height" };
+		for (int type = 0; type < MATERIAL_TEXTURE_TYPES; type++) {
+			size_t length = char_traits<char>::length(types[type]);
+			if (name.size() <= length || name.compare(0, length, types[type]) != 0)
+				continue;
+			int number = atoi(name.c_str() + length);
+			if (number < 1)
+				return -1;
+			return type + (number - 1) * MATERIAL_TEXTURE_TYPES;
+		}
+		return -1;
+	}
+
+	// #define names of a feature mask, in bit order
+	static vector<string> FeatureDefines(uint32_t features) {
+		static const char* const names[SHADER_FEATURE_COUNT] = { "SPECULAR_MAP", "NORMAL_MAP", "SPOT_LIGHTS", "INSTANCED", "ALPHA_TEST", "TEXTURE_ARRAY" };
+		vector<string> defines;
+		for (int bit = 0; bit < SHADER_FEATURE_COUNT; bit++) {
+			if (features & (1u << bit))
+				defines.push_back(names[bit]);
+		}
+		return defines;
+	}
+
+	// Texture unit of a shared sampler, or -1 if the name is not one
+	static int SharedSamplerUnit(const string& name) {
+		if (name == "clusterLights")
+			return TEXTURE_UNIT_CLUSTER_LIGHTS;
+		if (name == "clusterGrid")
+			return TEXTURE_UNIT_CLUSTER_GRID;
+		if (name == "clusterIndices")
+			return TEXTURE_UNIT_CLUSTER_INDICES;
+		return -1;
+	}
+
+	// Utility uniform funtions. These look the name up in the location table; hot paths should use handles.
 	void setBool(const string& name, int value) const {
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+		glUniform1i(location(name), (int)value);
 	}
 	void setInt(const string& name, int value) const {
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+		glUniform1i(location(name), value);
 	}
 	void setFloat(const string& name, float value) const {
-		glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+		glUniform1f(location(name), value);
 	}
 	// ------------------------------------------------------------------------
 	void setVec2(const std::string& name, const glm::vec2& value) const
 	{
-		glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+		glUniform2fv(location(name), 1, &value[0]);
 	}
 	void setVec2(const std::string& name, float x, float y) const
 	{
-		glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+		glUniform2f(location(name), x, y);
 	}
 	// ------------------------------------------------------------------------
 	void setVec3(const std::string& name, const glm::vec3& value) const
 	{
-		glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+		glUniform3fv(location(name), 1, &value[0]);
 	}
 	void setVec3(const std::string& name, float x, float y, float z) const
 	{
-		glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+		glUniform3f(location(name), x, y, z);
 	}
 	// ------------------------------------------------------------------------
 	void setVec4(const std::string& name, const glm::vec4& value) const
 	{
-		glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+		glUniform4fv(location(name), 1, &value[0]);
 	}
 	void setVec4(const std::string& name, float x, float y, float z, float w) const
 	{
-		glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+		glUniform4f(location(name), x, y, z, w);
 	}
 	// ------------------------------------------------------------------------
 	void setMat2(const std::string& name, const glm::mat2& mat) const
 	{
-		glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+		glUniformMatrix2fv(location(name), 1, GL_FALSE, &mat[0][0]);
 	}
 	// ------------------------------------------------------------------------
 	void setMat3(const std::string& name, const glm::mat3& mat) const
 	{
-		glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+		glUniformMatrix3fv(location(name), 1, GL_FALSE, &mat[0][0]);
 	}
 	void setMat4(const std::string& name, const glm::mat4& mat) const {
-		glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+		glUniformMatrix4fv(location(name), 1, GL_FALSE, &mat[0][0]);
 	}
 
 private:
-	// Utility function for checking shader compilation/linking errors
-	// ---------------------------------------------------------------
-	void checkCompileErrors(unsigned int shader, std::string type) {
+	// Active uniforms by name. Array elements are stored under "name[i]" as well.
+	unordered_map<string, UniformInfo> uniforms;
+
+	static bool isSampler(GLenum type) {
+		switch (type) {
+		case GL_SAMPLER_1D: case GL_SAMPLER_2D: case GL_SAMPLER_3D: case GL_SAMPLER_CUBE:
+		case GL_SAMPLER_1D_SHADOW: case GL_SAMPLER_2D_SHADOW: case GL_SAMPLER_1D_ARRAY: case GL_SAMPLER_2D_ARRAY:
+		case GL_SAMPLER_1D_ARRAY_SHADOW: case GL_SAMPLER_2D_ARRAY_SHADOW: case GL_SAMPLER_CUBE_SHADOW: case GL_SAMPLER_BUFFER:
+		case GL_SAMPLER_2D_RECT: case GL_SAMPLER_2D_RECT_SHADOW: case GL_SAMPLER_2D_MULTISAMPLE: case GL_SAMPLER_2D_MULTISAMPLE_ARRAY:
+		case GL_INT_SAMPLER_2D: case GL_INT_SAMPLER_BUFFER: case GL_UNSIGNED_INT_SAMPLER_2D: case GL_UNSIGNED_INT_SAMPLER_BUFFER:
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	// Build the uniform location table and assign the sampler units
+	// -------------------------------------------------------------
+	void introspect() {
+		uniforms.clear();
+		GLint count = 0, maxLength = 0;
+		glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+		glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+		string buffer(static_cast<size_t>(maxLength > 0 ? maxLength : 1), '\0');
+
+		glUseProgram(ID);
+		int nextOtherUnit = FIRST_OTHER_TEXTURE_UNIT;
+		for (GLint i = 0; i < count; i++) {
+			GLsizei length = 0;
+			UniformInfo info;
+			glGetActiveUniform(ID, static_cast<GLuint>(i), maxLength, &length, &info.size, &info.type, &buffer[0]);
+			string name(buffer.c_str(), static_cast<size_t>(length));
+			info.location = glGetUniformLocation(ID, name.c_str());
+			if (info.location < 0)
+				continue;	// Uniform block members have no location
+
+			// Arrays are reported as "name[0]": store the plain name and every element
+			size_t bracket = name.rfind("[0]");
+			if (bracket != string::npos && bracket + 3 == name.size()) {
+				string base = name.substr(0, bracket);
+				uniforms[base] = info;
+				for (GLint element = 1; element < info.size; element++) {
+					string elementName = base + "[" + to_string(element) + "]";
+					uniforms[elementName] = { glGetUniformLocation(ID, elementName.c_str()), info.type, 1 };
+				}
+			}
+			uniforms[name] = info;
+
+			if (isSampler(info.type)) {
+				int unit = MaterialSamplerUnit(name);
+				if (unit < 0)
+					unit = SharedSamplerUnit(name);
+				glUniform1i(info.location, unit >= 0 ? unit : nextOtherUnit++);
+			}
+		}
+		glUseProgram(0);
+	}
+
+	// Insert the defines after the #version line, which has to stay the first line of the source
+	static string injectDefines(const string& code, const vector<string>& defines) {
+		if (defines.empty() || code.empty())
+			return code;
+		string lines;
+		for (const string& define : defines)
+			lines += "#define " + define + "\n";
+
+		size_t insertAt = 0;
+		if (code.compare(0, 8, "#version") == 0) {
+			size_t lineEnd = code.find('\n');
+			insertAt = lineEnd == string::npos ? code.size() : lineEnd + 1;
+		}
+		return code.substr(0, insertAt) + lines + code.substr(insertAt);
+	}
+
+	void bindUniformBlocks() {
+		static const struct { const char* name; UniformBlockBinding binding; } blocks[] = {
+			{ "FrameData", UBO_BINDING_FRAME },
+			{ "LightData", UBO_BINDING_LIGHTS },
+			{ "ObjectData", UBO_BINDING_OBJECT }
+		};
+		for (const auto& block : blocks) {
+			GLuint index = glGetUniformBlockIndex(ID, block.name);
+			if (index != GL_INVALID_INDEX)
+				glUniformBlockBinding(ID, index, block.binding);
+		}
+	}
+
+	static double elapsedMs(chrono::steady_clock::time_point start) {
+		return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+	}
+
+	// Utility function for checking shader compilation/linking errors, returns false on failure
+	// -----------------------------------------------------------------------------------------
+	bool checkCompileErrors(unsigned int shader, std::string type) {
 		int success;
 		char infoLog[1024];
 		if (type != "PROGRAM") {
@@ -169,8 +441,39 @@ private:
 				std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
 			}
 		}
+		return success != 0;
 	}
 };
 
 
+// Shader variants
+// ---------------
+// All feature variants of one vertex/fragment shader pair. A variant is compiled (or loaded from the program
+// cache) the first time it is requested and kept for the lifetime of the set.
+class ShaderVariants {
+public:
+	ShaderVariants(const string& vertexPath, const string& fragmentPath)
+		: vertexPath(vertexPath), fragmentPath(fragmentPath) {}
+
+	ShaderVariants(const ShaderVariants&) = delete;
+	ShaderVariants& operator=(const ShaderVariants&) = delete;
+
+	// Variant with exactly the given ShaderFeature bits
+	const Shader& get(uint32_t features) {
+		auto it = variants.find(features);
+		if (it == variants.end()) {
+			unique_ptr<Shader> shader = make_unique<Shader>(vertexPath.c_str(), fragmentPath.c_str(), nullptr, Shader::FeatureDefines(features));
+			it = variants.emplace(features, std::move(shader)).first;
+		}
+		return *it->second;
+	}
+
+	size_t size() const { return variants.size(); }
+
+private:
+	string vertexPath;
+	string fragmentPath;
+	unordered_map<uint32_t, unique_ptr<Shader>> variants;
+};
+
 #endif
\ No newline at end of file
@@ -0,0 +1,118 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include <blimpPath.h>
+#include <camera.h>
+#include <tripleBuffer.h>
+
+#include <glm/glm.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+using namespace std;
+
+// Run the simulation on its own thread (--sim-thread), or advance it on the GL thread once per frame
+// (default, keeps benchmark frames reproducible)
+void SetSimulationThread(bool enabled);
+bool SimulationThreadEnabled();
+
+// Fixed simulation rate of the interactive app (the benchmark uses its timestep)
+const float SIMULATION_TICK = 1.0f / 60.0f;
+const int SIMULATION_BLIMPS = 2;
+// A simulation further behind than this many ticks skips ahead instead of catching up
+const int SIMULATION_MAX_CATCH_UP = 5;
+
+// Totals of the simulation thread, reported by the benchmark
+struct SimulationStats {
+	bool threaded = false;
+	uint64_t ticks = 0;
+	double tickMs = 0.0;				// CPU time of all ticks
+	unsigned int skips = 0;				// Times the simulation fell too far behind and skipped ahead
+	unsigned int staleFrames = 0;		// Frames rendered without a new state since the previous frame
+
+	double meanTickMs() const { return ticks > 0 ? tickMs / ticks : 0.0; }
+};
+
+const SimulationStats& GetSimulationStats();
+
+// Everything the renderer needs from one simulation tick
+struct SimSnapshot {
+	uint64_t tick = 0;
+	chrono::steady_clock::time_point published;
+	glm::vec3 cameraPosition = glm::vec3(0.0f);
+	float cameraYaw = 0.0f;
+	float cameraPitch = 0.0f;
+	float cameraZoom = 0.0f;
+	glm::vec3 blimpPositions[SIMULATION_BLIMPS];
+	float blimpYaws[SIMULATION_BLIMPS] = {};
+};
+
+// Simulation thread
+// -----------------
+// Advances the game state (camera movement, blimp paths) at a fixed tick on its own thread and publishes
+// every tick as an immutable SimSnapshot through a triple buffer. The GL thread samples the last two
+// snapshots once per frame and interpolates between them, so rendering and simulating overlap and a frame
+// costs max(simulation, render) instead of their sum. The rendered state trails the simulation by up to
+// one tick.
+// The simulation only works on its own copies (a Camera and the BlimpPaths), never on models or scene
+// nodes, which belong to the GL thread. GLFW input can only be read on the main thread, so it is handed
+// over through setMovement/addLook/addZoom.
+class Simulation {
+public:
+	// 'cameraScript' replaces input-driven camera movement with a scripted path (the benchmark camera)
+	Simulation(const Camera& camera, const BlimpPath (&blimps)[SIMULATION_BLIMPS], float tickSeconds,
+		function<void(Camera&, float)> cameraScript = nullptr);
+	~Simulation();
+	Simulation(const Simulation&) = delete;
+	Simulation& operator=(const Simulation&) = delete;
+
+	void start();
+	void stop();
+
+	// Input from the main thread, applied by the next tick
+	void setMovement(bool forward, bool backward, bool left, bool right);
+	void addLook(float xoffset, float yoffset);
+	void addZoom(float yoffset);
+
+	// State to render this frame: interpolated between the two newest snapshots
+	SimSnapshot sample();
+
+private:
+	struct Input {
+		bool forward = false;
+		bool backward = false;
+		bool left = false;
+		bool right = false;
+		float lookX = 0.0f;
+		float lookY = 0.0f;
+		float zoom = 0.0f;
+	};
+
+	// Simulation thread state
+	Camera camera;
+	BlimpPath blimps[SIMULATION_BLIMPS];
+	float tickSeconds;
+	function<void(Camera&, float)> cameraScript;
+	uint64_t tick = 0;
+
+	mutex inputMutex;
+	Input input;
+
+	TripleBuffer<SimSnapshot> snapshots;
+	thread worker;
+	atomic<bool> running{ false };
+
+	// GL thread state
+	SimSnapshot previous;
+	SimSnapshot current;
+
+	void run();
+	void step();
+	void capture(SimSnapshot& snapshot) const;
+};
+
+#endif
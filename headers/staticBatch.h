@@ -0,0 +1,114 @@
+#ifndef STATIC_BATCH_H
+#define STATIC_BATCH_H
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/type_precision.hpp>
+
+#include <culling.h>
+#include <frameInfo.h>
+#include <meshSimplifier.h>
+#include <renderQueue.h>
+#include <textureArrays.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+using namespace std;
+
+class Model;
+class ShaderVariants;
+
+// Merge static models into shared buffers (default), or submit them mesh by mesh like dynamic models
+void SetStaticBatching(bool enabled);
+bool StaticBatchingEnabled();
+
+// Static geometry batch
+// ---------------------
+// The meshes of all static models, with their transforms baked into the vertices, merged into one
+// vertex/index buffer per vertex layout. Inside a buffer the meshes are grouped by material: every group
+// is one contiguous vertex range and one index range per mesh, and is drawn with a single
+// glMultiDrawElementsBaseVertex call. Each mesh keeps its LOD chain, so the LOD is still picked per mesh.
+// The world space boxes of the meshes go into a BVH, and only the meshes it finds in the frustum are drawn.
+// Meshes of models with depthPrepass set are also drawn in the depth pre-pass, from a separate stream that
+// holds only the positions of the buffer (12 bytes per vertex).
+// With texture arrays on, the textures of all meshes are packed into arrays (see textureArrays.h) and the
+// material of a group is its set of arrays, so meshes of different materials share a group. Their layers go
+// into another stream (4 bytes per vertex).
+class StaticBatch {
+public:
+	StaticBatch() = default;
+	~StaticBatch();
+	StaticBatch(const StaticBatch&) = delete;
+	StaticBatch& operator=(const StaticBatch&) = delete;
+
+	// Merge the meshes of the given models (using their current transforms)
+	void build(const vector<const Model*>& models);
+
+	// Submit one multi-draw per material group with the visible meshes, using the shader variant of the material.
+	// The batch is drawn with the identity object transform at 'objectOffset'.
+	void submit(RenderQueue& queue, ShaderVariants& shaders, const FrameInfo& frame, RenderStats& stats, uint32_t objectOffset);
+
+	// Compile the shader variants of all groups up front
+	void compileShaders(ShaderVariants& shaders, uint32_t shaderFeatureMask) const;
+
+	bool empty() const { return groups.empty(); }
+
+private:
+	// One source mesh inside a group
+	struct Part {
+		vector<MeshLod> lods;			// Index ranges relative to the group's first index
+		Aabb bounds;					// World space
+		glm::vec3 boundsCenter;
+		float boundsRadius;
+		unsigned int currentLod = 0;
+		uint32_t visibleFrame = 0;		// Last frame the part passed culling
+	};
+
+	// Meshes of one layout and material
+	struct Group {
+		size_t buffer;					// Index into buffers
+		uint32_t materialId;
+		uint32_t shaderFeatures;		// ShaderFeature bits of the material
+		bool depthPrepass;				// Drawn in the depth pre-pass too
+		GLenum indexType;
+		size_t indexByteOffset;			// Start of the group's indices in the buffer's EBO
+		GLint baseVertex;				// Start of the group's vertices in the buffer's VBO
+		vector<Part> parts;
+	};
+
+	// Shared buffers of one vertex layout
+	struct Buffer {
+		uint32_t layout;
+		GLuint VAO = 0, VBO = 0, EBO = 0;
+		GLuint depthVAO = 0, positionVBO = 0;	// Position-only stream, if a group of the buffer is pre-passed
+		GLuint layerVBO = 0;					// Texture array layers, if a group of the buffer uses arrays
+	};
+
+	vector<Buffer> buffers;
+	vector<Group> groups;
+	TextureArrays textureArrays;
+
+	// BVH over all parts; item i is the part bvhParts[i] (group, part)
+	Bvh bvh;
+	vector<pair<uint32_t, uint32_t>> bvhParts;
+	uint32_t frameCounter = 0;
+
+	// Per-frame culling scratch
+	vector<uint32_t> visibleItems;
+	vector<Aabb> visibleBoxes;
+	vector<uint8_t> visibleFlags;
+
+	Part& partOf(uint32_t item) { return groups[bvhParts[item].first].parts[bvhParts[item].second]; }
+
+	// Per-frame scratch for the multi-draw ranges
+	vector<GLsizei> counts;
+	vector<size_t> offsets;
+
+	void release();
+};
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef STREAM_BUFFER_H
+#define STREAM_BUFFER_H
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+#include <cstddef>
+#include <cstdint>
+using namespace std;
+
+// Map stream buffers persistently when the driver supports it (default), or use the GL 3.3 mapping path
+void SetPersistentMapping(bool enabled);
+bool PersistentMappingEnabled();
+
+// Whether persistent mapping can be used with the current context: GL 4.4 or ARB_buffer_storage. The app asks
+// for a 3.3 core context, so this depends on the driver exposing the extension.
+bool PersistentMappingSupported();
+
+// Streaming totals of all stream buffers, reported by the benchmark
+struct StreamBufferStats {
+	bool persistent = false;		// At least one buffer is persistently mapped
+	size_t bytesWritten = 0;
+	unsigned int fenceWaits = 0;	// Frames that had to wait for the GPU to release a segment
+	double fenceWaitMs = 0.0;
+	unsigned int grows = 0;			// Reallocations because a frame wrote more than a segment holds
+};
+
+const StreamBufferStats& GetStreamBufferStats();
+
+// Stream buffer
+// -------------
+// A GL buffer split into STREAM_BUFFER_FRAMES segments, one per frame in flight, that the CPU writes into
+// directly. Each frame writes one segment; when the ring comes back around to a segment, the fence
+// inserted after its last frame tells whether the GPU is done with it, so the buffer is never orphaned and
+// the driver never has to copy or synchronize behind the caller's back.
+// With persistent mapping the whole buffer is created with glBufferStorage and mapped once,
+// MAP_PERSISTENT | MAP_COHERENT. Otherwise (plain GL 3.3) the segment is mapped with glMapBufferRange
+// (MAP_UNSYNCHRONIZED, the fence provides the synchronization) at the start of the frame and unmapped
+// by flush().
+// A frame that writes more than a segment holds grows the buffer, keeping what was written so far.
+const int STREAM_BUFFER_FRAMES = 3;
+
+class StreamBuffer {
+public:
+	// 'alignment' is the offset alignment the target needs, e.g. GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+	StreamBuffer(GLenum target, size_t segmentSize, size_t alignment = 256);
+	~StreamBuffer();
+	StreamBuffer(const StreamBuffer&) = delete;
+	StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+	// Fence the segment of the last frame and move on to the next one, waiting until the GPU has released it
+	void beginFrame();
+
+	// Reserve 'size' bytes in this frame's segment. Returns where to write them; 'offset' is set to their
+	// offset from segmentOffset().
+	void* allocate(size_t size, size_t alignment, size_t& offset);
+
+	// Make this frame's writes visible to the GPU. Call before the draws that read them.
+	void flush();
+
+	GLuint buffer() const { return id; }
+	size_t segmentOffset() const { return size_t(segment) * segmentSize; }
+	bool persistent() const { return persistentMapping; }
+
+private:
+	GLenum target;
+	size_t alignment;
+	GLuint id = 0;
+	size_t segmentSize = 0;
+	bool persistentMapping = false;
+
+	unsigned char* mapped = nullptr;	// Start of the current segment while it is writable
+	unsigned char* persistentBase = nullptr;
+	int segment = 0;
+	size_t used = 0;
+	GLsync fences[STREAM_BUFFER_FRAMES] = {};
+
+	void create(size_t newSegmentSize);
+	void map(bool invalidate);
+	void unmap();
+	void grow(size_t required);
+	void deleteFences();
+};
+
+#endif
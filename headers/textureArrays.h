@@ -0,0 +1,76 @@
+#ifndef TEXTURE_ARRAYS_H
+#define TEXTURE_ARRAYS_H
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+// Draw static geometry with its textures packed into texture arrays (default), or with one texture set per
+// material group
+void SetTextureArrays(bool enabled);
+bool TextureArraysEnabled();
+
+// Vertex attribute holding the array layers of a vertex's material (diffuse, specular, normal), read by the
+// TEXTURE_ARRAY variant of vertex_shader.vert. Above the instance attributes (see instancing.h).
+const GLuint TEXTURE_LAYER_ATTRIBUTE = 12;
+
+// Layers are stored as 8-bit vertex attributes
+const uint32_t TEXTURE_ARRAY_MAX_LAYERS = 256;
+// Larger textures are scaled down to this size
+const int TEXTURE_ARRAY_MAX_SIZE = 2048;
+
+// Totals of all texture arrays built so far, reported by the benchmark
+struct TextureArrayStats {
+	unsigned int arrays = 0;
+	unsigned int layers = 0;
+	size_t gpuBytes = 0;		// Memory of the arrays' mip chains
+	size_t sourceBytes = 0;		// What the same textures take at their own size, in the same formats
+	double buildMs = 0.0;
+
+	// Memory added by scaling the textures up to their size buckets
+	size_t paddingBytes() const { return gpuBytes > sourceBytes ? gpuBytes - sourceBytes : 0; }
+};
+
+const TextureArrayStats& GetTextureArrayStats();
+
+// Where a texture was copied to
+struct TextureArraySlot {
+	GLuint array = 0;
+	uint32_t layer = 0;
+};
+
+// Texture arrays
+// --------------
+// Copies of a set of 2D textures, packed into GL_TEXTURE_2D_ARRAYs at load time. Every texture is read back
+// from the GPU, scaled up to its size bucket (the next power of two in each direction, so UVs and
+// GL_REPEAT wrapping stay valid without remapping) and cooked again like a cached texture (see
+// textureCache.h). Textures with the same bucket and cooked format share an array. A mesh then selects its
+// textures with the layer index instead of a bind, so meshes of different materials can be drawn together.
+// The source textures are kept, since dynamic models still bind them directly.
+class TextureArrays {
+public:
+	TextureArrays() = default;
+	~TextureArrays();
+	TextureArrays(const TextureArrays&) = delete;
+	TextureArrays& operator=(const TextureArrays&) = delete;
+
+	// Pack the given textures, replacing any arrays built before. Duplicates are packed once.
+	void build(const vector<GLuint>& textures);
+	void release();
+
+	// Returns false for textures that were not packed (e.g. unreadable or not uploaded)
+	bool find(GLuint texture, TextureArraySlot& slot) const;
+
+	size_t size() const { return arrays.size(); }
+
+private:
+	vector<GLuint> arrays;
+	unordered_map<GLuint, TextureArraySlot> slots;
+};
+
+#endif
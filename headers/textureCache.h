@@ -0,0 +1,59 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Cooked texture cache
+// --------------------
+// A cooked texture is an image with its complete, pre-generated mip chain, block-compressed to BC1 (opaque)
+// or BC3 (with alpha) when the driver supports S3TC, or stored raw otherwise. It is written next to the
+// source image as '<image>.ctex' and uploaded level by level without decoding or glGenerateMipmap.
+// The cache records a hash of the source image (and the gamma flag), so edited images are re-cooked.
+
+const uint32_t TEXTURE_CACHE_MAGIC = 0x58455443;	// "CTEX"
+const uint32_t TEXTURE_CACHE_VERSION = 1;
+
+enum class CookedFormat : uint32_t {
+	R8 = 0,
+	RGB8,
+	RGBA8,
+	BC1,		// 8 bytes per 4x4 block, opaque
+	BC3			// 16 bytes per 4x4 block, BC1 colour + interpolated alpha
+};
+
+struct CookedLevel {
+	uint32_t width;
+	uint32_t height;
+	uint64_t offset;	// Into CookedTexture::data
+	uint64_t size;
+};
+
+struct CookedTexture {
+	CookedFormat format = CookedFormat::RGBA8;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	vector<CookedLevel> levels;
+	vector<unsigned char> data;
+
+	bool compressed() const { return format == CookedFormat::BC1 || format == CookedFormat::BC3; }
+};
+
+// Build the mip chain of an 8-bit image (1-4 components) and compress it if requested.
+// With 'srgb' the mips are filtered in linear space.
+CookedTexture CookTexture(const unsigned char* pixels, int width, int height, int components, bool compress, bool srgb);
+
+// Cache key for a source image: hash of its contents and the gamma flag. Returns 0 if the file cannot be read.
+uint64_t TextureSourceHash(const string& imagePath, bool gamma);
+
+string TextureCachePath(const string& imagePath);
+bool ReadTextureCache(const string& cachePath, uint64_t sourceHash, CookedTexture& texture);
+bool WriteTextureCache(const string& cachePath, uint64_t sourceHash, const CookedTexture& texture);
+
+// GPU memory of an uncompressed RGB(A)/R texture of this size with a full mip chain
+size_t UncompressedTextureBytes(int width, int height, int components);
+
+#endif
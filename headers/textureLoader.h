@@ -1,8 +1,61 @@
 #ifndef TEXTURE_LOADER_H
 #define TEXTURE_LOADER_H
 
+#include <textureCache.h>
+
 #include <string>
+#include <vector>
 
 unsigned int TextureFromFile(const char* path, const std::string& directory, bool gamma = false);
 
-#endif
\ No newline at end of file
+// 1x1 opaque white texture, bound in place of a material's missing diffuse map so that texture_diffuse1 never
+// samples whatever an earlier draw left on its unit. Created on first use, GL thread only.
+unsigned int WhiteTexture();
+
+// Full path of a texture referenced by a material of a model in 'directory'
+std::string TextureFilename(const char* path, const std::string& directory);
+
+// Texture loading totals, reported by the benchmark
+struct TextureLoadStats {
+	unsigned int textures = 0;
+	unsigned int fromCache = 0;			// Uploaded from an up-to-date cooked .ctex file
+	unsigned int cooked = 0;			// Decoded from the image and cooked during this run
+	unsigned int fromImage = 0;			// Decoded from the image and mipmapped by the driver (cache disabled or unavailable)
+	double loadMs = 0.0;				// Wall time spent in TextureBatch::load
+	size_t gpuBytes = 0;				// Texture memory of all uploaded mip chains
+	size_t uncompressedBytes = 0;		// The same textures as uncompressed RGB(A) with driver-built mips
+};
+
+// The cooked texture cache (see textureCache.h) is used unless disabled, e.g. to measure the plain image path
+void SetTextureCacheEnabled(bool enabled);
+const TextureLoadStats& GetTextureLoadStats();
+
+// GL internal format of a cooked format; 'gamma' selects the sRGB variants
+unsigned int CookedInternalFormat(CookedFormat format, bool gamma);
+// GL pixel format of the uncompressed cooked formats
+unsigned int CookedPixelFormat(CookedFormat format);
+
+// Two-phase texture loading
+// -------------------------
+// Phase 1 (add): collect the texture files of a model or a whole scene. A GL texture name is reserved
+// immediately so meshes can reference it right away.
+// Phase 2 (load): decode all collected images concurrently on the shared job system. The calling thread,
+// which owns the GL context, uploads each image and builds its mipmaps as soon as its decode finishes.
+class TextureBatch {
+public:
+	unsigned int add(const char* path, const std::string& directory, bool gamma = false);
+	void load();
+
+	size_t size() const { return requests.size(); }
+
+private:
+	struct Request {
+		unsigned int id;
+		std::string filename;
+		bool gamma;
+	};
+
+	std::vector<Request> requests;
+};
+
+#endif
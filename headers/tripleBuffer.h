@@ -0,0 +1,50 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+#include <cstdint>
+using namespace std;
+
+// Lock-free single producer / single consumer triple buffer. The writer fills its back buffer and publishes
+// it by swapping it with the middle one; the reader swaps the middle buffer in as its front buffer when a
+// newer one was published. Neither side ever waits for the other: the writer always has a buffer to write,
+// and the reader always has the last complete one to read. States the reader was too slow to see are
+// skipped.
+template <typename T>
+class TripleBuffer {
+public:
+	TripleBuffer() = default;
+	explicit TripleBuffer(const T& initial) {
+		for (T& buffer : buffers)
+			buffer = initial;
+	}
+
+	TripleBuffer(const TripleBuffer&) = delete;
+	TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+	// Writer side
+	T& back() { return buffers[backIndex]; }
+	void publish() {
+		backIndex = middle.exchange(static_cast<uint8_t>(backIndex | FRESH), memory_order_acq_rel) & INDEX_MASK;
+	}
+
+	// Reader side. Returns true if a buffer published since the last call is now the front buffer.
+	bool update() {
+		if (!(middle.load(memory_order_relaxed) & FRESH))
+			return false;
+		frontIndex = middle.exchange(frontIndex, memory_order_acq_rel) & INDEX_MASK;
+		return true;
+	}
+	const T& front() const { return buffers[frontIndex]; }
+
+private:
+	static const uint8_t INDEX_MASK = 3;
+	static const uint8_t FRESH = 4;		// Set in 'middle' when it holds a buffer the reader has not seen
+
+	T buffers[3];
+	uint8_t backIndex = 0;			// Writer only
+	atomic<uint8_t> middle{ 1 };
+	uint8_t frontIndex = 2;			// Reader only
+};
+
+#endif
@@ -0,0 +1,109 @@
+#ifndef UNIFORM_BUFFERS_H
+#define UNIFORM_BUFFERS_H
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include <light.h>
+#include <streamBuffer.h>
+
+#include <cstddef>
+#include <cstdint>
+using namespace std;
+
+// Uniform blocks
+// --------------
+// Data shared by all programs lives in std140 uniform blocks, which Shader binds to fixed binding points
+// (see UniformBlockBinding in shader.h):
+//   FrameData   camera matrices and position, uploaded once per frame
+//   LightData   moonlight and the cluster grid parameters, uploaded once per frame. The spot lights themselves
+//               are too many for a uniform block and go through texture buffers (see clusteredLighting.h)
+//   ObjectData  per-object data, sub-allocated from a ring buffer and bound with a dynamic offset per draw
+// All three are streamed through StreamBuffers (see streamBuffer.h), so a frame's update never waits for
+// the GPU to finish with an earlier one.
+// The structs below mirror the GLSL declarations in the shaders and must be kept in sync with them.
+
+struct FrameUniforms {
+	glm::mat4 view;
+	glm::mat4 projection;
+	glm::mat4 viewProjection;
+	glm::vec4 viewPos;				// xyz
+};
+
+// One spot light in the light texture buffer: 7 RGBA32F texels, read back as a SpotLight in the fragment shader
+struct GpuSpotLight {
+	glm::vec4 position;				// xyz
+	glm::vec4 direction;			// xyz
+	glm::vec4 ambient;				// rgb
+	glm::vec4 diffuse;				// rgb
+	glm::vec4 specular;				// rgb
+	glm::vec4 cone;					// x = cos(cutOff), y = cos(outerCutOff)
+	glm::vec4 attenuation;			// x = constant, y = linear, z = quadratic
+};
+
+struct LightUniforms {
+	glm::vec4 ambient;				// rgb, scene ambient
+	glm::vec4 moonDirection;		// xyz
+	glm::vec4 moonColor;			// rgb
+	glm::ivec4 counts;				// x = number of spot lights
+	glm::ivec4 clusterCounts;		// xyz = clusters along x, y and depth
+	glm::vec4 clusterParams;		// x, y = scale and bias of the depth slice (from log of the view depth), zw = tile size in pixels
+};
+
+struct ObjectUniforms {
+	glm::mat4 model;
+	glm::mat4 normalMatrix;			// Upper 3x3 used, computed once on the CPU (see SceneNode::normalMatrix)
+};
+
+static_assert(sizeof(FrameUniforms) == 208, "FrameUniforms must match the std140 layout of FrameData");
+static_assert(sizeof(GpuSpotLight) == 7 * sizeof(glm::vec4), "GpuSpotLight must be 7 texels of the light buffer");
+static_assert(sizeof(LightUniforms) == 96, "LightUniforms must match the std140 layout of LightData");
+static_assert(sizeof(ObjectUniforms) == 128, "ObjectUniforms must match the std140 layout of ObjectData");
+
+GpuSpotLight ToGpuSpotLight(const SpotLight& light);
+
+// A uniform block bound to one binding point, rewritten as a whole once per frame
+class UniformBuffer {
+public:
+	UniformBuffer(GLuint binding, size_t size);
+	UniformBuffer(const UniformBuffer&) = delete;
+	UniformBuffer& operator=(const UniformBuffer&) = delete;
+
+	// Write the new contents into the next frame's segment and bind it
+	void update(const void* data);
+
+private:
+	GLuint binding;
+	size_t size;
+	StreamBuffer stream;
+};
+
+// Ring of per-object uniform data. Every frame, the data of all objects is pushed first, straight into this
+// frame's segment of a stream buffer, then made visible with one flush(), and each draw binds its own range.
+class UniformRing {
+public:
+	UniformRing(GLuint binding, size_t blockSize, size_t objectsPerFrame = 256);
+	UniformRing(const UniformRing&) = delete;
+	UniformRing& operator=(const UniformRing&) = delete;
+
+	void beginFrame();
+
+	// Copy one block into this frame's segment, returns its offset within the segment
+	uint32_t push(const void* data);
+
+	// Make everything pushed this frame visible to the GPU
+	void flush();
+
+	// Bind the block at 'offset' to the binding point
+	void bind(uint32_t offset) const;
+
+private:
+	GLuint binding;
+	size_t blockSize;
+	size_t stride;				// blockSize rounded up to GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+	StreamBuffer stream;
+};
+
+#endif
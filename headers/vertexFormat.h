@@ -0,0 +1,60 @@
+#ifndef VERTEX_FORMAT_H
+#define VERTEX_FORMAT_H
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+using namespace std;
+
+struct Vertex;
+
+// GPU vertex layouts
+// ------------------
+// Meshes are uploaded either in the full Vertex layout (56 bytes) or in a compact layout chosen per mesh:
+//   position   3 x float                                     12 bytes
+//   normal     GL_INT_2_10_10_10_REV, normalized            4 bytes
+//   texcoords  2 x half float, or 2 x float when the UVs     4 / 8 bytes
+//              are too large for half precision
+//   tangent    GL_INT_2_10_10_10_REV, w = bitangent sign     4 bytes, only when a normal map is bound
+// Attribute locations stay the same as the full layout (0 position, 1 normal, 2 texcoords, 3 tangent),
+// so the shaders work with every layout. The bitangent is reconstructed as cross(normal, tangent) * w.
+enum VertexLayoutFlags : uint32_t {
+	VERTEX_LAYOUT_FULL = 0,
+	VERTEX_LAYOUT_COMPACT = 1 << 0,		// Packed position/normal stream
+	VERTEX_LAYOUT_HALF_UV = 1 << 1,		// Texture coordinates as half floats
+	VERTEX_LAYOUT_TANGENT = 1 << 2		// Packed tangent frame
+};
+
+// Use the compact layouts for newly loaded meshes (default) or keep the full Vertex layout
+void SetCompactVertices(bool enabled);
+bool CompactVerticesEnabled();
+
+// Pick the layout of a mesh from its data and material
+uint32_t ChooseVertexLayout(const Vertex* vertices, size_t count, bool hasNormalMap);
+
+size_t VertexStride(uint32_t layout);
+
+// Convert Vertex data into the byte stream of a layout
+vector<unsigned char> PackVertices(const Vertex* vertices, size_t count, uint32_t layout);
+
+// Convert the byte stream of a layout back into Vertex data (exact for the full layout, quantized otherwise)
+vector<Vertex> UnpackVertices(const unsigned char* bytes, size_t count, uint32_t layout);
+
+// Enable and point the vertex attributes of a layout. Expects the VAO and the VBO to be bound.
+void SetupVertexAttributes(uint32_t layout);
+
+// Vertex/index memory of everything uploaded so far, reported by the benchmark
+struct GeometryMemoryStats {
+	unsigned int meshes = 0;
+	size_t vertices = 0;
+	size_t fullVertexBytes = 0;		// What the vertices would take in the full Vertex layout
+	size_t vertexBytes = 0;			// What they actually take
+	size_t indexBytes = 0;
+};
+
+void RecordMeshUpload(size_t vertexCount, uint32_t layout, size_t indexBytes);
+const GeometryMemoryStats& GetGeometryMemoryStats();
+
+#endif
@@ -0,0 +1,24 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+
+// Depth pre-pass: only the position is read, and gl_Position is computed exactly like in vertex_shader.vert
+// so that the colour pass can test against this depth with GL_EQUAL
+invariant gl_Position;
+
+// Shared uniform blocks, see uniformBuffers.h
+layout (std140) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 viewPos;
+};
+
+layout (std140) uniform ObjectData {
+    mat4 model;
+    mat4 modelNormalMatrix;     // Unused, declared so the block matches vertex_shader.vert
+};
+
+void main() {
+    vec3 worldPos = vec3(model * vec4(aPos, 1.0));
+    gl_Position = viewProjection * vec4(worldPos, 1.0);
+}
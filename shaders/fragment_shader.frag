@@ -1,88 +1,157 @@
 #version 330 core
 out vec4 FragColor;
 
+// Same layout as GpuSpotLight in uniformBuffers.h
 struct SpotLight {
-    vec3 position;
-    vec3 direction;
-    float cutOff;
-    float outerCutOff;
-
-    float constant;
-    float linear;
-    float quadratic;
-
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
+    vec4 position;      // xyz
+    vec4 direction;     // xyz
+    vec4 ambient;       // rgb
+    vec4 diffuse;       // rgb
+    vec4 specular;      // rgb
+    vec4 cone;          // x = cos(cutOff), y = cos(outerCutOff)
+    vec4 attenuation;   // x = constant, y = linear, z = quadratic
 };
 
-#define NR_SPOT_LIGHTS 2
+// Shared uniform blocks, see uniformBuffers.h
+layout (std140) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 viewPos;
+};
+
+layout (std140) uniform LightData {
+    vec4 ambientColor;
+    vec4 moonDirection;
+    vec4 moonColor;
+    ivec4 lightCounts;      // x = number of spot lights
+    ivec4 clusterCounts;    // xyz = clusters along x, y and depth
+    vec4 clusterParams;     // x, y = depth slice scale and bias, zw = tile size in pixels
+};
+
+// Clustered lights, see clusteredLighting.h
+uniform samplerBuffer clusterLights;    // 7 texels per light
+uniform usamplerBuffer clusterGrid;     // Per cluster: first index, light count
+uniform usamplerBuffer clusterIndices;  // Light indices of all clusters
 
 in vec2 TexCoords;
 in vec3 Normal;
 in vec3 FragPos;
 
-uniform sampler2D texture_diffuse1;
-uniform sampler2D texture_specular1;
-
-uniform vec3 lightPos;
-uniform vec3 viewPos;
-uniform SpotLight spotLights[NR_SPOT_LIGHTS];
-
-vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec2 texCoords);
+// With TEXTURE_ARRAY the material textures are layers of texture arrays, selected per vertex
+#ifdef TEXTURE_ARRAY
+#define MATERIAL_SAMPLER sampler2DArray
+flat in vec3 MaterialLayers;    // Diffuse, specular, normal
+#define SAMPLE_MATERIAL(sampler, layer) texture(sampler, vec3(TexCoords, MaterialLayers.layer))
+#else
+#define MATERIAL_SAMPLER sampler2D
+#define SAMPLE_MATERIAL(sampler, layer) texture(sampler, TexCoords)
+#endif
+
+// Always bound: materials without a diffuse map get a 1x1 white texture (see WhiteTexture in textureLoader.h)
+uniform MATERIAL_SAMPLER texture_diffuse1;
+#ifdef SPECULAR_MAP
+uniform MATERIAL_SAMPLER texture_specular1;
+#endif
+#ifdef NORMAL_MAP
+uniform MATERIAL_SAMPLER texture_normal1;
+in vec4 Tangent;
+#endif
+
+
+vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 diffuseColor, vec3 specularColor);
+SpotLight FetchSpotLight(int index);
 
 void main()
 {
+    // Material, sampled once for all lights
+    vec4 diffuseColor = SAMPLE_MATERIAL(texture_diffuse1, x);
+#ifdef ALPHA_TEST
+    if (diffuseColor.a < 0.5)
+        discard;
+#endif
+#ifdef SPECULAR_MAP
+    vec3 specularColor = SAMPLE_MATERIAL(texture_specular1, y).rgb;
+#else
+    vec3 specularColor = vec3(0.0);
+#endif
+
     // Properties
     vec3 norm = normalize(Normal);
-    vec3 viewDir = normalize(viewPos - FragPos);
+#ifdef NORMAL_MAP
+    // Tangent frame re-orthogonalized against the interpolated normal
+    vec3 tangent = normalize(Tangent.xyz - norm * dot(norm, Tangent.xyz));
+    vec3 bitangent = cross(norm, tangent) * (Tangent.w < 0.0 ? -1.0 : 1.0);
+    vec3 mappedNormal = SAMPLE_MATERIAL(texture_normal1, z).rgb * 2.0 - 1.0;
+    norm = normalize(mat3(tangent, bitangent, norm) * mappedNormal);
+#endif
+    vec3 viewDir = normalize(viewPos.xyz - FragPos);
 
     vec3 result = vec3(0.0);
 
     // Phase 1: Ambient
-    // vec3(0.05, 0.05, 0.1) to give a bluish tint to simulate nighttime. R = 0.05, G = 0.05, B = 0.1
-    vec3 ambient = vec3(0.05, 0.05, 0.1) * texture(texture_diffuse1, TexCoords).rgb;
+    // Bluish tint to simulate nighttime
+    vec3 ambient = ambientColor.rgb * diffuseColor.rgb;
     result += ambient;
 
     // Phase 2: Directional light
-    vec3 lightDir = normalize(vec3(-1.0f, -0.1f, -1.0f));
+    vec3 lightDir = normalize(moonDirection.xyz);
     float diff = max(dot(norm, lightDir), 0.0);
-    vec3 moonlight = vec3(0.6f, 0.6f, 0.7f) * diff * texture(texture_diffuse1, TexCoords).rgb;
+    vec3 moonlight = moonColor.rgb * diff * diffuseColor.rgb;
     result += moonlight;
 
-    // Phase 3: Spot lights
-    for (int i = 0; i < NR_SPOT_LIGHTS; i++) {
-        result += CalcSpotLight(spotLights[i], norm, FragPos, viewDir, TexCoords);
+#ifdef SPOT_LIGHTS
+    // Phase 3: Spot lights of this fragment's cluster
+    float viewDepth = -(view * vec4(FragPos, 1.0)).z;
+    int slice = clamp(int(floor(log(max(viewDepth, 1e-4)) * clusterParams.x + clusterParams.y)), 0, clusterCounts.z - 1);
+    ivec2 tile = clamp(ivec2(gl_FragCoord.xy / clusterParams.zw), ivec2(0), clusterCounts.xy - 1);
+    int cluster = tile.x + clusterCounts.x * (tile.y + clusterCounts.y * slice);
+    uvec2 lightRange = texelFetch(clusterGrid, cluster).xy;
+    for (uint i = 0u; i < lightRange.y; i++) {
+        int lightIndex = int(texelFetch(clusterIndices, int(lightRange.x + i)).x);
+        result += CalcSpotLight(FetchSpotLight(lightIndex), norm, FragPos, viewDir, diffuseColor.rgb, specularColor);
     }
+#endif
 
     FragColor = vec4(result, 1.0);
     // DEBUG 
     // FragColor = vec4(texture(texture_diffuse1, TexCoords).rgb, 1.0);
     // FragColor = vec4(cos(radians(12.5)), cos(radians(17.5)), 0.0, 1.0);
-    // float theta = dot(lightDir, normalize(-spotLights[0].direction));
-    // FragColor = vec4(theta);
-    // float d = length(spotLights[0].position - FragPos);
-    // FragColor = vec4(vec3(d / 10.0), 1.0);
-    // FragColor = vec4(spotLights[0].linear, spotLights[0].quadratic, 0.0, 1.0);
-    // float debug = spotLights[0].constant + spotLights[0].linear + spotLights[0].quadratic * 0.0;
-    // FragColor = vec4(spotLights[0].linear, spotLights[0].quadratic, 0.0, 1.0);
     // FragColor = vec4(attenuation, 1.0);
 }
 
+// Read one light from the light buffer
+SpotLight FetchSpotLight(int index) {
+    int base = index * 7;
+    SpotLight light;
+    light.position = texelFetch(clusterLights, base);
+    light.direction = texelFetch(clusterLights, base + 1);
+    light.ambient = texelFetch(clusterLights, base + 2);
+    light.diffuse = texelFetch(clusterLights, base + 3);
+    light.specular = texelFetch(clusterLights, base + 4);
+    light.cone = texelFetch(clusterLights, base + 5);
+    light.attenuation = texelFetch(clusterLights, base + 6);
+    return light;
+}
+
 // Calculate the color when using a spot light
-vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec2 texCoords) {
-    vec3 lightDir = normalize(light.position - fragPos);
+vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 diffuseColor, vec3 specularColor) {
+    vec3 lightDir = normalize(light.position.xyz - fragPos);
 
     // Diffuse shading
     float diff = max(dot(normal, lightDir), 0.0);
 
     // Specular shading
+#ifdef SPECULAR_MAP
     vec3 reflectDir = reflect(-lightDir, normal);
     float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32.0);  // 32.0 = shininess. hard coded for now
+#else
+    float spec = 0.0;
+#endif
 
     // Attenuation
-    float distance = length(light.position - fragPos);
-    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
+    float distance = length(light.position.xyz - fragPos);
+    float attenuation = 1.0 / (light.attenuation.x + light.attenuation.y * distance + light.attenuation.z * (distance * distance));
     // DEBUG
     // float attenuation = 0.0;
     // float attenuation = 1.0 / (1.0 + 0.09 * distance + 0.032 * distance * distance);
@@ -90,9 +159,9 @@ vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec
     // float attenuation = 1.0 / (attenuation.x + attenuation.y * distance + attenuation.z * (distance * distance));
 
     // Spot light intesity
-    float theta = dot(lightDir, normalize(-light.direction));
-    float epsilon = light.cutOff - light.outerCutOff;
-    float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
+    float theta = dot(lightDir, normalize(-light.direction.xyz));
+    float epsilon = light.cone.x - light.cone.y;
+    float intensity = clamp((theta - light.cone.y) / epsilon, 0.0, 1.0);
     // DEBUG
     // float theta = dot(lightDir, normalize(-light.direction));
     // float cutOff = cos(radians(12.5));
@@ -101,9 +170,9 @@ vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec
     // float intensity = clamp((theta - outerCutOff) / epsilon, 0.0, 1.0);
 
     // Combine results
-    vec3 ambient = light.ambient * texture(texture_diffuse1, texCoords).rgb;
-    vec3 diffuse = light.diffuse * diff * texture(texture_diffuse1, texCoords).rgb;
-    vec3 specular = light.specular * spec * texture(texture_specular1, texCoords).rgb;
+    vec3 ambient = light.ambient.rgb * diffuseColor;
+    vec3 diffuse = light.diffuse.rgb * diff * diffuseColor;
+    vec3 specular = light.specular.rgb * spec * specularColor;
 
     // ambient *= intensity;
     // diffuse *= intensity;
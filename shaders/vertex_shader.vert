@@ -3,18 +3,66 @@ layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
 
+// Feature defines (SPECULAR_MAP, NORMAL_MAP, SPOT_LIGHTS, INSTANCED, ALPHA_TEST, TEXTURE_ARRAY) are injected after the
+// #version line, see ShaderFeature in shader.h
+
+#ifdef NORMAL_MAP
+// Tangent and bitangent sign (see vertexFormat.h). The full vertex layout has no sign, w reads as 1 there.
+layout (location = 3) in vec4 aTangent;
+out vec4 Tangent;
+#endif
+
+// The INSTANCED variant reads the transform of every instance from the instance buffer (see instancing.h),
+// applied on top of the mesh's node transform from ObjectData
+#ifdef INSTANCED
+layout (location = 5) in mat4 aInstanceModel;
+layout (location = 9) in mat3 aInstanceNormalMatrix;
+#endif
+
+// The TEXTURE_ARRAY variant reads the array layers of the material's textures per vertex (see textureArrays.h)
+#ifdef TEXTURE_ARRAY
+layout (location = 12) in vec3 aMaterialLayers;
+flat out vec3 MaterialLayers;
+#endif
+
 out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoords;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// Must match depth_prepass.vert bit for bit, the colour pass of pre-passed meshes uses GL_EQUAL
+invariant gl_Position;
+
+// Shared uniform blocks, see uniformBuffers.h
+layout (std140) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 viewPos;
+};
+
+layout (std140) uniform ObjectData {
+    mat4 model;
+    mat4 modelNormalMatrix;     // Upper 3x3 used
+};
 
 void main() {
-	FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;  
+#ifdef INSTANCED
+    mat4 modelMatrix = aInstanceModel * model;
+    mat3 normalMatrix = aInstanceNormalMatrix * mat3(modelNormalMatrix);
+#else
+    mat4 modelMatrix = model;
+    mat3 normalMatrix = mat3(modelNormalMatrix);
+#endif
+
+	FragPos = vec3(modelMatrix * vec4(aPos, 1.0));
+    Normal = normalMatrix * aNormal;
     TexCoords = aTexCoords;
-    
-    gl_Position = projection * view * vec4(FragPos, 1.0);
-}
\ No newline at end of file
+#ifdef TEXTURE_ARRAY
+    MaterialLayers = aMaterialLayers;
+#endif
+#ifdef NORMAL_MAP
+    Tangent = vec4(mat3(modelMatrix) * aTangent.xyz, aTangent.w);
+#endif
+
+    gl_Position = viewProjection * vec4(FragPos, 1.0);
+}
@@ -1,13 +1,39 @@
 #include <app.h>
+#include <profiler.h>
 
-App::App()
-	: camera(glm::vec3(0.0f, 5.0f, 10.0f))
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <memory>
+
+App::App(const BenchSettings& bench)
+	: bench(bench)
+	, camera(glm::vec3(0.0f, 5.0f, 10.0f))
 {
+	if (bench.enabled) {
+		SCR_WIDTH = bench.width;
+		SCR_HEIGHT = bench.height;
+		// The offscreen target is exactly this size
+		framebufferWidth = SCR_WIDTH;
+		framebufferHeight = SCR_HEIGHT;
+	}
 }
 
-int App::run() {
+// Initialize GLFW, create the window/context and load the OpenGL function pointers.
+// In benchmark mode the window is hidden and rendering goes to an offscreen framebuffer.
+bool App::initWindow() {
+#if defined(__linux__) && GLFW_VERSION_MAJOR == 3 && GLFW_VERSION_MINOR >= 4
+	// Build boxes have no display server: fall back to the null platform with an EGL context (Mesa surfaceless)
+	if (bench.enabled && !getenv("DISPLAY") && !getenv("WAYLAND_DISPLAY"))
+		glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+#endif
+
 	// glfw: initialize and configure
-	glfwInit();
+	if (!glfwInit()) {
+		std::cout << "Failed to initialize GLFW" << std::endl;
+		return false;
+	}
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
@@ -16,32 +42,90 @@ int App::run() {
 	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 #endif
 
+	if (bench.enabled) {
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+#if GLFW_VERSION_MAJOR == 3 && GLFW_VERSION_MINOR >= 4
+		if (glfwGetPlatform() == GLFW_PLATFORM_NULL)
+			glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_EGL_CONTEXT_API);
+#endif
+	}
+
 	// glfw: window creation
 	window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "COMP 371 Project", NULL, NULL);
 	if (window == NULL) {
 		std::cout << "Failed to create GLFW window" << std::endl;
 		glfwTerminate();
-		return -1;
+		return false;
 	}
 
 	glfwSetWindowUserPointer(window, this); // Pass App instance to GLFW
 
 	glfwMakeContextCurrent(window);
-	glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-	glfwSetCursorPosCallback(window, mouse_callback);
-	glfwSetScrollCallback(window, scroll_callback);
-
-	// Tell GLFW to capture the mouse cursor
-	glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+	if (!bench.enabled) {
+		int width, height;
+		glfwGetFramebufferSize(window, &width, &height);
+		framebufferWidth = static_cast<unsigned int>(width);
+		framebufferHeight = static_cast<unsigned int>(height);
+		glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+		glfwSetCursorPosCallback(window, mouse_callback);
+		glfwSetScrollCallback(window, scroll_callback);
+		glfwSetKeyCallback(window, key_callback);
+
+		// Tell GLFW to capture the mouse cursor
+		glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+	}
+	else {
+		// Never wait for vsync while benchmarking
+		glfwSwapInterval(0);
+	}
 
 	// glew: load all OpenGL function pointers
 	glewExperimental = true; // Needed for core profile
 	if (glewInit() != GLEW_OK) {
 		std::cerr << "Failed to create GLEW" << std::endl;
 		glfwTerminate();
+		return false;
+	}
+
+	return true;
+}
+
+int App::run() {
+	SetProfilerThreadName("Main");
+	if (!initWindow())
 		return -1;
+
+	std::unique_ptr<Benchmark> benchmark;
+	if (bench.enabled) {
+		if (!createOffscreenTarget()) {
+			destroyOffscreenTarget();
+			glfwTerminate();
+			return -1;
+		}
+		benchmark = std::make_unique<Benchmark>(bench);
+		benchmark->beginLoad();
+	}
+
+	// All GL objects of the scene are owned by renderScene, so they are freed before the context goes away
+	renderScene(benchmark.get());
+	WriteProfilerTrace();	// Deletes the GPU queries, so before the context goes away
+
+	int exitCode = 0;
+	if (benchmark) {
+		benchmark->finish();
+		if (!benchmark->writeJson(bench.outputPath))
+			exitCode = -1;
+		benchmark.reset();	// Queries must be deleted while the context is still alive
+		destroyOffscreenTarget();
 	}
 
+	// glfw: terminate, clearing all previously allocated GLFW resources
+	glfwTerminate();
+	return exitCode;
+}
+
+// Load the scene and run the render loop until the window is closed or the benchmark is done
+void App::renderScene(Benchmark* benchmark) {
 	// Tell stb_image.h to flip loaded texture's on the y-axis (before loading model).
 	// stbi_set_flip_vertically_on_load(true);
 
@@ -49,19 +133,83 @@ int App::run() {
 	glEnable(GL_DEPTH_TEST);
 
 	// Build and compile shaders
-	Shader shader("shaders/vertex_shader.vert", "shaders/fragment_shader.frag");
-
-	// Load models
-	Model carModel("resources/objects/car/sportcar.017.obj");
-	Model roadModel("resources/objects/road/scene5.obj");
-	Blimp blimp_1("resources/objects/blimp_1/Aircraft.obj");
-	Blimp blimp_2("resources/objects/blimp_1/Aircraft.obj");
+	// One variant per combination of material features, see ShaderFeature in shader.h
+	ShaderVariants shaders("shaders/vertex_shader.vert", "shaders/fragment_shader.frag");
+	Shader depthShader("shaders/depth_prepass.vert", "shaders/depth_prepass.frag");
+
+	// Uniform blocks shared by all programs, and the ring the per-object data is streamed through
+	UniformBuffer frameUniforms(UBO_BINDING_FRAME, sizeof(FrameUniforms));
+	UniformBuffer lightUniforms(UBO_BINDING_LIGHTS, sizeof(LightUniforms));
+	ClusteredLighting clusteredLighting;
+	UniformRing objectUniforms(UBO_BINDING_OBJECT, sizeof(ObjectUniforms));
+	RenderQueue renderQueue;
+	std::cout << "Stream buffers: " << (GetStreamBufferStats().persistent ? "persistently mapped" : "mapped per frame") << std::endl;
+
+	// Load models. Their textures are collected first and then decoded in parallel for the whole scene.
+	TextureBatch sceneTextures;
+	Model carModel("resources/objects/car/sportcar.017.obj", false, &sceneTextures);
+	Model roadModel("resources/objects/road/scene5.obj", false, &sceneTextures);
+	Blimp blimp_1("resources/objects/blimp_1/Aircraft.obj", &sceneTextures);
+	Blimp blimp_2("resources/objects/blimp_1/Aircraft.obj", &sceneTextures);
+	sceneTextures.load();
 
 	// Set initial position
-	carModel.scale = vec3(0.05f, 0.05f, 0.05f);
-	carModel.position = vec3(1.0f, 0.3f, 0.0f);
-	roadModel.position = vec3(-9.0f, 0.0f, -9.0f); // Manually move the object origin to world origin (object origin is offset)
-	blimp_2.angle = pi<float>();	// Make blimp_2 face the opposite direction
+	carModel.node.setScale(vec3(0.05f, 0.05f, 0.05f));
+	carModel.node.setPosition(vec3(1.0f, 0.3f, 0.0f));
+	roadModel.node.setPosition(vec3(-9.0f, 0.0f, -9.0f)); // Manually move the object origin to world origin (object origin is offset)
+	blimp_2.path.angle = pi<float>();	// Make blimp_2 face the opposite direction
+
+	// The road and the parked car never move: merge them into shared buffers drawn with a few multi-draws
+	carModel.isStatic = true;
+	roadModel.isStatic = true;
+	// The road covers most of the screen: lay down its depth first so only visible fragments get shaded
+	roadModel.depthPrepass = true;
+	carModel.depthPrepass = true;
+	StaticBatch staticBatch;
+	if (StaticBatchingEnabled())
+		staticBatch.build({ &carModel, &roadModel });
+	const ObjectUniforms identityObject = { glm::mat4(1.0f), glm::mat4(1.0f) };
+
+	// The largest static meshes hide what is behind them
+	OcclusionCuller occlusion;
+	occlusion.setOccluders(BuildOccluders({ &carModel, &roadModel }));
+	Model* sceneModels[] = { &carModel, &roadModel };
+
+	// Both blimps share one asset and are drawn as instances of it
+	InstanceBatch blimps(blimp_1.asset);
+
+	// Benchmark crowd (--instances): copies of the car spread over the road in a grid, all drawn instanced.
+	// Only created when asked for, since the batch adds its instance attributes to the car's vertex arrays.
+	std::unique_ptr<InstanceBatch> crowd;
+	vector<glm::mat4> crowdTransforms;
+	if (bench.instances > 0) {
+		crowd = std::make_unique<InstanceBatch>(carModel.asset);
+		int side = static_cast<int>(ceil(sqrt(static_cast<float>(bench.instances))));
+		float spacing = 18.0f / side;
+		for (int i = 0; i < bench.instances; i++) {
+			vec3 position = vec3(-9.0f + spacing * (i % side + 0.5f), 0.3f, -9.0f + spacing * (i / side + 0.5f));
+			glm::mat4 transform = glm::translate(glm::mat4(1.0f), position);
+			transform = glm::rotate(transform, glm::radians(float(i * 37 % 360)), vec3(0.0f, 1.0f, 0.0f));
+			crowdTransforms.push_back(glm::scale(transform, carModel.node.scale()));
+		}
+	}
+
+	// Vertex memory report
+	const GeometryMemoryStats& geometry = GetGeometryMemoryStats();
+	std::cout << "Geometry: " << geometry.meshes << " meshes, " << geometry.vertices << " vertices, "
+		<< geometry.vertexBytes / 1024 << " KiB vertex data (" << geometry.fullVertexBytes / 1024 << " KiB in the full layout), "
+		<< geometry.indexBytes / 1024 << " KiB index data" << std::endl;
+
+	if (benchmark) {
+		benchmark->endLoad();
+		auto recordLoad = [benchmark](const char* name, const Model& model) {
+			benchmark->recordModelLoad({ name, model.loadStats.fromPack, model.loadStats.shared, model.loadStats.loadMs, model.loadStats.assimpMs });
+		};
+		recordLoad("car", carModel);
+		recordLoad("road", roadModel);
+		recordLoad("blimp_1", blimp_1);
+		recordLoad("blimp_2", blimp_2);
+	}
 
 	// Update model positions
 	blimp_1.update(deltaTime);
@@ -69,7 +217,7 @@ int App::run() {
 
 	// Set light properties
 	SpotLight blimpLight_1 = {
-		blimp_1.position,
+		blimp_1.node.position(),
 		vec3(0.0f, -1.0f, 0.0f),	// light direction (downward)
 		12.5f,						// cutOff
 		17.5f,						// outerCutOff
@@ -81,59 +229,272 @@ int App::run() {
 		0.002f						// quadratic	0.032, 0.0075, 
 	};
 	SpotLight blimpLight_2 = blimpLight_1;		// Duplicate setting
-	blimpLight_2.position = blimp_2.position;
+	blimpLight_2.position = blimp_2.node.position();
+
+	// All spot lights of the scene: the blimp lights first, then street lamps over the road (--lights)
+	vector<SpotLight> spotLights = { blimpLight_1, blimpLight_2 };
+	spotLights.resize(static_cast<size_t>(glm::clamp(bench.lights, 0, 2)));
+	int lampCount = bench.lights - 2;
+	if (lampCount > 0) {
+		int side = static_cast<int>(ceil(sqrt(static_cast<float>(lampCount))));
+		float spacing = 18.0f / side;
+		for (int i = 0; i < lampCount; i++) {
+			SpotLight lamp = {
+				vec3(-9.0f + spacing * (i % side + 0.5f), 3.0f, -9.0f + spacing * (i / side + 0.5f)),
+				vec3(0.0f, -1.0f, 0.0f),
+				25.0f,
+				35.0f,
+				vec3(0.0f),
+				vec3(1.0f, 0.75f + 0.05f * (i % 5), 0.45f),	// Warm, slightly varying
+				vec3(0.5f),
+				1.0f,
+				0.7f,
+				1.8f
+			};
+			spotLights.push_back(lamp);
+		}
+	}
+
+	// Without spot lights no material needs the light loop
+	uint32_t shaderFeatureMask = spotLights.empty() ? ~uint32_t(SHADER_FEATURE_SPOT_LIGHTS) : ~0u;
+
+	// Compile the variants the scene's materials need up front, so no frame waits for a compile
+	for (const ModelAsset* asset : { carModel.asset.get(), roadModel.asset.get(), blimp_1.asset.get() }) {
+		for (const Mesh& mesh : asset->meshes) {
+			shaders.get(mesh.shaderFeatures & shaderFeatureMask);
+			if (InstancingEnabled())
+				shaders.get((mesh.shaderFeatures & shaderFeatureMask) | SHADER_FEATURE_INSTANCED);
+		}
+	}
+	{
+		PROFILE_ZONE("Compile shader variants");
+		staticBatch.compileShaders(shaders, shaderFeatureMask);
+	}
+	std::cout << "Shader variants: " << shaders.size() << std::endl;
+
+	DirectionalLight moonlight = {
+		vec3(-1.0f, -0.1f, -1.0f),	// direction
+		vec3(0.6f, 0.6f, 0.7f)		// color
+	};
+	vec3 ambientColor = vec3(0.05f, 0.05f, 0.1f);	// Bluish tint to simulate nighttime
+
+	// Simulation thread: from here on the camera and the blimp paths are advanced there, and every frame
+	// renders the state interpolated from its snapshots
+	unique_ptr<Simulation> simulationThread;
+	if (SimulationThreadEnabled()) {
+		function<void(Camera&, float)> cameraScript;
+		if (bench.enabled) {
+			updateBenchCamera(camera, 0.0f);
+			cameraScript = updateBenchCamera;
+		}
+		const BlimpPath paths[SIMULATION_BLIMPS] = { blimp_1.path, blimp_2.path };
+		simulationThread = make_unique<Simulation>(camera, paths, bench.enabled ? bench.timestep : SIMULATION_TICK, cameraScript);
+		simulation = simulationThread.get();
+		simulation->start();
+	}
 
 	// Render loop
+	int frame = 0;
+	const int benchTotalFrames = bench.warmupFrames + bench.frames;
 	while (!glfwWindowShouldClose(window)) {
-		// per-frame time logic
-		float currentFrame = static_cast<float>(glfwGetTime());
-		deltaTime = currentFrame - lastFrame;
-		lastFrame = currentFrame;
-
-		// Input
-		processInput(window);
+		if (bench.enabled && frame >= benchTotalFrames)
+			break;
+		ProfilerBeginFrame();
+		PROFILE_GPU_ZONE("Frame");
+
+		if (bench.enabled) {
+			benchmark->beginFrame(frame >= bench.warmupFrames);
+
+			// Fixed timestep and scripted camera so every run renders the exact same frames
+			deltaTime = bench.timestep;
+			if (!simulation)
+				updateBenchCamera(camera, frame * bench.timestep);
+		}
+		else {
+			// per-frame time logic
+			float currentFrame = static_cast<float>(glfwGetTime());
+			deltaTime = currentFrame - lastFrame;
+			lastFrame = currentFrame;
+
+			// Input
+			PROFILE_ZONE("processInput");
+			processInput(window);
+		}
 
 		// Update model positions
-		blimp_1.update(deltaTime);
-		blimp_2.update(deltaTime);
+		if (simulation) {
+			PROFILE_ZONE("Simulation::sample");
+			SimSnapshot state = simulation->sample();
+			camera.Position = state.cameraPosition;
+			camera.SetOrientation(state.cameraYaw, state.cameraPitch);
+			camera.Zoom = state.cameraZoom;
+			blimp_1.place(state.blimpPositions[0], state.blimpYaws[0]);
+			blimp_2.place(state.blimpPositions[1], state.blimpYaws[1]);
+		}
+		else {
+			PROFILE_ZONE("Blimp::update");
+			blimp_1.update(deltaTime);
+			blimp_2.update(deltaTime);
+		}
 
 		// Update spotlight positions from the blimps
-		blimpLight_1.position = blimp_1.position;
-		blimpLight_2.position = blimp_2.position;
+		if (spotLights.size() > 1) {
+			spotLights[0].position = blimp_1.node.position();
+			spotLights[1].position = blimp_2.node.position();
+		}
 
 		// render
 		glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-		// Enable the shader program
-		shader.use();
+		// View/projection transformations. A minimized window has an empty framebuffer, keep the aspect finite.
+		FrameInfo frameInfo;
+		unsigned int viewportWidth = std::max(framebufferWidth, 1u);
+		unsigned int viewportHeight = std::max(framebufferHeight, 1u);
+		frameInfo.projection = glm::perspective(glm::radians(camera.Zoom), (float)viewportWidth / (float)viewportHeight, frameInfo.nearPlane, frameInfo.farPlane);
+		frameInfo.view = camera.GetViewMatrix();
+		frameInfo.viewPos = camera.Position;
+		frameInfo.viewportHeight = static_cast<float>(viewportHeight);
+		frameInfo.lodPixelError = LodSelectionEnabled() ? LOD_PIXEL_ERROR : 0.0f;
+		frameInfo.frustum = Frustum::FromMatrix(frameInfo.projection * frameInfo.view);
+		frameInfo.frustumCulling = FrustumCullingEnabled();
+		if (OcclusionCullingEnabled() && occlusion.occluderCount() > 0) {
+			PROFILE_ZONE("Occlusion");
+			occlusion.render(frameInfo.projection * frameInfo.view);
+			frameInfo.occlusion = &occlusion;
+		}
+		if (DepthPrepassEnabled())
+			frameInfo.depthShader = &depthShader;
+		frameInfo.shaderFeatureMask = shaderFeatureMask;
+
+		{
+			// Update the frame block
+			PROFILE_ZONE("Uniforms and lights");
+			FrameUniforms frameData;
+			frameData.view = frameInfo.view;
+			frameData.projection = frameInfo.projection;
+			frameData.viewProjection = frameInfo.projection * frameInfo.view;
+			frameData.viewPos = vec4(camera.Position, 1.0f);
+			frameUniforms.update(&frameData);
+
+			// Update the light block and assign the spot lights to the clusters of this view
+			LightUniforms lights = {};
+			lights.ambient = vec4(ambientColor, 0.0f);
+			lights.moonDirection = vec4(normalize(moonlight.direction), 0.0f);
+			lights.moonColor = vec4(moonlight.color, 0.0f);
+			clusteredLighting.update(spotLights, frameInfo.view, frameInfo.projection, frameInfo.nearPlane, frameInfo.farPlane,
+				viewportWidth, viewportHeight, lights);
+			lightUniforms.update(&lights);
+			clusteredLighting.bind();
+		}
+
+		// Per-object data of all models goes up in one upload before anything is drawn
+		auto submitStart = chrono::steady_clock::now();
+		RenderStats renderStats;
+		uint32_t staticObject;
+		{
+			PROFILE_ZONE("Prepare objects");
+			objectUniforms.beginFrame();
+			size_t worldUpdates = SceneNode::WorldUpdates();
+			staticObject = objectUniforms.push(&identityObject);
+			carModel.prepare(objectUniforms);
+			roadModel.prepare(objectUniforms);
+			blimps.clear();
+			blimps.add(blimp_1.node.worldMatrix());
+			blimps.add(blimp_2.node.worldMatrix());
+			blimps.prepare(objectUniforms, frameInfo, renderStats);
+			if (crowd) {
+				crowd->clear();
+				crowd->add(crowdTransforms);
+				crowd->prepare(objectUniforms, frameInfo, renderStats);
+			}
+			objectUniforms.flush();
+			renderStats.worldMatrixUpdates = SceneNode::WorldUpdates() - worldUpdates;
+		}
+
+		// Draw all models: the queue sorts the draws by state and skips redundant binds.
+		// Static models are drawn from the batch when there is one.
+		{
+			PROFILE_ZONE("Submit");
+			renderQueue.clear();
+			staticBatch.submit(renderQueue, shaders, frameInfo, renderStats, staticObject);
+			for (Model* model : sceneModels) {
+				if (!model->isStatic || staticBatch.empty())
+					model->submit(renderQueue, shaders, frameInfo, renderStats);
+			}
+			blimps.submit(renderQueue, shaders, frameInfo, renderStats);
+			if (crowd)
+				crowd->submit(renderQueue, shaders, frameInfo, renderStats);
+		}
+		{
+			PROFILE_GPU_ZONE("Draw");
+			renderQueue.execute(objectUniforms, renderStats, benchmark ? benchmark->samplesQuery() : 0);
+		}
+		renderStats.submitMs = chrono::duration<double, milli>(chrono::steady_clock::now() - submitStart).count();
+		if (frameInfo.occlusion)
+			renderStats.occlusionMs = occlusion.frameMs();
+		renderStats.lightAssignMs = clusteredLighting.assignMs();
+		renderStats.clusterLightIndices = clusteredLighting.indexCount();
+
+		if (bench.enabled) {
+			benchmark->endFrame(renderStats);
+			glfwPollEvents();
+		}
+		else {
+			// glfw: swap buffers and poll IO events
+			PROFILE_ZONE("glfwSwapBuffers");
+			glfwSwapBuffers(window);
+			glfwPollEvents();
+		}
+		frame++;
+	}
 
-		// Update shader
-		shader.setVec3("viewPos", camera.Position);
-		shader.setVec3("lightPos", vec3(1.2f, 1.0f, 2.0f));
-		setSpotLightUniforms(shader, blimpLight_1, 0);
-		setSpotLightUniforms(shader, blimpLight_2, 1);
+	if (simulation) {
+		simulation->stop();
+		simulation = nullptr;
+	}
+}
 
-		// View/projection transformations
-		glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-		glm::mat4 view = camera.GetViewMatrix();
-		shader.setMat4("projection", projection);
-		shader.setMat4("view", view);
+// Create the framebuffer the benchmark renders into instead of the (hidden) default framebuffer.
+// Returns false if it is incomplete, since nothing drawn to it would be measured.
+bool App::createOffscreenTarget() {
+	glGenFramebuffers(1, &benchFBO);
+	glBindFramebuffer(GL_FRAMEBUFFER, benchFBO);
+
+	glGenRenderbuffers(1, &benchColorRBO);
+	glBindRenderbuffer(GL_RENDERBUFFER, benchColorRBO);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, SCR_WIDTH, SCR_HEIGHT);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, benchColorRBO);
+
+	glGenRenderbuffers(1, &benchDepthRBO);
+	glBindRenderbuffer(GL_RENDERBUFFER, benchDepthRBO);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, SCR_WIDTH, SCR_HEIGHT);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, benchDepthRBO);
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		std::cout << "ERROR::FRAMEBUFFER::BENCHMARK_TARGET_INCOMPLETE" << std::endl;
+		return false;
+	}
 
-		// Draw all models
-		carModel.Draw(shader);
-		roadModel.Draw(shader);
-		blimp_1.Draw(shader);
-		blimp_2.Draw(shader);
+	glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
+	return true;
+}
 
-		// glfw: swap buffers and poll IO events
-		glfwSwapBuffers(window);
-		glfwPollEvents();
-	}
+void App::destroyOffscreenTarget() {
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glDeleteRenderbuffers(1, &benchColorRBO);
+	glDeleteRenderbuffers(1, &benchDepthRBO);
+	glDeleteFramebuffers(1, &benchFBO);
+}
 
-	// glfw: terminate, clearing all previously allocated GLFW resources
-	glfwTerminate();
-	return 0;
+// Scripted camera path for the benchmark: a slow orbit around the scene with a gentle height change
+void App::updateBenchCamera(Camera& camera, float time) {
+	const float radius = 12.0f;
+	const float period = 20.0f;		// seconds per orbit
+	float angle = 2.0f * pi<float>() * time / period;
+
+	camera.Position = vec3(radius * cos(angle), 4.0f + 1.5f * sin(angle * 2.0f), radius * sin(angle));
+	camera.LookAt(vec3(0.0f, 1.0f, 0.0f));
 }
 
 // Process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
@@ -146,6 +507,13 @@ void App::processInput(GLFWwindow* window) {
 	if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
 		glfwSetWindowShouldClose(window, true);
 
+	// With a simulation thread the camera moves there, at its own tick
+	if (app->simulation) {
+		app->simulation->setMovement(glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS, glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS,
+			glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS, glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS);
+		return;
+	}
+
 	if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
 		app->camera.ProcessKeyboard(FORWARD, app->deltaTime);
 	if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
@@ -156,26 +524,16 @@ void App::processInput(GLFWwindow* window) {
 		app->camera.ProcessKeyboard(RIGHT, app->deltaTime);
 }
 
-void App::setSpotLightUniforms(const Shader& shader, const SpotLight& light, int index)
-{
-	string prefix = "spotLights[" + std::to_string(index) + "].";
-	shader.setVec3(prefix + "position", light.position);
-	shader.setVec3(prefix + "direction", light.direction);
-	shader.setFloat(prefix + "cutOff", cos(radians(light.cutOff)));
-	shader.setFloat(prefix + "outerCutOff", cos(radians(light.outerCutOff)));
-	shader.setVec3(prefix + "ambient", light.ambient);
-	shader.setVec3(prefix + "diffuse", light.diffuse);
-	shader.setVec3(prefix + "specular", light.specular);
-	shader.setFloat(prefix + "constant", light.constant);
-	shader.setFloat(prefix + "linear", light.linear);
-	shader.setFloat(prefix + "quadratic", light.quadratic);
-}
-
 // Process window resize
 void App::framebuffer_size_callback(GLFWwindow* window, int width, int height) {
 	// make sure the viewport matches the new window dimensions; note that width and
 	// height will be significantly larger than specified on retina displays.
 	glViewport(0, 0, width, height);
+
+	App* app = static_cast<App*>(glfwGetWindowUserPointer(window));
+	if (!app) return;
+	app->framebufferWidth = static_cast<unsigned int>(width);
+	app->framebufferHeight = static_cast<unsigned int>(height);
 }
 
 // Process mouse movement
@@ -199,7 +557,25 @@ void App::mouse_callback(GLFWwindow* window, double xposIn, double yposIn) {
 	app->lastX = xpos;
 	app->lastY = ypos;
 
-	app->camera.ProcessMouseMovement(xoffset, yoffset);
+	if (app->simulation)
+		app->simulation->addLook(xoffset, yoffset);
+	else
+		app->camera.ProcessMouseMovement(xoffset, yoffset);
+}
+
+// Process key presses that toggle settings
+void App::key_callback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+	if (action != GLFW_PRESS)
+		return;
+
+	if (key == GLFW_KEY_O) {
+		SetOcclusionCulling(!OcclusionCullingEnabled());
+		std::cout << "Occlusion culling " << (OcclusionCullingEnabled() ? "on" : "off") << std::endl;
+	}
+	else if (key == GLFW_KEY_P) {
+		SetDepthPrepass(!DepthPrepassEnabled());
+		std::cout << "Depth pre-pass " << (DepthPrepassEnabled() ? "on" : "off") << std::endl;
+	}
 }
 
 // Process mouse scrolls
@@ -207,5 +583,8 @@ void App::scroll_callback(GLFWwindow* window, double xoffset, double yoffset) {
 	App* app = static_cast<App*>(glfwGetWindowUserPointer(window));
 	if (!app) return;
 
-	app->camera.ProcessMouseScroll(static_cast<float>(yoffset));
+	if (app->simulation)
+		app->simulation->addZoom(static_cast<float>(yoffset));
+	else
+		app->camera.ProcessMouseScroll(static_cast<float>(yoffset));
 }
\ No newline at end of file
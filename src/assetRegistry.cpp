@@ -0,0 +1,93 @@
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+#include <assetRegistry.h>
+#include <model.h>
+#include <profiler.h>
+#include <scenePack.h>
+
+#include <filesystem>
+#include <iostream>
+using namespace std;
+
+namespace {
+	string canonicalPath(const string& path) {
+		error_code ec;
+		filesystem::path canonical = filesystem::weakly_canonical(path, ec);
+		return ec ? path : canonical.string();
+	}
+
+	uint64_t hashFileContents(const string& path) {
+		MappedFile file;
+		if (!file.open(path))
+			return 0;
+		return HashBytes(file.data(), file.size());
+	}
+
+	// Look up a weak entry, dropping it if the asset has already been freed
+	template <typename Key, typename Asset>
+	shared_ptr<Asset> findLive(unordered_map<Key, weak_ptr<Asset>>& map, const Key& key) {
+		auto it = map.find(key);
+		if (it == map.end())
+			return nullptr;
+		shared_ptr<Asset> asset = it->second.lock();
+		if (!asset)
+			map.erase(it);
+		return asset;
+	}
+}
+
+TextureAsset::~TextureAsset() {
+	if (id != 0)
+		glDeleteTextures(1, &id);
+}
+
+AssetRegistry& AssetRegistry::instance() {
+	static AssetRegistry registry;
+	return registry;
+}
+
+shared_ptr<ModelAsset> AssetRegistry::loadModel(const string& path, bool gamma, TextureBatch* sceneTextures, bool* shared) {
+	PROFILE_ZONE("AssetRegistry::loadModel");
+	string key = canonicalPath(path) + (gamma ? "|srgb" : "");
+	shared_ptr<ModelAsset> asset = findLive(models, key);
+	if (shared)
+		*shared = asset != nullptr;
+	if (asset)
+		return asset;
+
+	asset = make_shared<ModelAsset>(path, gamma, sceneTextures);
+	models[key] = asset;
+	return asset;
+}
+
+shared_ptr<TextureAsset> AssetRegistry::loadTexture(const string& path, const string& directory, bool gamma, TextureBatch& batch) {
+	string filename = TextureFilename(path.c_str(), directory);
+	string key = canonicalPath(filename) + (gamma ? "|srgb" : "");
+
+	// 1. Same file
+	shared_ptr<TextureAsset> texture = findLive(texturesByPath, key);
+	if (texture)
+		return texture;
+
+	// 2. Same image under another name
+	uint64_t contentHash = hashFileContents(filename);
+	if (contentHash != 0) {
+		contentHash = HashBytes(&gamma, sizeof(gamma), contentHash);
+		texture = findLive(texturesByHash, contentHash);
+		if (texture) {
+			texturesByPath[key] = texture;
+			return texture;
+		}
+	}
+
+	// 3. New texture: queue it for decoding
+	texture = make_shared<TextureAsset>();
+	texture->id = batch.add(path.c_str(), directory, gamma);
+	texture->contentHash = contentHash;
+	texture->canonicalPath = key;
+	texturesByPath[key] = texture;
+	if (contentHash != 0)
+		texturesByHash[contentHash] = texture;
+	return texture;
+}
@@ -0,0 +1,397 @@
+#include <benchmark.h>
+#include <culling.h>
+#include <jobSystem.h>
+#include <profiler.h>
+#include <programCache.h>
+#include <renderQueue.h>
+#include <sceneNode.h>
+#include <simulation.h>
+#include <streamBuffer.h>
+#include <textureArrays.h>
+#include <textureLoader.h>
+#include <uniformBuffers.h>
+#include <vertexFormat.h>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+using namespace std;
+
+namespace {
+	double elapsedMs(chrono::steady_clock::time_point start) {
+		return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+	}
+
+	// Nearest-rank percentile of an unsorted sample set
+	double percentile(vector<double> samples, double p) {
+		if (samples.empty())
+			return 0.0;
+		sort(samples.begin(), samples.end());
+		size_t rank = static_cast<size_t>(p / 100.0 * (samples.size() - 1) + 0.5);
+		return samples[std::min(rank, samples.size() - 1)];
+	}
+
+	double mean(const vector<double>& samples) {
+		if (samples.empty())
+			return 0.0;
+		double sum = 0.0;
+		for (double s : samples)
+			sum += s;
+		return sum / samples.size();
+	}
+
+	void writeStats(ofstream& out, const vector<double>& samples) {
+		out << "{ \"mean\": " << mean(samples)
+			<< ", \"p50\": " << percentile(samples, 50.0)
+			<< ", \"p95\": " << percentile(samples, 95.0)
+			<< ", \"p99\": " << percentile(samples, 99.0)
+			<< ", \"max\": " << (samples.empty() ? 0.0 : *max_element(samples.begin(), samples.end()))
+			<< " }";
+	}
+
+	// Objects per job of the scaling benchmark's frame preparation
+	const size_t JOB_SCALING_GRAIN = 512;
+
+	// Synthetic scene of the scaling benchmark: objects on a square grid, each spinning and bobbing on its own phase
+	struct ScalingScene {
+		vector<SceneNode> nodes;
+		vector<float> phases;
+		Aabb localBounds;
+
+		// Per-frame output
+		vector<Aabb> bounds;
+		vector<uint8_t> visible;
+		vector<ObjectUniforms> uniforms;
+		vector<uint32_t> drawList;
+
+		explicit ScalingScene(size_t count)
+			: nodes(count), phases(count), bounds(count), visible(count), uniforms(count)
+		{
+			localBounds.min = glm::vec3(-0.5f, 0.0f, -1.0f);
+			localBounds.max = glm::vec3(0.5f, 1.0f, 1.0f);
+			size_t side = static_cast<size_t>(ceil(sqrt(static_cast<double>(count))));
+			for (size_t i = 0; i < count; i++) {
+				nodes[i].setPosition(glm::vec3((i % side) * 3.0f, 0.0f, (i / side) * 3.0f));
+				nodes[i].setScale(glm::vec3(1.0f + (i % 7) * 0.1f));
+				phases[i] = static_cast<float>(i % 360);
+			}
+			drawList.reserve(count);
+		}
+
+		// Animate, transform and cull objects [first, last)
+		void update(size_t first, size_t last, float time, const Frustum& frustum) {
+			for (size_t i = first; i < last; i++) {
+				SceneNode& node = nodes[i];
+				glm::vec3 position = node.position();
+				position.y = sin(time * 2.0f + phases[i]) * 0.25f;
+				node.setPosition(position);
+				node.setRotation(glm::vec3(0.0f, phases[i] + time * 45.0f, 0.0f));
+
+				const glm::mat4& world = node.worldMatrix();
+				bounds[i] = TransformAabb(localBounds, world);
+				uniforms[i].model = world;
+				uniforms[i].normalMatrix = glm::mat4(node.normalMatrix());
+			}
+			CullAabbs(frustum, bounds.data() + first, last - first, visible.data() + first);
+		}
+
+		// Gather the visible objects, in order, once all updates are done
+		void compact() {
+			drawList.clear();
+			for (size_t i = 0; i < visible.size(); i++)
+				if (visible[i])
+					drawList.push_back(static_cast<uint32_t>(i));
+		}
+	};
+
+	// One frame of preparation: the update jobs, then the compaction job depending on all of them
+	void prepareScalingFrame(JobSystem& jobs, ScalingScene& scene, float time) {
+		PROFILE_ZONE("Job scaling frame");
+		glm::vec3 eye(sin(time * 0.1f) * 200.0f + 300.0f, 40.0f, -50.0f);
+		glm::mat4 view = glm::lookAt(eye, glm::vec3(330.0f, 0.0f, 330.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+		glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 500.0f);
+		Frustum frustum = Frustum::FromMatrix(projection * view);
+
+		JobCounter updated;
+		JobCounter compacted;
+		size_t count = scene.nodes.size();
+		for (size_t first = 0; first < count; first += JOB_SCALING_GRAIN) {
+			size_t last = std::min(first + JOB_SCALING_GRAIN, count);
+			jobs.run([&scene, &frustum, first, last, time] { scene.update(first, last, time, frustum); }, &updated);
+		}
+		jobs.runAfter(updated, [&scene] { scene.compact(); }, &compacted);
+		jobs.wait(compacted);
+	}
+
+	const char* glString(GLenum name) {
+		const GLubyte* str = glGetString(name);
+		return str ? reinterpret_cast<const char*>(str) : "unknown";
+	}
+}
+
+bool RunJobScalingBenchmark(const BenchSettings& settings) {
+	size_t objects = static_cast<size_t>(std::max(settings.jobScalingObjects, 1));
+	unsigned int maxThreads = std::max(thread::hardware_concurrency(), 1u);
+	cout << "Job scaling: " << objects << " objects, " << settings.frames << " frames, 1 to " << maxThreads << " threads" << endl;
+
+	struct Result {
+		unsigned int threads;
+		vector<double> frameMs;
+		size_t visible;
+	};
+	vector<Result> results;
+	for (unsigned int threads = 1; threads <= maxThreads; threads++) {
+		// A fresh scene per run, so every run starts from cold caches and dirty nodes alike
+		ScalingScene scene(objects);
+		JobSystem jobs(threads - 1);
+		Result result{ threads, {}, 0 };
+		for (int frame = 0; frame < settings.warmupFrames + settings.frames; frame++) {
+			float time = frame * settings.timestep;
+			auto start = chrono::steady_clock::now();
+			prepareScalingFrame(jobs, scene, time);
+			if (frame >= settings.warmupFrames)
+				result.frameMs.push_back(elapsedMs(start));
+		}
+		result.visible = scene.drawList.size();
+		results.push_back(std::move(result));
+
+		const Result& last = results.back();
+		double serialMs = mean(results.front().frameMs);
+		double frameMs = mean(last.frameMs);
+		cout << "  " << setw(2) << threads << " threads: " << fixed << setprecision(3) << frameMs << " ms (p95 "
+			<< percentile(last.frameMs, 95.0) << " ms), speedup " << setprecision(2) << (frameMs > 0.0 ? serialMs / frameMs : 0.0)
+			<< ", " << last.visible << " visible" << endl;
+	}
+
+	ofstream out(settings.outputPath);
+	if (!out) {
+		cout << "ERROR::BENCHMARK::FAILED_TO_OPEN_OUTPUT: " << settings.outputPath << endl;
+		return false;
+	}
+	out << fixed << setprecision(4);
+	out << "{\n";
+	out << "  \"objects\": " << objects << ",\n";
+	out << "  \"frames\": " << settings.frames << ",\n";
+	out << "  \"warmup_frames\": " << settings.warmupFrames << ",\n";
+	out << "  \"grain\": " << JOB_SCALING_GRAIN << ",\n";
+	out << "  \"hardware_threads\": " << maxThreads << ",\n";
+	out << "  \"job_scaling\": [\n";
+	double serialMs = mean(results.front().frameMs);
+	for (size_t i = 0; i < results.size(); i++) {
+		const Result& result = results[i];
+		double frameMs = mean(result.frameMs);
+		out << "    { \"threads\": " << result.threads << ", \"frame_prep_ms\": ";
+		writeStats(out, result.frameMs);
+		out << ", \"speedup\": " << (frameMs > 0.0 ? serialMs / frameMs : 0.0) << ", \"visible\": " << result.visible << " }";
+		out << (i + 1 < results.size() ? ",\n" : "\n");
+	}
+	out << "  ]\n";
+	out << "}\n";
+	cout << "Job scaling -> " << settings.outputPath << endl;
+	return true;
+}
+
+Benchmark::Benchmark(const BenchSettings& settings)
+	: settings(settings)
+{
+	glGenQueries(QUERY_LATENCY, queries);
+	glGenQueries(QUERY_LATENCY, samplesQueries);
+	for (int i = 0; i < QUERY_LATENCY; i++)
+		queryFrame[i] = -1;
+	cpuFrameMs.reserve(settings.frames);
+	gpuFrameMs.reserve(settings.frames);
+	trianglesSubmitted.reserve(settings.frames);
+	trianglesAvailable.reserve(settings.frames);
+	submitMs.reserve(settings.frames);
+}
+
+Benchmark::~Benchmark() {
+	glDeleteQueries(QUERY_LATENCY, queries);
+	glDeleteQueries(QUERY_LATENCY, samplesQueries);
+}
+
+void Benchmark::beginLoad() {
+	loadStart = chrono::steady_clock::now();
+}
+
+void Benchmark::endLoad() {
+	// Make sure all uploads have actually been executed before stopping the clock
+	glFinish();
+	loadTimeMs = elapsedMs(loadStart);
+}
+
+void Benchmark::beginFrame(bool measuring) {
+	currentMeasured = measuring;
+	frameStart = chrono::steady_clock::now();
+	if (!currentMeasured)
+		return;
+
+	// Reuse the oldest query slot, reading back its result first
+	collectQuery(queryCursor);
+	queryFrame[queryCursor] = static_cast<int>(cpuFrameMs.size());
+	glBeginQuery(GL_TIME_ELAPSED, queries[queryCursor]);
+}
+
+void Benchmark::endFrame(const RenderStats& stats) {
+	if (!currentMeasured)
+		return;
+
+	glEndQuery(GL_TIME_ELAPSED);
+	queryCursor = (queryCursor + 1) % QUERY_LATENCY;
+
+	cpuFrameMs.push_back(elapsedMs(frameStart));
+	gpuFrameMs.push_back(0.0);
+	shadedSamples.push_back(0.0);
+	trianglesSubmitted.push_back(static_cast<double>(stats.trianglesSubmitted));
+	trianglesAvailable.push_back(static_cast<double>(stats.trianglesAvailable));
+	drawCalls.push_back(stats.drawCalls);
+	textureBinds.push_back(stats.textureBinds);
+	programSwitches.push_back(stats.programSwitches);
+	vaoSwitches.push_back(stats.vaoSwitches);
+	depthPrepassDraws.push_back(stats.depthPrepassDraws);
+	submitMs.push_back(stats.submitMs);
+	meshesTested.push_back(static_cast<double>(stats.culling.tested));
+	meshesCulled.push_back(static_cast<double>(stats.culling.culled));
+	meshesDrawn.push_back(static_cast<double>(stats.culling.drawn));
+	meshesOccluded.push_back(static_cast<double>(stats.culling.occluded));
+	occlusionMs.push_back(stats.occlusionMs);
+	lightAssignMs.push_back(stats.lightAssignMs);
+	clusterLightIndices.push_back(static_cast<double>(stats.clusterLightIndices));
+	worldMatrixUpdates.push_back(static_cast<double>(stats.worldMatrixUpdates));
+}
+
+void Benchmark::finish() {
+	for (int i = 0; i < QUERY_LATENCY; i++)
+		collectQuery(i);
+}
+
+void Benchmark::collectQuery(int slot) {
+	int frame = queryFrame[slot];
+	if (frame < 0)
+		return;
+
+	// Blocks only if the GPU is more than QUERY_LATENCY frames behind
+	GLuint64 elapsedNs = 0;
+	glGetQueryObjectui64v(queries[slot], GL_QUERY_RESULT, &elapsedNs);
+	gpuFrameMs[frame] = elapsedNs / 1.0e6;
+	GLuint64 samples = 0;
+	glGetQueryObjectui64v(samplesQueries[slot], GL_QUERY_RESULT, &samples);
+	shadedSamples[frame] = static_cast<double>(samples);
+	queryFrame[slot] = -1;
+}
+
+bool Benchmark::writeJson(const string& path) const {
+	ofstream out(path);
+	if (!out) {
+		cout << "ERROR::BENCHMARK::FAILED_TO_OPEN_OUTPUT: " << path << endl;
+		return false;
+	}
+
+	out << fixed << setprecision(4);
+	out << "{\n";
+	out << "  \"gl_vendor\": \"" << glString(GL_VENDOR) << "\",\n";
+	out << "  \"gl_renderer\": \"" << glString(GL_RENDERER) << "\",\n";
+	out << "  \"gl_version\": \"" << glString(GL_VERSION) << "\",\n";
+	out << "  \"width\": " << settings.width << ",\n";
+	out << "  \"height\": " << settings.height << ",\n";
+	out << "  \"timestep\": " << settings.timestep << ",\n";
+	out << "  \"warmup_frames\": " << settings.warmupFrames << ",\n";
+	out << "  \"frames\": " << cpuFrameMs.size() << ",\n";
+	out << "  \"instances\": " << settings.instances << ",\n";
+	out << "  \"lights\": " << settings.lights << ",\n";
+	out << "  \"load_ms\": " << loadTimeMs << ",\n";
+	out << "  \"models\": [\n";
+	for (size_t i = 0; i < modelLoads.size(); i++) {
+		const ModelLoadRecord& model = modelLoads[i];
+		out << "    { \"path\": \"" << model.path << "\", \"source\": \"" << (model.shared ? "shared" : model.fromPack ? "pack" : "assimp")
+			<< "\", \"load_ms\": " << model.loadMs << ", \"assimp_ms\": " << model.assimpMs
+			<< ", \"speedup\": " << (model.loadMs > 0.0 ? model.assimpMs / model.loadMs : 0.0) << " }";
+		out << (i + 1 < modelLoads.size() ? ",\n" : "\n");
+	}
+	out << "  ],\n";
+	const TextureLoadStats& textures = GetTextureLoadStats();
+	out << "  \"textures\": { \"count\": " << textures.textures << ", \"from_cache\": " << textures.fromCache
+		<< ", \"cooked\": " << textures.cooked << ", \"from_image\": " << textures.fromImage
+		<< ", \"load_ms\": " << textures.loadMs << ", \"gpu_bytes\": " << textures.gpuBytes
+		<< ", \"uncompressed_bytes\": " << textures.uncompressedBytes << " },\n";
+	const TextureArrayStats& arrays = GetTextureArrayStats();
+	out << "  \"texture_arrays\": { \"enabled\": " << (TextureArraysEnabled() ? "true" : "false")
+		<< ", \"arrays\": " << arrays.arrays << ", \"layers\": " << arrays.layers << ", \"gpu_bytes\": " << arrays.gpuBytes
+		<< ", \"source_bytes\": " << arrays.sourceBytes << ", \"padding_bytes\": " << arrays.paddingBytes()
+		<< ", \"build_ms\": " << arrays.buildMs << " },\n";
+	const SimulationStats& simulation = GetSimulationStats();
+	out << "  \"simulation\": { \"threaded\": " << (simulation.threaded ? "true" : "false")
+		<< ", \"ticks\": " << simulation.ticks << ", \"mean_tick_ms\": " << simulation.meanTickMs()
+		<< ", \"skips\": " << simulation.skips << ", \"stale_frames\": " << simulation.staleFrames << " },\n";
+	const StreamBufferStats& streams = GetStreamBufferStats();
+	out << "  \"stream_buffers\": { \"persistent\": " << (streams.persistent ? "true" : "false")
+		<< ", \"bytes_written\": " << streams.bytesWritten << ", \"fence_waits\": " << streams.fenceWaits
+		<< ", \"fence_wait_ms\": " << streams.fenceWaitMs << ", \"grows\": " << streams.grows << " },\n";
+	const ProgramCacheStats& programs = GetProgramCacheStats();
+	out << "  \"programs\": { \"count\": " << programs.programs << ", \"cache_hits\": " << programs.hits
+		<< ", \"cache_misses\": " << programs.misses << ", \"rejected\": " << programs.rejected
+		<< ", \"load_ms\": " << programs.loadMs << ", \"saved_ms\": " << programs.savedMs << " },\n";
+	out << "  \"job_threads\": " << JobSystem::shared().threadCount() << ",\n";
+	const GeometryMemoryStats& geometry = GetGeometryMemoryStats();
+	out << "  \"geometry\": { \"meshes\": " << geometry.meshes << ", \"vertices\": " << geometry.vertices
+		<< ", \"full_vertex_bytes\": " << geometry.fullVertexBytes << ", \"vertex_bytes\": " << geometry.vertexBytes
+		<< ", \"index_bytes\": " << geometry.indexBytes << " },\n";
+	out << "  \"triangles_submitted\": ";
+	writeStats(out, trianglesSubmitted);
+	out << ",\n";
+	out << "  \"triangles_available\": " << mean(trianglesAvailable) << ",\n";
+	out << "  \"state_changes\": { \"draw_calls\": " << mean(drawCalls) << ", \"texture_binds\": " << mean(textureBinds)
+		<< ", \"program_switches\": " << mean(programSwitches) << ", \"vao_switches\": " << mean(vaoSwitches) << " },\n";
+	out << "  \"depth_prepass\": { \"enabled\": " << (DepthPrepassEnabled() ? "true" : "false")
+		<< ", \"draw_calls\": " << mean(depthPrepassDraws) << " },\n";
+	out << "  \"shaded_samples\": ";
+	writeStats(out, shadedSamples);
+	out << ",\n";
+	out << "  \"culling\": { \"meshes_tested\": " << mean(meshesTested) << ", \"meshes_culled\": " << mean(meshesCulled)
+		<< ", \"meshes_occluded\": " << mean(meshesOccluded) << ", \"meshes_drawn\": " << mean(meshesDrawn) << " },\n";
+	out << "  \"occlusion_ms\": ";
+	writeStats(out, occlusionMs);
+	out << ",\n";
+	out << "  \"light_assign_ms\": ";
+	writeStats(out, lightAssignMs);
+	out << ",\n";
+	out << "  \"cluster_light_indices\": " << mean(clusterLightIndices) << ",\n";
+	out << "  \"world_matrix_updates\": " << mean(worldMatrixUpdates) << ",\n";
+	out << "  \"cpu_ms\": ";
+	writeStats(out, cpuFrameMs);
+	out << ",\n";
+	out << "  \"gpu_ms\": ";
+	writeStats(out, gpuFrameMs);
+	out << ",\n";
+	out << "  \"submit_ms\": ";
+	writeStats(out, submitMs);
+	out << ",\n";
+	out << "  \"per_frame\": [\n";
+	for (size_t i = 0; i < cpuFrameMs.size(); i++) {
+		out << "    { \"cpu\": " << cpuFrameMs[i] << ", \"gpu\": " << gpuFrameMs[i]
+			<< ", \"shaded_samples\": " << static_cast<size_t>(shadedSamples[i])
+			<< ", \"triangles\": " << static_cast<size_t>(trianglesSubmitted[i])
+			<< ", \"meshes_tested\": " << static_cast<size_t>(meshesTested[i]) << ", \"meshes_culled\": " << static_cast<size_t>(meshesCulled[i])
+			<< ", \"meshes_occluded\": " << static_cast<size_t>(meshesOccluded[i]) << ", \"meshes_drawn\": " << static_cast<size_t>(meshesDrawn[i]) << " }";
+		out << (i + 1 < cpuFrameMs.size() ? ",\n" : "\n");
+	}
+	out << "  ]\n";
+	out << "}\n";
+
+	cout << "Textures: " << textures.textures << " (" << textures.fromCache << " cached, " << textures.cooked << " cooked, "
+		<< textures.fromImage << " from image) in " << textures.loadMs << " ms, " << textures.gpuBytes / 1024 << " KiB (uncompressed "
+		<< textures.uncompressedBytes / 1024 << " KiB)" << endl;
+	cout << "Benchmark: " << cpuFrameMs.size() << " frames, load " << loadTimeMs << " ms, cpu p50 "
+		<< percentile(cpuFrameMs, 50.0) << " ms, gpu p50 " << percentile(gpuFrameMs, 50.0) << " ms, shaded samples p50 "
+		<< static_cast<size_t>(percentile(shadedSamples, 50.0)) << ", submit p50 "
+		<< percentile(submitMs, 50.0) << " ms, triangles "
+		<< static_cast<size_t>(mean(trianglesSubmitted)) << " / " << static_cast<size_t>(mean(trianglesAvailable)) << ", draw calls "
+		<< mean(drawCalls) << ", texture binds " << mean(textureBinds) << ", meshes drawn " << mean(meshesDrawn) << " / "
+		<< mean(meshesDrawn) + mean(meshesCulled) + mean(meshesOccluded) << " (" << mean(meshesOccluded) << " occluded, "
+		<< percentile(occlusionMs, 50.0) << " ms) -> " << path << endl;
+	return true;
+}
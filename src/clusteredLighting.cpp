@@ -0,0 +1,230 @@
+#include <clusteredLighting.h>
+#include <profiler.h>
+#include <shader.h>
+#include <jobSystem.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+using namespace std;
+
+namespace {
+	// Below this many lights the assignment is cheaper than handing it to the workers
+	const size_t PARALLEL_LIGHT_THRESHOLD = 32;
+
+	bool sphereTouchesBox(const glm::vec3& center, float radius, const Aabb& box) {
+		glm::vec3 closest = glm::clamp(center, box.min, box.max);
+		glm::vec3 offset = center - closest;
+		return glm::dot(offset, offset) <= radius * radius;
+	}
+}
+
+float SpotLightRange(const SpotLight& light) {
+	float target = 1.0f / LIGHT_ATTENUATION_CUTOFF;
+	if (light.constant >= target)
+		return 0.0f;
+	if (light.quadratic > 0.0f) {
+		float discriminant = light.linear * light.linear - 4.0f * light.quadratic * (light.constant - target);
+		return (-light.linear + sqrt(discriminant)) / (2.0f * light.quadratic);
+	}
+	if (light.linear > 0.0f)
+		return (target - light.constant) / light.linear;
+	return INFINITY;
+}
+
+ClusteredLighting::ClusteredLighting() {
+	static const GLenum formats[3] = { GL_RGBA32F, GL_RG32UI, GL_R16UI };
+	glGenBuffers(3, buffers);
+	glGenTextures(3, textures);
+	for (int i = 0; i < 3; i++) {
+		glBindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+		glBufferData(GL_TEXTURE_BUFFER, 16, nullptr, GL_STREAM_DRAW);
+		glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+		glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers[i]);
+	}
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	clusterLights.resize(CLUSTER_COUNT);
+	grid.resize(CLUSTER_COUNT);
+}
+
+ClusteredLighting::~ClusteredLighting() {
+	glDeleteTextures(3, textures);
+	glDeleteBuffers(3, buffers);
+}
+
+void ClusteredLighting::buildClusterBoxes(const glm::mat4& projection, float nearPlane, float farPlane, int width, int height) {
+	clusterBoxes.resize(CLUSTER_COUNT);
+	float tileWidth = ceil(float(width) / CLUSTERS_X);
+	float tileHeight = ceil(float(height) / CLUSTERS_Y);
+
+	// Symmetric perspective projection: a point at view depth d and NDC x has view x = ndc * d / projection[0][0]
+	for (int z = 0; z < CLUSTERS_Z; z++) {
+		float sliceNear = nearPlane * pow(farPlane / nearPlane, float(z) / CLUSTERS_Z);
+		float sliceFar = nearPlane * pow(farPlane / nearPlane, float(z + 1) / CLUSTERS_Z);
+		for (int y = 0; y < CLUSTERS_Y; y++) {
+			float ndcY0 = y * tileHeight / height * 2.0f - 1.0f;
+			float ndcY1 = (y + 1) * tileHeight / height * 2.0f - 1.0f;
+			for (int x = 0; x < CLUSTERS_X; x++) {
+				float ndcX0 = x * tileWidth / width * 2.0f - 1.0f;
+				float ndcX1 = (x + 1) * tileWidth / width * 2.0f - 1.0f;
+
+				Aabb& box = clusterBoxes[x + CLUSTERS_X * (y + CLUSTERS_Y * z)];
+				box.min = glm::vec3(INFINITY);
+				box.max = glm::vec3(-INFINITY);
+				for (float depth : { sliceNear, sliceFar }) {
+					for (float ndcX : { ndcX0, ndcX1 }) {
+						for (float ndcY : { ndcY0, ndcY1 }) {
+							glm::vec3 corner(ndcX * depth / projection[0][0], ndcY * depth / projection[1][1], -depth);
+							box.min = glm::min(box.min, corner);
+							box.max = glm::max(box.max, corner);
+						}
+					}
+				}
+			}
+		}
+	}
+
+	boxesProjection = projection;
+	boxesWidth = width;
+	boxesHeight = height;
+}
+
+void ClusteredLighting::update(const vector<SpotLight>& lights, const glm::mat4& view, const glm::mat4& projection,
+	float nearPlane, float farPlane, int width, int height, LightUniforms& uniforms)
+{
+	PROFILE_ZONE("ClusteredLighting::update");
+	auto start = chrono::steady_clock::now();
+	if (projection != boxesProjection || width != boxesWidth || height != boxesHeight)
+		buildClusterBoxes(projection, nearPlane, farPlane, width, height);
+
+	float tileWidth = ceil(float(width) / CLUSTERS_X);
+	float tileHeight = ceil(float(height) / CLUSTERS_Y);
+	float sliceScale = CLUSTERS_Z / log(farPlane / nearPlane);
+	float sliceBias = -CLUSTERS_Z * log(nearPlane) / log(farPlane / nearPlane);
+	auto sliceOf = [&](float depth) {
+		return glm::clamp(static_cast<int>(floor(log(depth) * sliceScale + sliceBias)), 0, CLUSTERS_Z - 1);
+	};
+
+	// 1. Bound every light and find the cluster range it may touch
+	size_t lightCount = glm::min(lights.size(), MAX_CLUSTERED_LIGHTS);
+	gpuLights.resize(lightCount);
+	bounds.resize(lightCount);
+	for (size_t i = 0; i < lightCount; i++) {
+		const SpotLight& light = lights[i];
+		gpuLights[i] = ToGpuSpotLight(light);
+
+		// Sphere around the cone of the outer cut-off
+		float range = glm::min(SpotLightRange(light), farPlane);
+		float angle = glm::radians(glm::clamp(light.outerCutOff, 0.0f, 89.0f));
+		glm::vec3 direction = glm::normalize(light.direction);
+		glm::vec3 center;
+		float radius;
+		if (angle > glm::radians(45.0f)) {
+			center = light.position + direction * (range * cos(angle));
+			radius = range * sin(angle);
+		}
+		else {
+			radius = range / (2.0f * cos(angle));
+			center = light.position + direction * radius;
+		}
+
+		LightBounds& bound = bounds[i];
+		bound.center = glm::vec3(view * glm::vec4(center, 1.0f));
+		bound.radius = radius;
+		float nearest = -bound.center.z - radius;
+		float farthest = -bound.center.z + radius;
+		bound.active = range > 0.0f && farthest >= nearPlane && nearest <= farPlane;
+		if (!bound.active)
+			continue;
+		bound.minZ = sliceOf(glm::max(nearest, nearPlane));
+		bound.maxZ = sliceOf(glm::min(farthest, farPlane));
+
+		// Screen rectangle of the sphere's view space box, or the whole screen if it reaches the near plane
+		bound.minX = 0;
+		bound.maxX = CLUSTERS_X - 1;
+		bound.minY = 0;
+		bound.maxY = CLUSTERS_Y - 1;
+		if (nearest > nearPlane) {
+			glm::vec2 minimum(INFINITY), maximum(-INFINITY);
+			for (int corner = 0; corner < 8; corner++) {
+				glm::vec3 offset(corner & 1 ? radius : -radius, corner & 2 ? radius : -radius, corner & 4 ? radius : -radius);
+				glm::vec4 clip = projection * glm::vec4(bound.center + offset, 1.0f);
+				glm::vec2 ndc = glm::vec2(clip) / clip.w;
+				minimum = glm::min(minimum, ndc);
+				maximum = glm::max(maximum, ndc);
+			}
+			bound.minX = glm::clamp(static_cast<int>(floor((minimum.x * 0.5f + 0.5f) * width / tileWidth)), 0, CLUSTERS_X - 1);
+			bound.maxX = glm::clamp(static_cast<int>(floor((maximum.x * 0.5f + 0.5f) * width / tileWidth)), 0, CLUSTERS_X - 1);
+			bound.minY = glm::clamp(static_cast<int>(floor((minimum.y * 0.5f + 0.5f) * height / tileHeight)), 0, CLUSTERS_Y - 1);
+			bound.maxY = glm::clamp(static_cast<int>(floor((maximum.y * 0.5f + 0.5f) * height / tileHeight)), 0, CLUSTERS_Y - 1);
+			if (maximum.x < -1.0f || minimum.x > 1.0f || maximum.y < -1.0f || minimum.y > 1.0f)
+				bound.active = false;
+		}
+	}
+
+	// 2. Fill the cluster lists. Every job owns a range of depth slices, so no two write the same cluster.
+	if (lightCount < PARALLEL_LIGHT_THRESHOLD) {
+		assignSlices(0, CLUSTERS_Z);
+	}
+	else {
+		JobSystem::shared().parallelFor(0, CLUSTERS_Z, 1, [this](size_t first, size_t last) {
+			assignSlices(static_cast<int>(first), static_cast<int>(last));
+		});
+	}
+
+	// 3. Pack the lists back to back
+	indices.clear();
+	for (int cluster = 0; cluster < CLUSTER_COUNT; cluster++) {
+		const vector<uint16_t>& list = clusterLights[cluster];
+		grid[cluster] = glm::uvec2(static_cast<uint32_t>(indices.size()), static_cast<uint32_t>(list.size()));
+		indices.insert(indices.end(), list.begin(), list.end());
+	}
+
+	// 4. Upload, orphaning last frame's storage
+	const void* data[3] = { gpuLights.data(), grid.data(), indices.data() };
+	size_t sizes[3] = { gpuLights.size() * sizeof(GpuSpotLight), grid.size() * sizeof(glm::uvec2), indices.size() * sizeof(uint16_t) };
+	for (int i = 0; i < 3; i++) {
+		glBindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+		glBufferData(GL_TEXTURE_BUFFER, glm::max(sizes[i], size_t(16)), nullptr, GL_STREAM_DRAW);
+		if (sizes[i] > 0)
+			glBufferSubData(GL_TEXTURE_BUFFER, 0, sizes[i], data[i]);
+	}
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	uniforms.counts.x = static_cast<int>(lightCount);
+	uniforms.clusterCounts = glm::ivec4(CLUSTERS_X, CLUSTERS_Y, CLUSTERS_Z, 0);
+	uniforms.clusterParams = glm::vec4(sliceScale, sliceBias, tileWidth, tileHeight);
+
+	lastAssignMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+void ClusteredLighting::assignSlices(int firstSlice, int lastSlice) {
+	for (int z = firstSlice; z < lastSlice; z++) {
+		for (int cluster = z * CLUSTERS_X * CLUSTERS_Y; cluster < (z + 1) * CLUSTERS_X * CLUSTERS_Y; cluster++)
+			clusterLights[cluster].clear();
+
+		for (size_t i = 0; i < bounds.size(); i++) {
+			const LightBounds& bound = bounds[i];
+			if (!bound.active || z < bound.minZ || z > bound.maxZ)
+				continue;
+			for (int y = bound.minY; y <= bound.maxY; y++) {
+				for (int x = bound.minX; x <= bound.maxX; x++) {
+					int cluster = x + CLUSTERS_X * (y + CLUSTERS_Y * z);
+					if (sphereTouchesBox(bound.center, bound.radius, clusterBoxes[cluster]))
+						clusterLights[cluster].push_back(static_cast<uint16_t>(i));
+				}
+			}
+		}
+	}
+}
+
+void ClusteredLighting::bind() const {
+	static const GLenum units[3] = { TEXTURE_UNIT_CLUSTER_LIGHTS, TEXTURE_UNIT_CLUSTER_GRID, TEXTURE_UNIT_CLUSTER_INDICES };
+	for (int i = 0; i < 3; i++) {
+		glActiveTexture(GL_TEXTURE0 + units[i]);
+		glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+	}
+	glActiveTexture(GL_TEXTURE0);
+}
@@ -0,0 +1,173 @@
+#include <culling.h>
+
+#include <algorithm>
+#include <cmath>
+
+#ifdef CULLING_SSE
+#include <emmintrin.h>
+#endif
+using namespace std;
+
+namespace {
+	bool frustumCulling = true;
+
+	// Signed distance of the box's furthest point along the plane normal: below zero means outside
+	bool boxOutsidePlane(const glm::vec4& plane, const glm::vec3& center, const glm::vec3& extents) {
+		float distance = glm::dot(glm::vec3(plane), center) + plane.w;
+		float radius = glm::dot(glm::abs(glm::vec3(plane)), extents);
+		return distance + radius < 0.0f;
+	}
+}
+
+void SetFrustumCulling(bool enabled) {
+	frustumCulling = enabled;
+}
+
+bool FrustumCullingEnabled() {
+	return frustumCulling;
+}
+
+Aabb TransformAabb(const Aabb& box, const glm::mat4& transform) {
+	glm::vec3 center = glm::vec3(transform * glm::vec4(box.center(), 1.0f));
+	glm::vec3 extents = box.extents();
+
+	// Each world axis extent is the sum of the absolute transformed local extents
+	glm::vec3 worldExtents(0.0f);
+	for (int column = 0; column < 3; column++)
+		worldExtents += glm::abs(glm::vec3(transform[column])) * extents[column];
+
+	Aabb result;
+	result.min = center - worldExtents;
+	result.max = center + worldExtents;
+	return result;
+}
+
+Frustum Frustum::FromMatrix(const glm::mat4& viewProjection) {
+	// glm is column major: row i is (m[0][i], m[1][i], m[2][i], m[3][i])
+	glm::vec4 rows[4];
+	for (int i = 0; i < 4; i++)
+		rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+
+	Frustum frustum;
+	frustum.planes[0] = rows[3] + rows[0];	// Left
+	frustum.planes[1] = rows[3] - rows[0];	// Right
+	frustum.planes[2] = rows[3] + rows[1];	// Bottom
+	frustum.planes[3] = rows[3] - rows[1];	// Top
+	frustum.planes[4] = rows[3] + rows[2];	// Near
+	frustum.planes[5] = rows[3] - rows[2];	// Far
+	for (glm::vec4& plane : frustum.planes)
+		plane /= glm::length(glm::vec3(plane));
+	return frustum;
+}
+
+FrustumTest Frustum::test(const Aabb& box) const {
+	glm::vec3 center = box.center();
+	glm::vec3 extents = box.extents();
+	FrustumTest result = FRUSTUM_INSIDE;
+	for (const glm::vec4& plane : planes) {
+		float distance = glm::dot(glm::vec3(plane), center) + plane.w;
+		float radius = glm::dot(glm::abs(glm::vec3(plane)), extents);
+		if (distance + radius < 0.0f)
+			return FRUSTUM_OUTSIDE;
+		if (distance - radius < 0.0f)
+			result = FRUSTUM_INTERSECTS;
+	}
+	return result;
+}
+
+void CullAabbs(const Frustum& frustum, const Aabb* boxes, size_t count, uint8_t* visible) {
+	size_t i = 0;
+
+#ifdef CULLING_SSE
+	// Four boxes per iteration: centers and extents are transposed into x/y/z registers, then every plane
+	// is tested against all four at once
+	const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	for (; i + 4 <= count; i += 4) {
+		const Aabb* b = boxes + i;
+		__m128 minX = _mm_setr_ps(b[0].min.x, b[1].min.x, b[2].min.x, b[3].min.x);
+		__m128 minY = _mm_setr_ps(b[0].min.y, b[1].min.y, b[2].min.y, b[3].min.y);
+		__m128 minZ = _mm_setr_ps(b[0].min.z, b[1].min.z, b[2].min.z, b[3].min.z);
+		__m128 maxX = _mm_setr_ps(b[0].max.x, b[1].max.x, b[2].max.x, b[3].max.x);
+		__m128 maxY = _mm_setr_ps(b[0].max.y, b[1].max.y, b[2].max.y, b[3].max.y);
+		__m128 maxZ = _mm_setr_ps(b[0].max.z, b[1].max.z, b[2].max.z, b[3].max.z);
+
+		const __m128 half = _mm_set1_ps(0.5f);
+		__m128 centerX = _mm_mul_ps(_mm_add_ps(minX, maxX), half);
+		__m128 centerY = _mm_mul_ps(_mm_add_ps(minY, maxY), half);
+		__m128 centerZ = _mm_mul_ps(_mm_add_ps(minZ, maxZ), half);
+		__m128 extentX = _mm_mul_ps(_mm_sub_ps(maxX, minX), half);
+		__m128 extentY = _mm_mul_ps(_mm_sub_ps(maxY, minY), half);
+		__m128 extentZ = _mm_mul_ps(_mm_sub_ps(maxZ, minZ), half);
+
+		__m128 outside = _mm_setzero_ps();
+		for (const glm::vec4& plane : frustum.planes) {
+			__m128 planeX = _mm_set1_ps(plane.x);
+			__m128 planeY = _mm_set1_ps(plane.y);
+			__m128 planeZ = _mm_set1_ps(plane.z);
+
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planeX, centerX), _mm_mul_ps(planeY, centerY)),
+				_mm_add_ps(_mm_mul_ps(planeZ, centerZ), _mm_set1_ps(plane.w)));
+			__m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_and_ps(planeX, signMask), extentX),
+				_mm_mul_ps(_mm_and_ps(planeY, signMask), extentY)), _mm_mul_ps(_mm_and_ps(planeZ, signMask), extentZ));
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+		}
+
+		int mask = _mm_movemask_ps(outside);
+		for (int lane = 0; lane < 4; lane++)
+			visible[i + lane] = (mask >> lane & 1) ? 0 : 1;
+	}
+#endif
+
+	for (; i < count; i++) {
+		glm::vec3 center = boxes[i].center();
+		glm::vec3 extents = boxes[i].extents();
+		bool outside = false;
+		for (const glm::vec4& plane : frustum.planes)
+			outside = outside || boxOutsidePlane(plane, center, extents);
+		visible[i] = outside ? 0 : 1;
+	}
+}
+
+void Bvh::build(const vector<Aabb>& boxes) {
+	nodes.clear();
+	items.resize(boxes.size());
+	for (uint32_t i = 0; i < items.size(); i++)
+		items[i] = i;
+	itemBoxes = boxes;
+	if (boxes.empty())
+		return;
+
+	nodes.reserve(2 * boxes.size() / BVH_LEAF_SIZE + 1);
+	nodes.resize(1);
+	buildNode(0, 0, static_cast<uint32_t>(boxes.size()));
+
+	// Put the boxes in tree order, so leaves read them contiguously
+	for (uint32_t i = 0; i < items.size(); i++)
+		itemBoxes[i] = boxes[items[i]];
+}
+
+void Bvh::buildNode(uint32_t index, uint32_t first, uint32_t count) {
+	Aabb bounds = itemBoxes[items[first]];
+	for (uint32_t i = 1; i < count; i++)
+		bounds.expand(itemBoxes[items[first + i]]);
+	nodes[index].bounds = bounds;
+	nodes[index].firstItem = first;
+	nodes[index].itemCount = count;
+	nodes[index].left = 0;
+	if (count <= BVH_LEAF_SIZE)
+		return;
+
+	// Split at the median of the item centers along the longest axis
+	glm::vec3 size = bounds.max - bounds.min;
+	int axis = size.x > size.y ? (size.x > size.z ? 0 : 2) : (size.y > size.z ? 1 : 2);
+	uint32_t half = count / 2;
+	nth_element(items.begin() + first, items.begin() + first + half, items.begin() + first + count,
+		[&](uint32_t a, uint32_t b) { return itemBoxes[a].center()[axis] < itemBoxes[b].center()[axis]; });
+
+	// Children are allocated as a pair so the right child is always left + 1
+	uint32_t left = static_cast<uint32_t>(nodes.size());
+	nodes.resize(nodes.size() + 2);
+	nodes[index].left = left;
+	buildNode(left, first, half);
+	buildNode(left + 1, first + half, count - half);
+}
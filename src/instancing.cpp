@@ -0,0 +1,215 @@
+#include <instancing.h>
+#include <jobSystem.h>
+#include <model.h>
+
+#include <algorithm>
+#include <cstddef>
+using namespace std;
+
+namespace {
+	bool instancing = true;
+
+	// Instances per job of the parallel loops
+	const size_t INSTANCE_JOB_GRAIN = 1024;
+}
+
+void SetInstancing(bool enabled) {
+	instancing = enabled;
+}
+
+bool InstancingEnabled() {
+	return instancing;
+}
+
+InstanceBatch::InstanceBatch(shared_ptr<ModelAsset> asset)
+	: asset(std::move(asset))
+{
+	glGenBuffers(1, &buffer);
+
+	for (size_t i = 0; i < this->asset->meshes.size(); i++) {
+		const glm::mat4& transform = this->asset->meshTransforms[i];
+		Aabb bounds = TransformAabb(this->asset->meshes[i].bounds, transform);
+		if (i == 0)
+			assetBounds = bounds;
+		else
+			assetBounds.expand(bounds);
+
+		ObjectUniforms object;
+		object.model = transform;
+		object.normalMatrix = glm::mat4(glm::transpose(glm::inverse(glm::mat3(transform))));
+		meshObjects.push_back(object);
+	}
+
+	// Add the per-instance attributes to the VAO of every mesh. They only advance once per instance.
+	for (const Mesh& mesh : this->asset->meshes) {
+		glBindVertexArray(mesh.VAO);
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		for (GLuint column = 0; column < 4; column++) {
+			GLuint location = INSTANCE_ATTRIBUTE_MODEL + column;
+			glEnableVertexAttribArray(location);
+			glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+				(void*)(offsetof(InstanceData, model) + column * sizeof(glm::vec4)));
+			glVertexAttribDivisor(location, 1);
+		}
+		for (GLuint column = 0; column < 3; column++) {
+			GLuint location = INSTANCE_ATTRIBUTE_NORMAL_MATRIX + column;
+			glEnableVertexAttribArray(location);
+			glVertexAttribPointer(location, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+				(void*)(offsetof(InstanceData, normalMatrix) + column * sizeof(glm::vec3)));
+			glVertexAttribDivisor(location, 1);
+		}
+	}
+	glBindVertexArray(0);
+}
+
+InstanceBatch::~InstanceBatch() {
+	glDeleteBuffers(1, &buffer);
+}
+
+void InstanceBatch::clear() {
+	instances.clear();
+	maxScale = 0.0f;
+}
+
+void InstanceBatch::add(const glm::mat4& model) {
+	InstanceData instance;
+	instance.model = model;
+	instance.normalMatrix = glm::transpose(glm::inverse(glm::mat3(model)));
+	instances.push_back(instance);
+
+	for (int column = 0; column < 3; column++)
+		maxScale = glm::max(maxScale, glm::length(glm::vec3(model[column])));
+}
+
+void InstanceBatch::add(const vector<glm::mat4>& models) {
+	size_t first = instances.size();
+	instances.resize(first + models.size());
+	size_t chunks = (models.size() + INSTANCE_JOB_GRAIN - 1) / INSTANCE_JOB_GRAIN;
+	vector<float> chunkScales(chunks, 0.0f);
+	JobSystem::shared().parallelFor(0, models.size(), INSTANCE_JOB_GRAIN, [&](size_t begin, size_t end) {
+		float scale = 0.0f;
+		for (size_t i = begin; i < end; i++) {
+			InstanceData& instance = instances[first + i];
+			instance.model = models[i];
+			instance.normalMatrix = glm::transpose(glm::inverse(glm::mat3(models[i])));
+			for (int column = 0; column < 3; column++)
+				scale = glm::max(scale, glm::length(glm::vec3(models[i][column])));
+		}
+		chunkScales[begin / INSTANCE_JOB_GRAIN] = scale;
+	});
+	for (float scale : chunkScales)
+		maxScale = glm::max(maxScale, scale);
+}
+
+void InstanceBatch::prepare(UniformRing& objectUniforms, const FrameInfo& frame, RenderStats& stats) {
+	instanced = InstancingEnabled();
+	objectOffsets.clear();
+	visibleInstances.clear();
+	if (instances.empty())
+		return;
+
+	// Cull whole instances with the box around all of their meshes, first against the frustum, then the occluders
+	size_t meshCount = asset->meshes.size();
+	instanceVisible.assign(instances.size(), 1);
+	if (frame.frustumCulling || frame.occlusion) {
+		instanceBoxes.resize(instances.size());
+		JobSystem::shared().parallelFor(0, instances.size(), INSTANCE_JOB_GRAIN, [this, &frame](size_t first, size_t last) {
+			for (size_t i = first; i < last; i++)
+				instanceBoxes[i] = TransformAabb(assetBounds, instances[i].model);
+			if (frame.frustumCulling)
+				CullAabbs(frame.frustum, instanceBoxes.data() + first, last - first, instanceVisible.data() + first);
+		});
+	}
+	if (frame.frustumCulling) {
+		stats.culling.tested += instances.size();
+		for (uint8_t visible : instanceVisible)
+			stats.culling.culled += visible ? 0 : meshCount;
+	}
+	if (frame.occlusion)
+		stats.culling.occluded += frame.occlusion->cull(instanceBoxes.data(), instances.size(), instanceVisible.data()) * meshCount;
+
+	for (size_t i = 0; i < instances.size(); i++) {
+		if (instanceVisible[i])
+			visibleInstances.push_back(instances[i]);
+	}
+	stats.culling.drawn += visibleInstances.size() * meshCount;
+	if (visibleInstances.empty())
+		return;
+
+	if (!instanced) {
+		for (const InstanceData& instance : visibleInstances) {
+			for (const ObjectUniforms& meshObject : meshObjects) {
+				ObjectUniforms object;
+				object.model = instance.model * meshObject.model;
+				object.normalMatrix = glm::mat4(instance.normalMatrix * glm::mat3(meshObject.normalMatrix));
+				objectOffsets.push_back(objectUniforms.push(&object));
+			}
+		}
+		return;
+	}
+
+	for (const ObjectUniforms& meshObject : meshObjects)
+		objectOffsets.push_back(objectUniforms.push(&meshObject));
+
+	// The buffer is orphaned every frame, so the upload never waits for last frame's draws
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	if (visibleInstances.size() > capacity)
+		capacity = visibleInstances.size() + visibleInstances.size() / 2;
+	glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(InstanceData), nullptr, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, visibleInstances.size() * sizeof(InstanceData), visibleInstances.data());
+}
+
+void InstanceBatch::submit(RenderQueue& queue, ShaderVariants& shaders, const FrameInfo& frame, RenderStats& stats) {
+	if (visibleInstances.empty())
+		return;
+
+	// The instance closest to the camera decides the LOD
+	size_t nearest = 0;
+	float nearestDistance = -1.0f;
+	for (size_t i = 0; i < visibleInstances.size(); i++) {
+		glm::vec3 offset = glm::vec3(visibleInstances[i].model[3]) - frame.viewPos;
+		float distance = glm::dot(offset, offset);
+		if (nearestDistance < 0.0f || distance < nearestDistance) {
+			nearest = i;
+			nearestDistance = distance;
+		}
+	}
+	const glm::mat4& nearestModel = visibleInstances[nearest].model;
+
+	meshLods.resize(asset->meshes.size(), 0);
+	for (unsigned int i = 0; i < asset->meshes.size(); i++) {
+		const Mesh& mesh = asset->meshes[i];
+		glm::vec3 meshCenter = glm::vec3(asset->meshTransforms[i] * glm::vec4(mesh.boundsCenter, 1.0f));
+
+		glm::vec3 center = glm::vec3(nearestModel * glm::vec4(meshCenter, 1.0f));
+		float distance = glm::length(center - frame.viewPos) - mesh.boundsRadius * maxScale;
+		distance = glm::max(distance, 0.1f);
+		meshLods[i] = SelectLod(mesh.lods, frame.pixelsPerUnit(distance) * maxScale, frame.lodPixelError, meshLods[i]);
+
+		DrawItem item;
+		item.materialId = mesh.materialId;
+		item.vao = mesh.VAO;
+		item.indexType = mesh.indexType;
+		item.indexCount = static_cast<GLsizei>(mesh.lods[meshLods[i]].indexCount);
+		item.indexOffset = mesh.indexByteOffset(meshLods[i]);
+
+		uint32_t features = mesh.shaderFeatures & frame.shaderFeatureMask;
+		if (instanced) {
+			item.program = shaders.get(features | SHADER_FEATURE_INSTANCED).ID;
+			item.objectOffset = objectOffsets[i];
+			item.instanceCount = static_cast<GLsizei>(visibleInstances.size());
+			queue.submit(item, glm::length(center - frame.viewPos), frame.farPlane);
+		}
+		else {
+			item.program = shaders.get(features).ID;
+			for (size_t j = 0; j < visibleInstances.size(); j++) {
+				item.objectOffset = objectOffsets[j * asset->meshes.size() + i];
+				glm::vec3 instanceCenter = glm::vec3(visibleInstances[j].model * glm::vec4(meshCenter, 1.0f));
+				queue.submit(item, glm::length(instanceCenter - frame.viewPos), frame.farPlane);
+			}
+		}
+
+		stats.trianglesSubmitted += mesh.triangleCount(meshLods[i]) * visibleInstances.size();
+		stats.trianglesAvailable += mesh.triangleCount(0) * visibleInstances.size();
+	}
+}
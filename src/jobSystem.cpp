@@ -0,0 +1,161 @@
+#include <jobSystem.h>
+#include <profiler.h>
+
+#include <string>
+using namespace std;
+
+namespace {
+	// Worker identity of the current thread: which system it belongs to and which deque it owns
+	thread_local const JobSystem* workerSystem = nullptr;
+	thread_local size_t workerQueue = 0;
+}
+
+JobSystem::JobSystem(unsigned int workerCount) {
+	for (unsigned int i = 0; i <= workerCount; i++)
+		queues.push_back(make_unique<WorkQueue>());
+	for (unsigned int i = 0; i < workerCount; i++)
+		workers.emplace_back([this, i] { workerLoop(i); });
+}
+
+JobSystem::~JobSystem() {
+	{
+		lock_guard<mutex> lock(wakeMutex);
+		stopping = true;
+	}
+	wakeCondition.notify_all();
+	for (thread& worker : workers)
+		worker.join();
+}
+
+JobSystem& JobSystem::shared() {
+	static JobSystem system([] {
+		unsigned int cores = thread::hardware_concurrency();
+		return cores > 1 ? cores - 1 : 1u;
+	}());
+	return system;
+}
+
+void JobSystem::run(function<void()> job, JobCounter* counter) {
+	if (counter)
+		counter->pending.fetch_add(1, memory_order_relaxed);
+	Job entry{ std::move(job), counter };
+	if (workers.empty()) {
+		execute(entry);
+		return;
+	}
+	push(std::move(entry));
+}
+
+void JobSystem::runAfter(JobCounter& dependency, function<void()> job, JobCounter* counter) {
+	if (counter)
+		counter->pending.fetch_add(1, memory_order_relaxed);
+	{
+		lock_guard<mutex> lock(dependency.continuationMutex);
+		if (!dependency.done()) {
+			dependency.continuations.push_back({ std::move(job), counter });
+			return;
+		}
+	}
+	Job entry{ std::move(job), counter };
+	if (workers.empty())
+		execute(entry);
+	else
+		push(std::move(entry));
+}
+
+void JobSystem::wait(JobCounter& counter) {
+	while (!counter.done()) {
+		Job job;
+		if (take(job))
+			execute(job);
+		else
+			this_thread::yield();
+	}
+	// The last job may still be between taking the counter to zero and releasing it
+	lock_guard<mutex> lock(counter.continuationMutex);
+}
+
+void JobSystem::push(Job job) {
+	size_t index = workerSystem == this ? workerQueue : workers.size();
+	{
+		WorkQueue& queue = *queues[index];
+		lock_guard<mutex> lock(queue.lock);
+		queue.jobs.push_back(std::move(job));
+	}
+	queued.fetch_add(1, memory_order_release);
+	{
+		lock_guard<mutex> lock(wakeMutex);
+	}
+	wakeCondition.notify_one();
+}
+
+bool JobSystem::pop(size_t index, Job& job) {
+	WorkQueue& queue = *queues[index];
+	lock_guard<mutex> lock(queue.lock);
+	if (queue.jobs.empty())
+		return false;
+	job = std::move(queue.jobs.back());
+	queue.jobs.pop_back();
+	queued.fetch_sub(1, memory_order_relaxed);
+	return true;
+}
+
+bool JobSystem::steal(size_t thief, Job& job) {
+	size_t count = queues.size();
+	for (size_t offset = 1; offset < count; offset++) {
+		WorkQueue& queue = *queues[(thief + offset) % count];
+		lock_guard<mutex> lock(queue.lock);
+		if (queue.jobs.empty())
+			continue;
+		job = std::move(queue.jobs.front());
+		queue.jobs.pop_front();
+		queued.fetch_sub(1, memory_order_relaxed);
+		return true;
+	}
+	return false;
+}
+
+bool JobSystem::take(Job& job) {
+	size_t own = workerSystem == this ? workerQueue : workers.size();
+	return pop(own, job) || steal(own, job);
+}
+
+void JobSystem::execute(Job& job) {
+	job.work();
+	if (job.counter)
+		finish(*job.counter);
+}
+
+void JobSystem::finish(JobCounter& counter) {
+	vector<JobCounter::Continuation> ready;
+	{
+		lock_guard<mutex> lock(counter.continuationMutex);
+		if (counter.pending.fetch_sub(1, memory_order_acq_rel) == 1)
+			ready.swap(counter.continuations);
+	}
+	// 'counter' may be gone from here on
+	for (JobCounter::Continuation& continuation : ready) {
+		Job entry{ std::move(continuation.job), continuation.counter };
+		if (workers.empty())
+			execute(entry);
+		else
+			push(std::move(entry));
+	}
+}
+
+void JobSystem::workerLoop(size_t index) {
+	workerSystem = this;
+	workerQueue = index;
+	SetProfilerThreadName("Worker " + to_string(index + 1));
+	for (;;) {
+		Job job;
+		if (take(job)) {
+			execute(job);
+			continue;
+		}
+		unique_lock<mutex> lock(wakeMutex);
+		wakeCondition.wait(lock, [this] { return stopping || queued.load(memory_order_acquire) > 0; });
+		if (stopping && queued.load(memory_order_acquire) == 0)
+			return;
+	}
+}
@@ -1,11 +1,122 @@
-
 #include <app.h>
+#include <profiler.h>
 #include <iostream>
+#include <string>
+#include <cstdlib>
+
+// Parse command line options. Supported:
+//   --bench                Run the headless benchmark instead of the interactive app
+//   --frames <n>           Number of measured benchmark frames
+//   --warmup <n>           Number of unmeasured warm-up frames
+//   --size <w> <h>         Offscreen framebuffer size
+//   --out <file>           JSON output path
+//   --no-texture-cache     Load textures from the images instead of the cooked texture cache
+//   --no-program-cache     Compile every shader program from source instead of loading cached binaries
+//   --full-vertices        Upload meshes in the full 56 byte Vertex layout instead of the compact layouts
+//   --no-lod               Always draw the full-resolution LOD of every mesh
+//   --no-static-batching   Draw static models mesh by mesh instead of from the merged static batch
+//   --no-texture-arrays    Draw the static batch with one texture set per material instead of texture arrays
+//   --instances <n>        Add n car instances to the benchmark scene
+//   --lights <n>           Light the benchmark scene with n spot lights (2 blimp lights and n - 2 street lamps;
+//                          0 drops the spot light loop from the shaders)
+//   --no-instancing        Draw repeated models one instance at a time instead of with instanced draws
+//   --no-culling           Submit every mesh instead of only those in the view frustum
+//   --no-occlusion         Start with CPU occlusion culling off (toggle at runtime with O)
+//   --no-depth-prepass     Start with the depth pre-pass of static occluders off (toggle at runtime with P)
+//   --no-persistent-mapping  Map the per-frame stream buffers every frame instead of once (the GL 3.3 path)
+//   --sim-thread           Run the simulation (camera, blimps) on its own thread at a fixed tick
+//   --trace <file>         Record profiler zones and write them to <file> as a Chrome trace
+//   --job-scaling [n]      Time the frame preparation of a synthetic n object scene (default 50000) with 1 to N
+//                          job system threads, without opening a window, and write the timings to --out
+static bool parseArgs(int argc, char* argv[], BenchSettings& bench) {
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--bench")
+			bench.enabled = true;
+		else if (arg == "--frames" && i + 1 < argc) {
+			bench.frames = std::atoi(argv[++i]);
+			if (bench.frames < 1) {
+				std::cout << "Invalid argument: --frames " << argv[i] << " (at least 1)\n";
+				return false;
+			}
+		}
+		else if (arg == "--warmup" && i + 1 < argc) {
+			bench.warmupFrames = std::atoi(argv[++i]);
+			if (bench.warmupFrames < 0) {
+				std::cout << "Invalid argument: --warmup " << argv[i] << " (at least 0)\n";
+				return false;
+			}
+		}
+		else if (arg == "--size" && i + 2 < argc) {
+			int width = std::atoi(argv[++i]);
+			int height = std::atoi(argv[++i]);
+			if (width < 1 || height < 1) {
+				std::cout << "Invalid argument: --size " << argv[i - 1] << " " << argv[i] << " (at least 1 x 1)\n";
+				return false;
+			}
+			bench.width = static_cast<unsigned int>(width);
+			bench.height = static_cast<unsigned int>(height);
+		}
+		else if (arg == "--out" && i + 1 < argc)
+			bench.outputPath = argv[++i];
+		else if (arg == "--no-texture-cache")
+			SetTextureCacheEnabled(false);
+		else if (arg == "--no-program-cache")
+			SetProgramCacheEnabled(false);
+		else if (arg == "--full-vertices")
+			SetCompactVertices(false);
+		else if (arg == "--no-lod")
+			SetLodSelection(false);
+		else if (arg == "--no-static-batching")
+			SetStaticBatching(false);
+		else if (arg == "--no-texture-arrays")
+			SetTextureArrays(false);
+		else if (arg == "--instances" && i + 1 < argc)
+			bench.instances = std::atoi(argv[++i]);
+		else if (arg == "--lights" && i + 1 < argc)
+			bench.lights = std::atoi(argv[++i]);
+		else if (arg == "--no-instancing")
+			SetInstancing(false);
+		else if (arg == "--no-culling")
+			SetFrustumCulling(false);
+		else if (arg == "--no-occlusion")
+			SetOcclusionCulling(false);
+		else if (arg == "--no-depth-prepass")
+			SetDepthPrepass(false);
+		else if (arg == "--no-persistent-mapping")
+			SetPersistentMapping(false);
+		else if (arg == "--sim-thread")
+			SetSimulationThread(true);
+		else if (arg == "--trace" && i + 1 < argc)
+			StartProfiler(argv[++i]);
+		else if (arg == "--job-scaling") {
+			bench.jobScaling = true;
+			if (i + 1 < argc && std::atoi(argv[i + 1]) > 0)
+				bench.jobScalingObjects = std::atoi(argv[++i]);
+		}
+		else {
+			std::cout << "Unknown argument: " << arg << "\n";
+			return false;
+		}
+	}
+	return true;
+}
 
-int main() {
+int main(int argc, char* argv[]) {
 	std::cout << "Starting application...\n";
 
-	App app;
+	BenchSettings bench;
+	if (!parseArgs(argc, argv, bench))
+		return -1;
+
+	if (bench.jobScaling) {
+		SetProfilerThreadName("Main");
+		bool written = RunJobScalingBenchmark(bench);
+		WriteProfilerTrace();
+		return written ? 0 : -1;
+	}
+
+	App app(bench);
 
 	return app.run();
 }
@@ -0,0 +1,337 @@
+#include <meshOptimizer.h>
+#include <mesh.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <unordered_map>
+using namespace std;
+
+namespace {
+	// Vertices are welded only when they are bit-identical, so no attribute is ever changed
+	struct VertexBytesHash {
+		size_t operator()(const Vertex& v) const {
+			const unsigned char* p = reinterpret_cast<const unsigned char*>(&v);
+			uint64_t hash = 14695981039346656037ull;
+			for (size_t i = 0; i < sizeof(Vertex); i++)
+				hash = (hash ^ p[i]) * 1099511628211ull;
+			return static_cast<size_t>(hash);
+		}
+	};
+
+	struct VertexBytesEqual {
+		bool operator()(const Vertex& a, const Vertex& b) const {
+			return memcmp(&a, &b, sizeof(Vertex)) == 0;
+		}
+	};
+
+	// Forsyth's scoring: vertices at the front of the simulated LRU cache and vertices with few remaining
+	// triangles score high, so triangles that finish off cached vertices are emitted first.
+	// https://tomforsyth1000.github.io/papers/fast_vert_cache_opt.html
+	const int FORSYTH_CACHE_SIZE = 32;
+	const float FORSYTH_CACHE_DECAY = 1.5f;
+	const float FORSYTH_LAST_TRIANGLE_SCORE = 0.75f;
+	const float FORSYTH_VALENCE_SCALE = 2.0f;
+	const float FORSYTH_VALENCE_POWER = 0.5f;
+
+	float forsythScore(int cachePosition, unsigned int remainingTriangles) {
+		if (remainingTriangles == 0)
+			return -1.0f;
+
+		float score = 0.0f;
+		if (cachePosition >= 0) {
+			if (cachePosition < 3) {
+				// The vertices of the last triangle get a fixed score, so it is not simply repeated
+				score = FORSYTH_LAST_TRIANGLE_SCORE;
+			}
+			else {
+				float scaler = 1.0f / (FORSYTH_CACHE_SIZE - 3);
+				score = powf(1.0f - (cachePosition - 3) * scaler, FORSYTH_CACHE_DECAY);
+			}
+		}
+		score += FORSYTH_VALENCE_SCALE * powf(static_cast<float>(remainingTriangles), -FORSYTH_VALENCE_POWER);
+		return score;
+	}
+
+	// Triangles per overdraw cluster boundary search: a new cluster may only start where the cache-optimized
+	// order already restarts (a triangle with three cache misses), and never before this many triangles
+	const size_t OVERDRAW_MIN_CLUSTER = 16;
+}
+
+void WeldVertices(vector<Vertex>& vertices, vector<unsigned int>& indices) {
+	unordered_map<Vertex, unsigned int, VertexBytesHash, VertexBytesEqual> unique;
+	unique.reserve(vertices.size());
+
+	vector<unsigned int> remap(vertices.size());
+	vector<Vertex> welded;
+	welded.reserve(vertices.size());
+	for (size_t i = 0; i < vertices.size(); i++) {
+		auto inserted = unique.emplace(vertices[i], static_cast<unsigned int>(welded.size()));
+		if (inserted.second)
+			welded.push_back(vertices[i]);
+		remap[i] = inserted.first->second;
+	}
+	if (welded.size() == vertices.size())
+		return;
+
+	for (unsigned int& index : indices)
+		index = remap[index];
+	vertices = std::move(welded);
+}
+
+void OptimizeVertexCache(vector<unsigned int>& indices, size_t vertexCount) {
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0)
+		return;
+
+	// Triangle adjacency of every vertex
+	vector<unsigned int> remaining(vertexCount, 0);
+	for (unsigned int index : indices)
+		remaining[index]++;
+	vector<unsigned int> adjacencyOffset(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; v++)
+		adjacencyOffset[v + 1] = adjacencyOffset[v] + remaining[v];
+	vector<unsigned int> adjacency(indices.size());
+	{
+		vector<unsigned int> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+		for (size_t t = 0; t < triangleCount; t++) {
+			for (int k = 0; k < 3; k++)
+				adjacency[fill[indices[t * 3 + k]]++] = static_cast<unsigned int>(t);
+		}
+	}
+
+	vector<float> vertexScore(vertexCount);
+	for (size_t v = 0; v < vertexCount; v++)
+		vertexScore[v] = forsythScore(-1, remaining[v]);
+
+	vector<float> triangleScore(triangleCount);
+	vector<bool> emitted(triangleCount, false);
+	for (size_t t = 0; t < triangleCount; t++)
+		triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+
+	vector<unsigned int> cache, nextCache;
+	cache.reserve(FORSYTH_CACHE_SIZE + 3);
+	nextCache.reserve(FORSYTH_CACHE_SIZE + 3);
+
+	vector<unsigned int> output;
+	output.reserve(indices.size());
+	size_t scanCursor = 0;	// Fallback scan for the best triangle when nothing in the cache is left
+
+	while (output.size() < indices.size()) {
+		// 1. Best triangle touching the cache
+		long best = -1;
+		float bestScore = -1.0f;
+		for (unsigned int v : cache) {
+			for (unsigned int a = adjacencyOffset[v]; a < adjacencyOffset[v] + remaining[v]; a++) {
+				unsigned int t = adjacency[a];
+				if (triangleScore[t] > bestScore) {
+					bestScore = triangleScore[t];
+					best = t;
+				}
+			}
+		}
+		// 2. Otherwise the next triangle that has not been emitted yet
+		if (best < 0) {
+			while (emitted[scanCursor])
+				scanCursor++;
+			best = static_cast<long>(scanCursor);
+		}
+
+		// Emit it and move its vertices to the front of the cache
+		emitted[best] = true;
+		nextCache.clear();
+		for (int k = 0; k < 3; k++) {
+			unsigned int v = indices[best * 3 + k];
+			output.push_back(v);
+			if (find(nextCache.begin(), nextCache.end(), v) == nextCache.end())
+				nextCache.push_back(v);
+			remaining[v]--;
+			// Move the triangle out of the live part of the vertex' adjacency so it is not visited again
+			for (unsigned int a = adjacencyOffset[v]; a <= adjacencyOffset[v] + remaining[v]; a++) {
+				if (adjacency[a] == static_cast<unsigned int>(best)) {
+					swap(adjacency[a], adjacency[adjacencyOffset[v] + remaining[v]]);
+					break;
+				}
+			}
+		}
+		size_t emittedVertices = nextCache.size();
+		for (unsigned int v : cache) {
+			if (find(nextCache.begin(), nextCache.begin() + emittedVertices, v) == nextCache.begin() + emittedVertices)
+				nextCache.push_back(v);
+		}
+		// Vertices pushed out of the cache lose their cache score
+		for (size_t i = 0; i < nextCache.size(); i++) {
+			unsigned int v = nextCache[i];
+			int position = i < static_cast<size_t>(FORSYTH_CACHE_SIZE) ? static_cast<int>(i) : -1;
+			vertexScore[v] = forsythScore(position, remaining[v]);
+		}
+		// Rescore the triangles these vertices still belong to
+		for (unsigned int v : nextCache) {
+			for (unsigned int a = adjacencyOffset[v]; a < adjacencyOffset[v] + remaining[v]; a++) {
+				unsigned int t = adjacency[a];
+				triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+			}
+		}
+		if (nextCache.size() > static_cast<size_t>(FORSYTH_CACHE_SIZE))
+			nextCache.resize(FORSYTH_CACHE_SIZE);
+		swap(cache, nextCache);
+	}
+
+	indices = std::move(output);
+}
+
+void OptimizeOverdraw(vector<unsigned int>& indices, const vector<Vertex>& vertices, float threshold) {
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount < OVERDRAW_MIN_CLUSTER * 2)
+		return;
+
+	// 1. Split the cache-optimized order into clusters where the cache restarts anyway, so reordering whole
+	// clusters costs (almost) no cache efficiency
+	vector<size_t> clusterStart;
+	{
+		const unsigned int cacheSize = 16;
+		vector<unsigned int> timestamp(vertices.size(), 0);
+		unsigned int time = cacheSize + 1;
+		size_t lastStart = 0;
+		clusterStart.push_back(0);
+		for (size_t t = 0; t < triangleCount; t++) {
+			int misses = 0;
+			for (int k = 0; k < 3; k++) {
+				unsigned int v = indices[t * 3 + k];
+				if (time - timestamp[v] > cacheSize) {
+					timestamp[v] = time++;
+					misses++;
+				}
+			}
+			if (misses == 3 && t - lastStart >= OVERDRAW_MIN_CLUSTER) {
+				clusterStart.push_back(t);
+				lastStart = t;
+			}
+		}
+		clusterStart.push_back(triangleCount);
+	}
+	size_t clusterCount = clusterStart.size() - 1;
+	if (clusterCount < 2)
+		return;
+
+	// 2. Sort clusters by how far they face outwards from the mesh centre: clusters on the outside of the
+	// mesh are likely to occlude the inside ones, so they should be drawn first
+	glm::vec3 meshCentre(0.0f);
+	float meshArea = 0.0f;
+	vector<float> sortKey(clusterCount);
+	vector<glm::vec3> clusterCentre(clusterCount), clusterNormal(clusterCount);
+	for (size_t c = 0; c < clusterCount; c++) {
+		glm::vec3 centre(0.0f), normal(0.0f);
+		float area = 0.0f;
+		for (size_t t = clusterStart[c]; t < clusterStart[c + 1]; t++) {
+			const glm::vec3& a = vertices[indices[t * 3]].Position;
+			const glm::vec3& b = vertices[indices[t * 3 + 1]].Position;
+			const glm::vec3& d = vertices[indices[t * 3 + 2]].Position;
+			glm::vec3 n = glm::cross(b - a, d - a);
+			float triangleArea = glm::length(n);
+			centre += (a + b + d) * (triangleArea / 3.0f);
+			normal += n;
+			area += triangleArea;
+		}
+		meshCentre += centre;
+		meshArea += area;
+		clusterCentre[c] = area > 0.0f ? centre / area : vertices[indices[clusterStart[c] * 3]].Position;
+		float normalLength = glm::length(normal);
+		clusterNormal[c] = normalLength > 0.0f ? normal / normalLength : glm::vec3(0.0f);
+	}
+	if (meshArea > 0.0f)
+		meshCentre /= meshArea;
+	for (size_t c = 0; c < clusterCount; c++)
+		sortKey[c] = glm::dot(clusterCentre[c] - meshCentre, clusterNormal[c]);
+
+	vector<size_t> order(clusterCount);
+	for (size_t c = 0; c < clusterCount; c++)
+		order[c] = c;
+	stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sortKey[a] > sortKey[b]; });
+
+	vector<unsigned int> sorted;
+	sorted.reserve(indices.size());
+	for (size_t c : order)
+		sorted.insert(sorted.end(), indices.begin() + clusterStart[c] * 3, indices.begin() + clusterStart[c + 1] * 3);
+
+	// 3. Keep the new order only if the vertex cache does not suffer too much
+	if (ComputeACMR(sorted, vertices.size()) <= ComputeACMR(indices, vertices.size()) * threshold)
+		indices = std::move(sorted);
+}
+
+void OptimizeVertexFetch(vector<Vertex>& vertices, vector<unsigned int>& indices) {
+	const unsigned int unused = ~0u;
+	vector<unsigned int> remap(vertices.size(), unused);
+	vector<Vertex> ordered;
+	ordered.reserve(vertices.size());
+	for (unsigned int& index : indices) {
+		if (remap[index] == unused) {
+			remap[index] = static_cast<unsigned int>(ordered.size());
+			ordered.push_back(vertices[index]);
+		}
+		index = remap[index];
+	}
+	// Vertices no triangle references are dropped
+	vertices = std::move(ordered);
+}
+
+float ComputeACMR(const vector<unsigned int>& indices, size_t vertexCount, unsigned int cacheSize) {
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0)
+		return 0.0f;
+
+	vector<unsigned int> timestamp(vertexCount, 0);
+	unsigned int time = cacheSize + 1;
+	size_t misses = 0;
+	for (unsigned int index : indices) {
+		if (time - timestamp[index] > cacheSize) {
+			timestamp[index] = time++;
+			misses++;
+		}
+	}
+	return static_cast<float>(misses) / triangleCount;
+}
+
+size_t IndexSize(size_t vertexCount) {
+	return vertexCount <= 65536 ? sizeof(uint16_t) : sizeof(uint32_t);
+}
+
+vector<unsigned char> PackIndices(const unsigned int* indices, size_t count, size_t indexSize) {
+	vector<unsigned char> bytes(count * indexSize);
+	if (indexSize == sizeof(uint32_t)) {
+		if (count > 0)
+			memcpy(bytes.data(), indices, count * sizeof(uint32_t));
+		return bytes;
+	}
+	uint16_t* out = reinterpret_cast<uint16_t*>(bytes.data());
+	for (size_t i = 0; i < count; i++)
+		out[i] = static_cast<uint16_t>(indices[i]);
+	return bytes;
+}
+
+MeshOptimizationStats OptimizeMesh(vector<Vertex>& vertices, vector<unsigned int>& indices, const string& meshName) {
+	MeshOptimizationStats stats;
+	stats.verticesBefore = vertices.size();
+	stats.acmrBefore = ComputeACMR(indices, vertices.size());
+	stats.indexBytesBefore = indices.size() * sizeof(unsigned int);
+
+	WeldVertices(vertices, indices);
+	OptimizeVertexCache(indices, vertices.size());
+	OptimizeOverdraw(indices, vertices);
+	OptimizeVertexFetch(vertices, indices);
+
+	stats.verticesAfter = vertices.size();
+	stats.acmrAfter = ComputeACMR(indices, vertices.size());
+	stats.indexBytesAfter = indices.size() * IndexSize(vertices.size());
+
+	// One write, so lines of meshes optimized in parallel do not interleave
+	ostringstream line;
+	line << "Optimized mesh " << meshName << ": vertices " << stats.verticesBefore << " -> " << stats.verticesAfter
+		<< ", ACMR " << stats.acmrBefore << " -> " << stats.acmrAfter
+		<< ", index buffer " << stats.indexBytesBefore / 1024.0 << " KiB -> " << stats.indexBytesAfter / 1024.0 << " KiB\n";
+	cout << line.str() << flush;
+	return stats;
+}
@@ -0,0 +1,317 @@
+#include <meshSimplifier.h>
+#include <meshOptimizer.h>
+#include <mesh.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <unordered_map>
+using namespace std;
+
+namespace {
+	bool lodSelection = true;
+
+	// LOD i targets LOD_REDUCTION^i of the triangles of LOD 0, with an error bound that doubles per level
+	const int MAX_LODS = 4;
+	const float LOD_REDUCTION = 0.5f;
+	const float LOD_BASE_ERROR = 0.01f;	// Relative to the mesh radius, for LOD 1
+	// A LOD that removes less than this fraction of the previous one's triangles is not worth keeping
+	const float LOD_MIN_GAIN = 0.1f;
+
+	// Symmetric 4x4 matrix of the sum of squared distances to a set of planes, weighted by triangle area
+	struct Quadric {
+		double a00 = 0, a01 = 0, a02 = 0, a03 = 0;
+		double a11 = 0, a12 = 0, a13 = 0;
+		double a22 = 0, a23 = 0;
+		double a33 = 0;
+		double weight = 0;
+
+		void addPlane(glm::dvec3 n, double d, double w) {
+			a00 += w * n.x * n.x; a01 += w * n.x * n.y; a02 += w * n.x * n.z; a03 += w * n.x * d;
+			a11 += w * n.y * n.y; a12 += w * n.y * n.z; a13 += w * n.y * d;
+			a22 += w * n.z * n.z; a23 += w * n.z * d;
+			a33 += w * d * d;
+			weight += w;
+		}
+
+		void add(const Quadric& q) {
+			a00 += q.a00; a01 += q.a01; a02 += q.a02; a03 += q.a03;
+			a11 += q.a11; a12 += q.a12; a13 += q.a13;
+			a22 += q.a22; a23 += q.a23;
+			a33 += q.a33;
+			weight += q.weight;
+		}
+
+		// Weighted mean squared distance of p to the planes
+		double error(glm::dvec3 p) const {
+			double e = a00 * p.x * p.x + 2 * a01 * p.x * p.y + 2 * a02 * p.x * p.z + 2 * a03 * p.x
+				+ a11 * p.y * p.y + 2 * a12 * p.y * p.z + 2 * a13 * p.y
+				+ a22 * p.z * p.z + 2 * a23 * p.z
+				+ a33;
+			return weight > 0 ? fabs(e) / weight : 0.0;
+		}
+	};
+
+	struct Collapse {
+		unsigned int from;
+		unsigned int to;
+		double error;	// Squared distance
+	};
+
+	uint64_t edgeKey(unsigned int a, unsigned int b) {
+		return a < b ? (uint64_t(a) << 32 | b) : (uint64_t(b) << 32 | a);
+	}
+
+	glm::vec3 triangleNormal(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c) {
+		return glm::cross(b - a, c - a);
+	}
+}
+
+void SetLodSelection(bool enabled) {
+	lodSelection = enabled;
+}
+
+bool LodSelectionEnabled() {
+	return lodSelection;
+}
+
+float SimplifyMesh(const vector<Vertex>& vertices, const vector<unsigned int>& indices, size_t targetIndexCount, float targetError, vector<unsigned int>& result) {
+	result = indices;
+	size_t vertexCount = vertices.size();
+	if (indices.size() <= targetIndexCount || vertexCount == 0)
+		return 0.0f;
+
+	// 1. Lock vertices that must not move: seams (several vertices at one position) and open borders
+	vector<bool> locked(vertexCount, false);
+	{
+		struct PositionHash {
+			size_t operator()(const glm::vec3& p) const {
+				uint32_t bits[3];
+				memcpy(bits, &p, sizeof(bits));
+				return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+			}
+		};
+		unordered_map<glm::vec3, unsigned int, PositionHash> firstAtPosition;
+		firstAtPosition.reserve(vertexCount);
+		for (unsigned int v = 0; v < vertexCount; v++) {
+			auto inserted = firstAtPosition.emplace(vertices[v].Position, v);
+			if (!inserted.second) {
+				locked[v] = true;
+				locked[inserted.first->second] = true;
+			}
+		}
+
+		unordered_map<uint64_t, unsigned int> edgeUse;
+		edgeUse.reserve(indices.size());
+		for (size_t i = 0; i < indices.size(); i += 3) {
+			for (int k = 0; k < 3; k++)
+				edgeUse[edgeKey(indices[i + k], indices[i + (k + 1) % 3])]++;
+		}
+		for (const auto& edge : edgeUse) {
+			if (edge.second == 1) {
+				locked[edge.first >> 32] = true;
+				locked[edge.first & 0xffffffffu] = true;
+			}
+		}
+	}
+
+	// 2. Vertex quadrics from the planes of the original triangles
+	vector<Quadric> quadrics(vertexCount);
+	for (size_t i = 0; i < indices.size(); i += 3) {
+		glm::dvec3 a = vertices[indices[i]].Position;
+		glm::dvec3 b = vertices[indices[i + 1]].Position;
+		glm::dvec3 c = vertices[indices[i + 2]].Position;
+		glm::dvec3 n = glm::cross(b - a, c - a);
+		double area = glm::length(n);
+		if (area <= 0.0)
+			continue;
+		n /= area;
+		for (int k = 0; k < 3; k++)
+			quadrics[indices[i + k]].addPlane(n, -glm::dot(n, a), area);
+	}
+
+	// 3. Collapse edges in passes, cheapest first, until the target or the error bound is reached
+	double maxErrorSq = double(targetError) * targetError;
+	double resultErrorSq = 0.0;
+	vector<unsigned int> remap(vertexCount);
+	vector<bool> touched(vertexCount);
+	vector<unsigned int> adjacencyOffset(vertexCount + 1), adjacency;
+	vector<Collapse> collapses;
+
+	while (result.size() > targetIndexCount) {
+		// Triangles around every vertex
+		fill(adjacencyOffset.begin(), adjacencyOffset.end(), 0);
+		for (unsigned int index : result)
+			adjacencyOffset[index + 1]++;
+		for (size_t v = 0; v < vertexCount; v++)
+			adjacencyOffset[v + 1] += adjacencyOffset[v];
+		adjacency.resize(result.size());
+		{
+			vector<unsigned int> cursor(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+			for (size_t i = 0; i < result.size(); i++)
+				adjacency[cursor[result[i]]++] = static_cast<unsigned int>(i / 3);
+		}
+
+		// Candidate collapses within the error bound. Each collapse moves 'from' onto 'to'.
+		collapses.clear();
+		for (size_t i = 0; i < result.size(); i += 3) {
+			for (int k = 0; k < 3; k++) {
+				unsigned int a = result[i + k];
+				unsigned int b = result[i + (k + 1) % 3];
+				for (int direction = 0; direction < 2; direction++) {
+					unsigned int from = direction ? b : a;
+					unsigned int to = direction ? a : b;
+					if (locked[from])
+						continue;
+					Quadric q = quadrics[from];
+					q.add(quadrics[to]);
+					double error = q.error(vertices[to].Position);
+					if (error <= maxErrorSq)
+						collapses.push_back({ from, to, error });
+				}
+			}
+		}
+		if (collapses.empty())
+			break;
+		sort(collapses.begin(), collapses.end(), [](const Collapse& x, const Collapse& y) { return x.error < y.error; });
+
+		// Apply as many independent collapses as this pass allows. A collapse removes about two triangles.
+		for (unsigned int v = 0; v < vertexCount; v++)
+			remap[v] = v;
+		fill(touched.begin(), touched.end(), false);
+		size_t trianglesToRemove = (result.size() - targetIndexCount) / 3;
+		size_t removed = 0;
+		size_t applied = 0;
+		for (const Collapse& collapse : collapses) {
+			if (removed >= trianglesToRemove)
+				break;
+			if (touched[collapse.from] || touched[collapse.to])
+				continue;
+
+			// Reject collapses that flip a triangle around 'from'
+			bool flips = false;
+			size_t collapsing = 0;
+			for (unsigned int a = adjacencyOffset[collapse.from]; a < adjacencyOffset[collapse.from + 1] && !flips; a++) {
+				const unsigned int* triangle = &result[adjacency[a] * 3];
+				if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to) {
+					collapsing++;
+					continue;
+				}
+				glm::vec3 p[3], q[3];
+				for (int k = 0; k < 3; k++) {
+					p[k] = vertices[triangle[k]].Position;
+					q[k] = triangle[k] == collapse.from ? vertices[collapse.to].Position : p[k];
+				}
+				glm::vec3 before = triangleNormal(p[0], p[1], p[2]);
+				glm::vec3 after = triangleNormal(q[0], q[1], q[2]);
+				flips = glm::dot(before, after) <= 0.0f;
+			}
+			if (flips)
+				continue;
+
+			remap[collapse.from] = collapse.to;
+			quadrics[collapse.to].add(quadrics[collapse.from]);
+			resultErrorSq = max(resultErrorSq, collapse.error);
+			removed += collapsing;
+			applied++;
+
+			// The neighbourhood of 'from' changes shape, so its vertices wait for the next pass
+			for (unsigned int a = adjacencyOffset[collapse.from]; a < adjacencyOffset[collapse.from + 1]; a++) {
+				const unsigned int* triangle = &result[adjacency[a] * 3];
+				touched[triangle[0]] = touched[triangle[1]] = touched[triangle[2]] = true;
+			}
+		}
+		if (applied == 0)
+			break;
+
+		// Rewrite the triangles and drop the ones that collapsed
+		size_t write = 0;
+		for (size_t i = 0; i < result.size(); i += 3) {
+			unsigned int a = remap[result[i]];
+			unsigned int b = remap[result[i + 1]];
+			unsigned int c = remap[result[i + 2]];
+			if (a == b || b == c || a == c)
+				continue;
+			result[write++] = a;
+			result[write++] = b;
+			result[write++] = c;
+		}
+		result.resize(write);
+	}
+
+	return static_cast<float>(sqrt(resultErrorSq));
+}
+
+vector<MeshLod> BuildLodChain(const vector<Vertex>& vertices, vector<unsigned int>& indices, const string& meshName) {
+	vector<MeshLod> lods;
+	MeshLod base;
+	base.indexCount = static_cast<uint32_t>(indices.size());
+	lods.push_back(base);
+	if (indices.empty())
+		return lods;
+
+	// The error bound scales with the size of the mesh
+	glm::vec3 minimum = vertices[0].Position;
+	glm::vec3 maximum = minimum;
+	for (const Vertex& vertex : vertices) {
+		minimum = glm::min(minimum, vertex.Position);
+		maximum = glm::max(maximum, vertex.Position);
+	}
+	float radius = glm::length(maximum - minimum) * 0.5f;
+
+	// Every LOD is simplified from LOD 0, so the error is always measured against the full mesh
+	vector<unsigned int> lod0(indices);
+	size_t previousCount = lod0.size();
+	float targetError = LOD_BASE_ERROR * radius;
+	float ratio = 1.0f;
+	for (int level = 1; level < MAX_LODS; level++) {
+		ratio *= LOD_REDUCTION;
+		size_t target = static_cast<size_t>(lod0.size() / 3 * ratio) * 3;
+		vector<unsigned int> simplified;
+		float error = SimplifyMesh(vertices, lod0, target, targetError, simplified);
+		if (simplified.empty() || simplified.size() > previousCount * (1.0f - LOD_MIN_GAIN))
+			break;
+
+		OptimizeVertexCache(simplified, vertices.size());
+		MeshLod lod;
+		lod.indexOffset = static_cast<uint32_t>(indices.size());
+		lod.indexCount = static_cast<uint32_t>(simplified.size());
+		lod.error = error;
+		lods.push_back(lod);
+		indices.insert(indices.end(), simplified.begin(), simplified.end());
+
+		previousCount = simplified.size();
+		targetError *= 2.0f;
+	}
+
+	ostringstream line;
+	line << "LODs of " << meshName << ":";
+	for (const MeshLod& lod : lods)
+		line << " " << lod.indexCount / 3;
+	line << " triangles\n";
+	cout << line.str() << flush;
+	return lods;
+}
+
+unsigned int SelectLod(const vector<MeshLod>& lods, float pixelsPerUnit, float pixelError, unsigned int current) {
+	if (lods.size() < 2 || pixelError <= 0.0f)
+		return 0;
+	if (current >= lods.size())
+		current = 0;
+
+	// Coarsest LOD whose error projects to less than the threshold
+	unsigned int target = 0;
+	for (unsigned int i = static_cast<unsigned int>(lods.size()) - 1; i > 0; i--) {
+		if (lods[i].error * pixelsPerUnit <= pixelError) {
+			target = i;
+			break;
+		}
+	}
+
+	// Refine right away, but only coarsen once the error is well below the threshold
+	if (target > current && lods[target].error * pixelsPerUnit > pixelError * LOD_HYSTERESIS)
+		return current;
+	return target;
+}
@@ -0,0 +1,293 @@
+#include <occlusion.h>
+#include <model.h>
+#include <profiler.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <unordered_map>
+
+#ifdef CULLING_SSE
+#include <emmintrin.h>
+#endif
+using namespace std;
+
+namespace {
+	bool occlusionCulling = true;
+
+	double elapsedSince(chrono::steady_clock::time_point start) {
+		return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+	}
+
+	// Edge function A * x + B * y + C of the edge v0 -> v1, positive on the inside of counter-clockwise triangles
+	struct Edge {
+		float a, b, c;
+
+		Edge(const glm::vec3& v0, const glm::vec3& v1)
+			: a(v0.y - v1.y), b(v1.x - v0.x), c(-(a * v0.x + b * v0.y)) {}
+
+		float at(float x, float y) const { return a * x + b * y + c; }
+	};
+}
+
+void SetOcclusionCulling(bool enabled) {
+	occlusionCulling = enabled;
+}
+
+bool OcclusionCullingEnabled() {
+	return occlusionCulling;
+}
+
+vector<Occluder> BuildOccluders(const vector<const Model*>& models, size_t maxCount, size_t triangleBudget) {
+	// Rank all meshes by the surface of their world space box
+	struct Candidate {
+		const Mesh* mesh;
+		glm::mat4 transform;
+		Aabb bounds;
+		float score;
+	};
+	vector<Candidate> candidates;
+	for (const Model* model : models) {
+		for (size_t i = 0; i < model->asset->meshes.size(); i++) {
+			const Mesh& mesh = model->asset->meshes[i];
+			const glm::mat4& transform = model->meshTransform(i);
+			Aabb bounds = TransformAabb(mesh.bounds, transform);
+			glm::vec3 size = bounds.max - bounds.min;
+			candidates.push_back({ &mesh, transform, bounds, size.x * size.y + size.y * size.z + size.z * size.x });
+		}
+	}
+	sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) { return a.score > b.score; });
+
+	vector<Occluder> occluders;
+	size_t triangles = 0;
+	for (const Candidate& candidate : candidates) {
+		if (occluders.size() >= maxCount)
+			break;
+		const Mesh& mesh = *candidate.mesh;
+		glm::vec3 size = mesh.bounds.max - mesh.bounds.min;
+		float maxError = OCCLUDER_MAX_LOD_ERROR * std::max(size.x, std::max(size.y, size.z));
+		const MeshLod* chosen = nullptr;
+		for (const MeshLod& lod : mesh.lods) {
+			if (lod.error > maxError)
+				break;
+			if (triangles + lod.indexCount / 3 <= triangleBudget) {
+				chosen = &lod;
+				break;
+			}
+		}
+		if (!chosen)
+			continue;
+		const MeshLod& lod = *chosen;
+
+		// Keep only the vertices the chosen LOD uses, eroded by its error so the proxy stays inside the mesh
+		vector<unsigned char> vertexData;
+		vector<unsigned int> indices;
+		mesh.readBack(vertexData, indices);
+		vector<Vertex> vertices = UnpackVertices(vertexData.data(), vertexData.size() / VertexStride(mesh.layout), mesh.layout);
+
+		Occluder occluder;
+		occluder.bounds = candidate.bounds;
+		const glm::mat4& transform = candidate.transform;
+		unordered_map<unsigned int, uint32_t> remap;
+		for (uint32_t i = lod.indexOffset; i < lod.indexOffset + lod.indexCount; i++) {
+			auto inserted = remap.emplace(indices[i], static_cast<uint32_t>(occluder.positions.size()));
+			if (inserted.second) {
+				const Vertex& vertex = vertices[indices[i]];
+				glm::vec3 position = vertex.Position - vertex.Normal * lod.error;
+				occluder.positions.push_back(glm::vec3(transform * glm::vec4(position, 1.0f)));
+			}
+			occluder.indices.push_back(inserted.first->second);
+		}
+		triangles += lod.indexCount / 3;
+		occluders.push_back(std::move(occluder));
+	}
+
+	cout << "Occlusion: " << occluders.size() << " occluders, " << triangles << " triangles" << endl;
+	return occluders;
+}
+
+OcclusionCuller::OcclusionCuller() {
+	glm::ivec2 size(OCCLUSION_WIDTH, OCCLUSION_HEIGHT);
+	while (true) {
+		levels.push_back(vector<float>(size_t(size.x) * size.y, 1.0f));
+		levelSizes.push_back(size);
+		if (size.x == 1 && size.y == 1)
+			break;
+		size = glm::max(size / 2, glm::ivec2(1));
+	}
+}
+
+void OcclusionCuller::setOccluders(vector<Occluder> occluders) {
+	this->occluders = std::move(occluders);
+}
+
+void OcclusionCuller::render(const glm::mat4& viewProjection) {
+	PROFILE_ZONE("OcclusionCuller::render");
+	auto start = chrono::steady_clock::now();
+	this->viewProjection = viewProjection;
+
+	vector<float>& depth = levels[0];
+	fill(depth.begin(), depth.end(), 1.0f);
+
+	// 1. Rasterize the occluders in the frustum
+	Frustum frustum = Frustum::FromMatrix(viewProjection);
+	for (const Occluder& occluder : occluders) {
+		if (frustum.test(occluder.bounds) == FRUSTUM_OUTSIDE)
+			continue;
+		projected.resize(occluder.positions.size());
+		for (size_t i = 0; i < occluder.positions.size(); i++) {
+			glm::vec4 clip = viewProjection * glm::vec4(occluder.positions[i], 1.0f);
+			if (clip.w <= 1e-5f || clip.z < -clip.w) {
+				projected[i] = glm::vec4(0.0f, 0.0f, 0.0f, -1.0f);
+				continue;
+			}
+			glm::vec3 ndc = glm::vec3(clip) / clip.w;
+			projected[i] = glm::vec4((ndc.x * 0.5f + 0.5f) * OCCLUSION_WIDTH, (ndc.y * 0.5f + 0.5f) * OCCLUSION_HEIGHT,
+				ndc.z * 0.5f + 0.5f, 1.0f);
+		}
+
+		for (size_t i = 0; i + 2 < occluder.indices.size(); i += 3) {
+			const glm::vec4& a = projected[occluder.indices[i]];
+			const glm::vec4& b = projected[occluder.indices[i + 1]];
+			const glm::vec4& c = projected[occluder.indices[i + 2]];
+			if (a.w < 0.0f || b.w < 0.0f || c.w < 0.0f)
+				continue;
+			rasterizeTriangle(glm::vec3(a), glm::vec3(b), glm::vec3(c));
+		}
+	}
+
+	// 2. Every pyramid level keeps the farthest depth of the 2x2 texels below it
+	for (size_t level = 1; level < levels.size(); level++) {
+		const vector<float>& source = levels[level - 1];
+		glm::ivec2 sourceSize = levelSizes[level - 1];
+		glm::ivec2 size = levelSizes[level];
+		for (int y = 0; y < size.y; y++) {
+			int y0 = glm::min(y * 2, sourceSize.y - 1), y1 = glm::min(y * 2 + 1, sourceSize.y - 1);
+			for (int x = 0; x < size.x; x++) {
+				int x0 = glm::min(x * 2, sourceSize.x - 1), x1 = glm::min(x * 2 + 1, sourceSize.x - 1);
+				float farthest = glm::max(glm::max(source[y0 * sourceSize.x + x0], source[y0 * sourceSize.x + x1]),
+					glm::max(source[y1 * sourceSize.x + x0], source[y1 * sourceSize.x + x1]));
+				levels[level][y * size.x + x] = farthest;
+			}
+		}
+	}
+
+	elapsedMs = elapsedSince(start);
+}
+
+void OcclusionCuller::rasterizeTriangle(glm::vec3 a, glm::vec3 b, glm::vec3 c) {
+	float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+	if (!(fabs(area) > 1e-6f))
+		return;
+	// Occluders are drawn two-sided
+	if (area < 0.0f) {
+		swap(b, c);
+		area = -area;
+	}
+
+	int minX = glm::max(0, static_cast<int>(floor(glm::min(a.x, glm::min(b.x, c.x)))));
+	int maxX = glm::min(OCCLUSION_WIDTH - 1, static_cast<int>(ceil(glm::max(a.x, glm::max(b.x, c.x)))));
+	int minY = glm::max(0, static_cast<int>(floor(glm::min(a.y, glm::min(b.y, c.y)))));
+	int maxY = glm::min(OCCLUSION_HEIGHT - 1, static_cast<int>(ceil(glm::max(a.y, glm::max(b.y, c.y)))));
+	if (minX > maxX || minY > maxY)
+		return;
+	minX &= ~3;
+
+	// e0, e1, e2 are the barycentric weights of a, b and c (times the area), so depth is a plane in x and y
+	Edge e0(b, c), e1(c, a), e2(a, b);
+	float zA = (e0.a * a.z + e1.a * b.z + e2.a * c.z) / area;
+	float zB = (e0.b * a.z + e1.b * b.z + e2.b * c.z) / area;
+	float zC = (e0.c * a.z + e1.c * b.z + e2.c * c.z) / area;
+
+	float* depth = levels[0].data();
+	for (int y = minY; y <= maxY; y++) {
+		float py = y + 0.5f;
+		float* row = depth + size_t(y) * OCCLUSION_WIDTH;
+		int x = minX;
+
+#ifdef CULLING_SSE
+		// Four pixels per step; rows are a multiple of 4 wide, so the last step never leaves the row
+		__m128 px = _mm_add_ps(_mm_set1_ps(minX + 0.5f), _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f));
+		__m128 w0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(e0.a), px), _mm_set1_ps(e0.b * py + e0.c));
+		__m128 w1 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(e1.a), px), _mm_set1_ps(e1.b * py + e1.c));
+		__m128 w2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(e2.a), px), _mm_set1_ps(e2.b * py + e2.c));
+		__m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(zA), px), _mm_set1_ps(zB * py + zC));
+		__m128 w0Step = _mm_set1_ps(e0.a * 4.0f), w1Step = _mm_set1_ps(e1.a * 4.0f), w2Step = _mm_set1_ps(e2.a * 4.0f);
+		__m128 zStep = _mm_set1_ps(zA * 4.0f);
+		const __m128 zero = _mm_setzero_ps();
+
+		for (; x <= maxX; x += 4) {
+			__m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(w0, zero), _mm_cmpge_ps(w1, zero)), _mm_cmpge_ps(w2, zero));
+			if (_mm_movemask_ps(inside)) {
+				__m128 current = _mm_loadu_ps(row + x);
+				__m128 nearest = _mm_min_ps(current, z);
+				_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, current)));
+			}
+			w0 = _mm_add_ps(w0, w0Step);
+			w1 = _mm_add_ps(w1, w1Step);
+			w2 = _mm_add_ps(w2, w2Step);
+			z = _mm_add_ps(z, zStep);
+		}
+#endif
+
+		for (; x <= maxX; x++) {
+			float px = x + 0.5f;
+			if (e0.at(px, py) >= 0.0f && e1.at(px, py) >= 0.0f && e2.at(px, py) >= 0.0f)
+				row[x] = glm::min(row[x], zA * px + zB * py + zC);
+		}
+	}
+}
+
+bool OcclusionCuller::boxOccluded(const Aabb& box) const {
+	glm::vec3 minimum(0.0f), maximum(0.0f);
+	for (int corner = 0; corner < 8; corner++) {
+		glm::vec3 position(corner & 1 ? box.max.x : box.min.x, corner & 2 ? box.max.y : box.min.y, corner & 4 ? box.max.z : box.min.z);
+		glm::vec4 clip = viewProjection * glm::vec4(position, 1.0f);
+		// Boxes touching the near plane are never occluded
+		if (clip.w <= 1e-5f || clip.z < -clip.w)
+			return false;
+		glm::vec3 ndc = glm::vec3(clip) / clip.w;
+		minimum = corner ? glm::min(minimum, ndc) : ndc;
+		maximum = corner ? glm::max(maximum, ndc) : ndc;
+	}
+
+	int x0 = static_cast<int>(floor((minimum.x * 0.5f + 0.5f) * OCCLUSION_WIDTH));
+	int x1 = static_cast<int>(floor((maximum.x * 0.5f + 0.5f) * OCCLUSION_WIDTH));
+	int y0 = static_cast<int>(floor((minimum.y * 0.5f + 0.5f) * OCCLUSION_HEIGHT));
+	int y1 = static_cast<int>(floor((maximum.y * 0.5f + 0.5f) * OCCLUSION_HEIGHT));
+	if (x1 < 0 || y1 < 0 || x0 >= OCCLUSION_WIDTH || y0 >= OCCLUSION_HEIGHT)
+		return false;	// Off screen, left to the frustum test
+	x0 = glm::max(x0, 0);
+	y0 = glm::max(y0, 0);
+	x1 = glm::min(x1, OCCLUSION_WIDTH - 1);
+	y1 = glm::min(y1, OCCLUSION_HEIGHT - 1);
+	float nearest = minimum.z * 0.5f + 0.5f;
+
+	// Coarsest level where the rectangle covers at most 2x2 texels
+	size_t level = 0;
+	while (level + 1 < levels.size() && ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1))
+		level++;
+
+	glm::ivec2 size = levelSizes[level];
+	const vector<float>& depth = levels[level];
+	float farthest = 0.0f;
+	for (int y = y0 >> level; y <= glm::min(y1 >> level, size.y - 1); y++) {
+		for (int x = x0 >> level; x <= glm::min(x1 >> level, size.x - 1); x++)
+			farthest = glm::max(farthest, depth[y * size.x + x]);
+	}
+	return nearest > farthest;
+}
+
+size_t OcclusionCuller::cull(const Aabb* boxes, size_t count, uint8_t* visible) {
+	auto start = chrono::steady_clock::now();
+	size_t occluded = 0;
+	for (size_t i = 0; i < count; i++) {
+		if (visible[i] && boxOccluded(boxes[i])) {
+			visible[i] = 0;
+			occluded++;
+		}
+	}
+	elapsedMs += elapsedSince(start);
+	return occluded;
+}
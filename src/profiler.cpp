@@ -0,0 +1,249 @@
+#include <profiler.h>
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+using namespace std;
+
+namespace {
+	struct ZoneEvent {
+		const char* name;
+		uint64_t startNs;		// Since the profiler was started
+		uint64_t durationNs;
+	};
+
+	// Zones of one thread. Only the owning thread appends; 'count' is published after the event is written,
+	// so the trace writer can read the buffer while the thread keeps recording.
+	struct ThreadTrace {
+		uint32_t id = 0;
+		string name;
+		unique_ptr<ZoneEvent[]> events;
+		atomic<size_t> count{ 0 };
+		atomic<size_t> dropped{ 0 };
+
+		void append(const char* zoneName, uint64_t startNs, uint64_t durationNs) {
+			size_t index = count.load(memory_order_relaxed);
+			if (index >= PROFILER_EVENTS_PER_THREAD) {
+				dropped.fetch_add(1, memory_order_relaxed);
+				return;
+			}
+			events[index] = { zoneName, startNs, durationNs };
+			count.store(index + 1, memory_order_release);
+		}
+	};
+
+	struct GpuZoneRecord {
+		const char* name;
+		GLuint beginQuery;
+		GLuint endQuery;
+	};
+
+	atomic<bool> recording{ false };
+	string traceOutput;
+	chrono::steady_clock::time_point epoch;
+
+	// Buffers of every thread that recorded a zone. They are never freed: pool workers live as long as the
+	// process, and the trace is written after the last frame.
+	mutex registryMutex;
+	vector<unique_ptr<ThreadTrace>> threadTraces;
+	thread_local ThreadTrace* threadTrace = nullptr;
+	thread_local string threadName;
+
+	// GL thread only
+	ThreadTrace gpuTrace;
+	vector<GpuZoneRecord> gpuFrames[PROFILER_GPU_LATENCY];
+	int gpuFrame = 0;
+	vector<GLuint> freeQueries;
+	vector<GLuint> allQueries;
+	int64_t gpuToCpuNs = 0;		// Added to GPU timestamps to get steady_clock nanoseconds since the epoch
+	bool gpuCalibrated = false;
+
+	uint64_t nowNs() {
+		return static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - epoch).count());
+	}
+
+	ThreadTrace& currentTrace() {
+		if (!threadTrace) {
+			auto trace = make_unique<ThreadTrace>();
+			trace->events.reset(new ZoneEvent[PROFILER_EVENTS_PER_THREAD]);
+			lock_guard<mutex> lock(registryMutex);
+			trace->id = static_cast<uint32_t>(threadTraces.size() + 1);
+			trace->name = threadName.empty() ? "Thread " + to_string(trace->id) : threadName;
+			threadTrace = trace.get();
+			threadTraces.push_back(std::move(trace));
+		}
+		return *threadTrace;
+	}
+
+	GLuint takeQuery() {
+		if (freeQueries.empty()) {
+			GLuint query;
+			glGenQueries(1, &query);
+			allQueries.push_back(query);
+			return query;
+		}
+		GLuint query = freeQueries.back();
+		freeQueries.pop_back();
+		return query;
+	}
+
+	// Turn the zones of one GPU frame into events. Blocks only if the GPU is more than PROFILER_GPU_LATENCY
+	// frames behind.
+	void collectGpuFrame(vector<GpuZoneRecord>& zones) {
+		for (const GpuZoneRecord& zone : zones) {
+			GLuint64 begin = 0, end = 0;
+			glGetQueryObjectui64v(zone.beginQuery, GL_QUERY_RESULT, &begin);
+			glGetQueryObjectui64v(zone.endQuery, GL_QUERY_RESULT, &end);
+			int64_t start = static_cast<int64_t>(begin) + gpuToCpuNs;
+			if (start >= 0 && end >= begin)
+				gpuTrace.append(zone.name, static_cast<uint64_t>(start), end - begin);
+			freeQueries.push_back(zone.beginQuery);
+			freeQueries.push_back(zone.endQuery);
+		}
+		zones.clear();
+	}
+
+	void writeEscaped(ofstream& out, const string& text) {
+		for (char c : text) {
+			if (c == '"' || c == '\\')
+				out << '\\';
+			out << c;
+		}
+	}
+
+	void writeThread(ofstream& out, const ThreadTrace& trace, bool& first) {
+		out << (first ? "\n" : ",\n") << "  { \"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << trace.id
+			<< ", \"args\": { \"name\": \"";
+		writeEscaped(out, trace.name);
+		out << "\" } }";
+		first = false;
+
+		size_t count = trace.count.load(memory_order_acquire);
+		for (size_t i = 0; i < count; i++) {
+			const ZoneEvent& event = trace.events[i];
+			out << ",\n  { \"name\": \"";
+			writeEscaped(out, event.name);
+			out << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << trace.id
+				<< ", \"ts\": " << event.startNs / 1000.0 << ", \"dur\": " << event.durationNs / 1000.0 << " }";
+		}
+	}
+}
+
+void StartProfiler(const string& tracePath) {
+#ifndef PROFILER_ENABLED
+	cout << "ERROR::PROFILER::COMPILED_OUT: rebuild with -DPROFILER=ON to record " << tracePath << endl;
+#endif
+	traceOutput = tracePath;
+	epoch = chrono::steady_clock::now();
+	recording = true;
+}
+
+bool ProfilerRecording() {
+	return recording.load(memory_order_acquire);
+}
+
+void SetProfilerThreadName(const string& name) {
+	threadName = name;
+	if (threadTrace) {
+		lock_guard<mutex> lock(registryMutex);
+		threadTrace->name = name;
+	}
+}
+
+void ProfilerBeginFrame() {
+	if (!ProfilerRecording())
+		return;
+	gpuFrame = (gpuFrame + 1) % PROFILER_GPU_LATENCY;
+	collectGpuFrame(gpuFrames[gpuFrame]);
+}
+
+bool WriteProfilerTrace() {
+	if (!ProfilerRecording())
+		return false;
+	for (vector<GpuZoneRecord>& zones : gpuFrames)
+		collectGpuFrame(zones);
+	if (!allQueries.empty())
+		glDeleteQueries(static_cast<GLsizei>(allQueries.size()), allQueries.data());
+	allQueries.clear();
+	freeQueries.clear();
+	recording = false;
+
+	ofstream out(traceOutput);
+	if (!out) {
+		cout << "ERROR::PROFILER::FAILED_TO_OPEN_OUTPUT: " << traceOutput << endl;
+		return false;
+	}
+
+	out << fixed << setprecision(3);
+	out << "{ \"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+	bool first = true;
+	size_t events = 0, dropped = 0;
+	{
+		lock_guard<mutex> lock(registryMutex);
+		for (const auto& trace : threadTraces) {
+			writeThread(out, *trace, first);
+			events += trace->count.load(memory_order_acquire);
+			dropped += trace->dropped.load(memory_order_relaxed);
+		}
+	}
+	if (gpuTrace.count > 0) {
+		writeThread(out, gpuTrace, first);
+		events += gpuTrace.count;
+		dropped += gpuTrace.dropped;
+	}
+	out << "\n] }\n";
+
+	cout << "Profiler trace: " << events << " zones written to " << traceOutput;
+	if (dropped > 0)
+		cout << " (" << dropped << " dropped, buffers full)";
+	cout << endl;
+	return true;
+}
+
+// ProfileZone
+// -----------
+ProfileZone::ProfileZone(const char* name)
+	: name(name), active(ProfilerRecording())
+{
+	if (active)
+		start = nowNs();
+}
+
+ProfileZone::~ProfileZone() {
+	if (active)
+		currentTrace().append(name, start, nowNs() - start);
+}
+
+// GpuProfileZone
+// --------------
+GpuProfileZone::GpuProfileZone(const char* name) {
+	if (!ProfilerRecording())
+		return;
+	if (!gpuCalibrated) {
+		// Line the GPU clock up with the CPU clock once, at the first GPU zone
+		gpuTrace.id = 0;
+		gpuTrace.name = "GPU";
+		gpuTrace.events.reset(new ZoneEvent[PROFILER_EVENTS_PER_THREAD]);
+		GLint64 gpuNow = 0;
+		glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+		gpuToCpuNs = static_cast<int64_t>(nowNs()) - gpuNow;
+		gpuCalibrated = true;
+	}
+	GpuZoneRecord zone = { name, takeQuery(), takeQuery() };
+	glQueryCounter(zone.beginQuery, GL_TIMESTAMP);
+	gpuFrames[gpuFrame].push_back(zone);
+	endQuery = zone.endQuery;
+}
+
+GpuProfileZone::~GpuProfileZone() {
+	if (endQuery)
+		glQueryCounter(endQuery, GL_TIMESTAMP);
+}
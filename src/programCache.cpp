@@ -0,0 +1,140 @@
+#include <programCache.h>
+#include <scenePack.h>
+
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+using namespace std;
+
+namespace {
+	bool programCache = true;
+	ProgramCacheStats stats;
+
+	struct CacheHeader {
+		uint32_t magic;
+		uint32_t version;
+		uint64_t key;
+		uint32_t format;		// Driver specific binary format
+		uint32_t size;
+		double compileMs;		// Compile and link time of the cached program
+	};
+
+	const char* glString(GLenum name) {
+		const GLubyte* str = glGetString(name);
+		return str ? reinterpret_cast<const char*>(str) : "";
+	}
+}
+
+void SetProgramCacheEnabled(bool enabled) {
+	programCache = enabled;
+}
+
+bool ProgramCacheEnabled() {
+	return programCache;
+}
+
+bool ProgramCacheSupported() {
+	if (!GLEW_VERSION_4_1 && !GLEW_ARB_get_program_binary)
+		return false;
+	GLint formats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	return formats > 0;
+}
+
+const ProgramCacheStats& GetProgramCacheStats() {
+	return stats;
+}
+
+uint64_t ProgramCacheKey(const vector<string>& sources) {
+	uint64_t key = HashBytes(&PROGRAM_CACHE_VERSION, sizeof(PROGRAM_CACHE_VERSION));
+	for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION }) {
+		string driver = glString(name);
+		key = HashBytes(driver.data(), driver.size() + 1, key);
+	}
+	for (const string& source : sources)
+		key = HashBytes(source.data(), source.size() + 1, key);	// The terminator keeps stage boundaries apart
+	return key;
+}
+
+string ProgramCachePath(const string& vertexPath, uint64_t key) {
+	stringstream name;
+	name << hex << setw(16) << setfill('0') << key << ".glbin";
+	return (filesystem::path(vertexPath).parent_path() / "cache" / name.str()).string();
+}
+
+bool LoadProgramBinary(GLuint program, const string& cachePath, uint64_t key, bool& rejected, double& compileMs) {
+	rejected = false;
+	ifstream in(cachePath, ios::binary);
+	if (!in)
+		return false;
+
+	CacheHeader header;
+	if (!in.read(reinterpret_cast<char*>(&header), sizeof(header))
+		|| header.magic != PROGRAM_CACHE_MAGIC || header.version != PROGRAM_CACHE_VERSION
+		|| header.key != key || header.size == 0)
+		return false;
+	vector<char> binary(header.size);
+	if (!in.read(binary.data(), binary.size()))
+		return false;
+
+	glProgramBinary(program, header.format, binary.data(), static_cast<GLsizei>(binary.size()));
+	GLint linked = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	if (!linked) {
+		rejected = true;
+		return false;
+	}
+	compileMs = header.compileMs;
+	return true;
+}
+
+bool SaveProgramBinary(GLuint program, const string& cachePath, uint64_t key, double compileMs) {
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+		return false;
+	vector<char> binary(length);
+	GLenum format = 0;
+	glGetProgramBinary(program, length, &length, &format, binary.data());
+
+	error_code ec;
+	filesystem::create_directories(filesystem::path(cachePath).parent_path(), ec);
+
+	// Written to a temporary file first so a crash never leaves a half-written cache entry behind
+	string tempPath = cachePath + ".tmp";
+	{
+		ofstream out(tempPath, ios::binary | ios::trunc);
+		if (!out)
+			return false;
+		CacheHeader header = { PROGRAM_CACHE_MAGIC, PROGRAM_CACHE_VERSION, key, format, uint32_t(length), compileMs };
+		out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		out.write(binary.data(), length);
+		if (!out)
+			return false;
+	}
+
+	filesystem::rename(tempPath, cachePath, ec);
+	if (ec) {
+		cout << "ERROR::PROGRAM_CACHE::FAILED_TO_WRITE: " << cachePath << " (" << ec.message() << ")" << endl;
+		return false;
+	}
+	return true;
+}
+
+void RecordProgramLoad(const string& name, bool hit, bool rejected, double loadMs, double compileMs) {
+	stats.programs++;
+	stats.loadMs += loadMs;
+	if (hit) {
+		stats.hits++;
+		stats.savedMs += compileMs - loadMs;
+		cout << "Program cache hit: " << name << " in " << loadMs << " ms (saved " << compileMs - loadMs << " ms)" << endl;
+		return;
+	}
+	stats.misses++;
+	if (rejected)
+		stats.rejected++;
+	if (programCache)
+		cout << "Program cache " << (rejected ? "rejected" : "miss") << ": " << name << " compiled in " << loadMs << " ms" << endl;
+}
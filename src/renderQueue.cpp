@@ -0,0 +1,196 @@
+#include <profiler.h>
+#include <renderQueue.h>
+#include <uniformBuffers.h>
+
+#include <algorithm>
+#include <cassert>
+#include <map>
+using namespace std;
+
+namespace {
+	vector<vector<TextureBinding>> materials;
+	map<vector<uint64_t>, uint32_t> materialIds;
+
+	// Texture units the queue tracks bindings for. Material units are well below this.
+	const GLuint TRACKED_TEXTURE_UNITS = 32;
+
+	bool depthPrepass = true;
+
+	void setPassState(RenderPass pass) {
+		GLboolean color = pass == RENDER_PASS_DEPTH ? GL_FALSE : GL_TRUE;
+		glColorMask(color, color, color, color);
+		glDepthMask(pass == RENDER_PASS_DEPTH_EQUAL ? GL_FALSE : GL_TRUE);
+		glDepthFunc(pass == RENDER_PASS_DEPTH_EQUAL ? GL_EQUAL : GL_LESS);
+	}
+}
+
+void SetDepthPrepass(bool enabled) {
+	depthPrepass = enabled;
+}
+
+bool DepthPrepassEnabled() {
+	return depthPrepass;
+}
+
+uint32_t InternMaterial(const vector<TextureBinding>& bindings) {
+	vector<uint64_t> key;
+	key.reserve(bindings.size());
+	for (const TextureBinding& binding : bindings)
+		key.push_back(uint64_t(binding.unit) << 32 | binding.texture);
+	sort(key.begin(), key.end());
+
+	auto it = materialIds.find(key);
+	if (it != materialIds.end())
+		return it->second;
+
+	uint32_t id = static_cast<uint32_t>(materials.size());
+	materials.push_back(bindings);
+	materialIds.emplace(std::move(key), id);
+	return id;
+}
+
+const vector<TextureBinding>& GetMaterial(uint32_t materialId) {
+	return materials[materialId];
+}
+
+uint32_t EmptyMaterial() {
+	static const uint32_t id = InternMaterial(vector<TextureBinding>());
+	return id;
+}
+
+void RenderQueue::clear() {
+	items.clear();
+	keys.clear();
+	multiCounts.clear();
+	multiOffsets.clear();
+	multiBaseVertices.clear();
+	programs.clear();
+}
+
+uint64_t RenderQueue::makeKey(const DrawItem& item, float viewDistance, float farPlane) {
+	uint64_t programIndex = find(programs.begin(), programs.end(), item.program) - programs.begin();
+	if (programIndex == programs.size()) {
+		// Indices past the key field would alias other programs and interleave them in the sort
+		assert(programs.size() < RENDER_QUEUE_MAX_PROGRAMS);
+		programs.push_back(item.program);
+	}
+
+	float depth = farPlane > 0.0f ? viewDistance / farPlane : 0.0f;
+	depth = glm::clamp(depth, 0.0f, 1.0f);
+
+	return uint64_t(item.pass & 0x3) << 62
+		| (programIndex & 0x3ff) << 52
+		| (uint64_t(item.materialId) & 0xffffff) << 28
+		| (uint64_t(item.vao) & 0xffff) << 12
+		| uint64_t(depth * 4095.0f);
+}
+
+void RenderQueue::submit(const DrawItem& item, float viewDistance, float farPlane) {
+	keys.push_back({ makeKey(item, viewDistance, farPlane), static_cast<uint32_t>(items.size()) });
+	items.push_back(item);
+}
+
+void RenderQueue::submitMultiDraw(const DrawItem& item, const GLsizei* counts, const size_t* offsets, GLsizei rangeCount, float viewDistance, float farPlane) {
+	if (rangeCount <= 0)
+		return;
+	DrawItem multi = item;
+	multi.multiFirst = static_cast<uint32_t>(multiCounts.size());
+	multi.multiCount = rangeCount;
+	for (GLsizei i = 0; i < rangeCount; i++) {
+		multiCounts.push_back(counts[i]);
+		multiOffsets.push_back((void*)offsets[i]);
+		multiBaseVertices.push_back(item.baseVertex);
+	}
+	submit(multi, viewDistance, farPlane);
+}
+
+void RenderQueue::execute(const UniformRing& objectUniforms, RenderStats& stats, GLuint samplesQuery) {
+	PROFILE_ZONE("RenderQueue::execute");
+	sort(keys.begin(), keys.end());
+
+	// State is unknown at the start of the frame, apart from the depth state, which is the opaque pass default
+	RenderPass pass = RENDER_PASS_OPAQUE;
+	bool counting = false;
+	const GLuint unknown = ~0u;
+	GLuint program = unknown;
+	GLuint vao = unknown;
+	uint32_t material = unknown;
+	uint32_t objectOffset = unknown;
+	GLuint activeUnit = unknown;
+	GLuint boundTextures[TRACKED_TEXTURE_UNITS];
+	fill(begin(boundTextures), end(boundTextures), unknown);
+
+	for (const auto& key : keys) {
+		const DrawItem& item = items[key.second];
+
+		if (item.pass != pass) {
+			setPassState(item.pass);
+			pass = item.pass;
+		}
+		if (samplesQuery && !counting && item.pass != RENDER_PASS_DEPTH) {
+			glBeginQuery(GL_SAMPLES_PASSED, samplesQuery);
+			counting = true;
+		}
+		if (item.program != program) {
+			glUseProgram(item.program);
+			program = item.program;
+			stats.programSwitches++;
+		}
+		if (item.materialId != material) {
+			for (const TextureBinding& binding : GetMaterial(item.materialId)) {
+				if (binding.unit < TRACKED_TEXTURE_UNITS && boundTextures[binding.unit] == binding.texture)
+					continue;
+				if (binding.unit != activeUnit) {
+					glActiveTexture(GL_TEXTURE0 + binding.unit);
+					activeUnit = binding.unit;
+				}
+				glBindTexture(binding.target, binding.texture);
+				if (binding.unit < TRACKED_TEXTURE_UNITS)
+					boundTextures[binding.unit] = binding.texture;
+				stats.textureBinds++;
+			}
+			material = item.materialId;
+		}
+		if (item.vao != vao) {
+			glBindVertexArray(item.vao);
+			vao = item.vao;
+			stats.vaoSwitches++;
+		}
+		if (item.objectOffset != objectOffset) {
+			objectUniforms.bind(item.objectOffset);
+			objectOffset = item.objectOffset;
+		}
+
+		if (item.pass == RENDER_PASS_DEPTH)
+			stats.depthPrepassDraws++;
+
+		if (item.multiCount > 0) {
+			glMultiDrawElementsBaseVertex(GL_TRIANGLES, &multiCounts[item.multiFirst], item.indexType,
+				&multiOffsets[item.multiFirst], item.multiCount, &multiBaseVertices[item.multiFirst]);
+		}
+		else if (item.instanceCount > 0) {
+			glDrawElementsInstancedBaseVertex(GL_TRIANGLES, item.indexCount, item.indexType, (void*)item.indexOffset,
+				item.instanceCount, item.baseVertex);
+		}
+		else if (item.baseVertex != 0) {
+			glDrawElementsBaseVertex(GL_TRIANGLES, item.indexCount, item.indexType, (void*)item.indexOffset, item.baseVertex);
+		}
+		else {
+			glDrawElements(GL_TRIANGLES, item.indexCount, item.indexType, (void*)item.indexOffset);
+		}
+		stats.drawCalls++;
+	}
+
+	if (samplesQuery) {
+		// Keep the query valid for frames without shading passes
+		if (!counting)
+			glBeginQuery(GL_SAMPLES_PASSED, samplesQuery);
+		glEndQuery(GL_SAMPLES_PASSED);
+	}
+
+	// Leave the defaults behind for code outside the queue
+	if (pass != RENDER_PASS_OPAQUE)
+		setPassState(RENDER_PASS_OPAQUE);
+	glBindVertexArray(0);
+	glActiveTexture(GL_TEXTURE0);
+}
@@ -0,0 +1,134 @@
+#include <sceneNode.h>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+using namespace std;
+
+namespace {
+	// World updates are counted per thread, so nodes updated in parallel jobs do not fight over one counter
+	struct UpdateCounter {
+		atomic<size_t> count{ 0 };
+	};
+
+	mutex countersMutex;
+	vector<unique_ptr<UpdateCounter>> counters;
+
+	UpdateCounter& threadCounter() {
+		thread_local UpdateCounter* counter = nullptr;
+		if (!counter) {
+			lock_guard<mutex> lock(countersMutex);
+			counters.push_back(make_unique<UpdateCounter>());
+			counter = counters.back().get();
+		}
+		return *counter;
+	}
+}
+
+SceneNode::~SceneNode() {
+	if (parentNode)
+		parentNode->removeChild(this);
+	for (SceneNode* child : childNodes) {
+		child->parentNode = nullptr;
+		child->markDirty();
+	}
+}
+
+void SceneNode::setPosition(const glm::vec3& position) {
+	localPosition = position;
+	updateLocal();
+}
+
+void SceneNode::setRotation(const glm::vec3& degrees) {
+	localRotation = degrees;
+	updateLocal();
+}
+
+void SceneNode::setScale(const glm::vec3& scale) {
+	localScale = scale;
+	updateLocal();
+}
+
+void SceneNode::setLocalMatrix(const glm::mat4& matrix) {
+	base = matrix;
+	local = matrix;
+	localPosition = glm::vec3(0.0f);
+	localRotation = glm::vec3(0.0f);
+	localScale = glm::vec3(1.0f);
+	markDirty();
+}
+
+void SceneNode::updateLocal() {
+	local = glm::translate(base, localPosition);
+	local = glm::rotate(local, glm::radians(localRotation.x), glm::vec3(1, 0, 0));
+	local = glm::rotate(local, glm::radians(localRotation.y), glm::vec3(0, 1, 0));
+	local = glm::rotate(local, glm::radians(localRotation.z), glm::vec3(0, 0, 1));
+	local = glm::scale(local, localScale);
+	markDirty();
+}
+
+void SceneNode::addChild(SceneNode* child) {
+	if (child->parentNode)
+		child->parentNode->removeChild(child);
+	child->parentNode = this;
+	childNodes.push_back(child);
+	child->markDirty();
+}
+
+void SceneNode::removeChild(SceneNode* child) {
+	auto it = find(childNodes.begin(), childNodes.end(), child);
+	if (it == childNodes.end())
+		return;
+	childNodes.erase(it);
+	child->parentNode = nullptr;
+	child->markDirty();
+}
+
+// A dirty node's subtree is always dirty as well, so the walk stops at the first node that already is
+void SceneNode::markDirty() {
+	if (dirty)
+		return;
+	dirty = true;
+	for (SceneNode* child : childNodes)
+		child->markDirty();
+}
+
+void SceneNode::updateWorld() const {
+	world = parentNode ? parentNode->worldMatrix() * local : local;
+	glm::mat3 linear(world);
+	normal = glm::transpose(glm::inverse(linear));
+	worldMaxScale = glm::max(glm::length(linear[0]), glm::max(glm::length(linear[1]), glm::length(linear[2])));
+	dirty = false;
+	UpdateCounter& counter = threadCounter();
+	counter.count.store(counter.count.load(memory_order_relaxed) + 1, memory_order_relaxed);
+}
+
+const glm::mat4& SceneNode::worldMatrix() const {
+	if (dirty)
+		updateWorld();
+	return world;
+}
+
+const glm::mat3& SceneNode::normalMatrix() const {
+	if (dirty)
+		updateWorld();
+	return normal;
+}
+
+float SceneNode::maxScale() const {
+	if (dirty)
+		updateWorld();
+	return worldMaxScale;
+}
+
+size_t SceneNode::WorldUpdates() {
+	lock_guard<mutex> lock(countersMutex);
+	size_t total = 0;
+	for (const auto& counter : counters)
+		total += counter->count.load(memory_order_relaxed);
+	return total;
+}
@@ -0,0 +1,395 @@
+#include <scenePack.h>
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+using namespace std;
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// MappedFile
+// ----------
+MappedFile::~MappedFile() {
+	close();
+}
+
+bool MappedFile::open(const string& path) {
+	close();
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+		CloseHandle(file);
+		return false;
+	}
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (!mapping) {
+		CloseHandle(file);
+		return false;
+	}
+	void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!view) {
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+	fileHandle = file;
+	mappingHandle = mapping;
+	bytes = static_cast<const unsigned char*>(view);
+	length = static_cast<size_t>(fileSize.QuadPart);
+#else
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		::close(fd);
+		return false;
+	}
+	void* view = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);	// The mapping keeps its own reference to the file
+	if (view == MAP_FAILED)
+		return false;
+	bytes = static_cast<const unsigned char*>(view);
+	length = static_cast<size_t>(st.st_size);
+#endif
+	return true;
+}
+
+void MappedFile::close() {
+	if (!bytes)
+		return;
+#ifdef _WIN32
+	UnmapViewOfFile(bytes);
+	CloseHandle(mappingHandle);
+	CloseHandle(fileHandle);
+	mappingHandle = nullptr;
+	fileHandle = nullptr;
+#else
+	munmap(const_cast<unsigned char*>(bytes), length);
+#endif
+	bytes = nullptr;
+	length = 0;
+}
+
+// Hashing
+// -------
+uint64_t HashBytes(const void* data, size_t size, uint64_t seed) {
+	const uint64_t prime = 1099511628211ull;
+	const unsigned char* p = static_cast<const unsigned char*>(data);
+	uint64_t hash = seed;
+
+	size_t words = size / 8;
+	for (size_t i = 0; i < words; i++) {
+		uint64_t word;
+		memcpy(&word, p + i * 8, 8);
+		hash = (hash ^ word) * prime;
+	}
+	for (size_t i = words * 8; i < size; i++)
+		hash = (hash ^ p[i]) * prime;
+
+	return hash;
+}
+
+namespace {
+	// Arguments of every mtllib statement of an OBJ file, one entry per statement with surrounding whitespace trimmed
+	vector<string> objMaterialLibraries(const unsigned char* data, size_t size) {
+		vector<string> libraries;
+		const char* text = reinterpret_cast<const char*>(data);
+		size_t lineStart = 0;
+		while (lineStart < size) {
+			size_t lineEnd = lineStart;
+			while (lineEnd < size && text[lineEnd] != '\n')
+				lineEnd++;
+			string line(text + lineStart, lineEnd - lineStart);
+			lineStart = lineEnd + 1;
+
+			size_t first = line.find_first_not_of(" \t");
+			if (first == string::npos || line.compare(first, 6, "mtllib") != 0)
+				continue;
+			size_t nameStart = line.find_first_not_of(" \t", first + 6);
+			if (nameStart == first + 6 || nameStart == string::npos)
+				continue;
+			size_t nameEnd = line.find_last_not_of(" \t\r");
+			libraries.push_back(line.substr(nameStart, nameEnd - nameStart + 1));
+		}
+		return libraries;
+	}
+
+	uint64_t hashFile(const filesystem::path& path, uint64_t hash, bool& found) {
+		MappedFile file;
+		found = file.open(path.string());
+		return found ? HashBytes(file.data(), file.size(), hash) : hash;
+	}
+}
+
+uint64_t HashModelSource(const string& path) {
+	MappedFile source;
+	if (!source.open(path))
+		return 0;
+	uint64_t hash = HashBytes(source.data(), source.size());
+
+	// The material libraries an OBJ names are part of the source as well. A statement may name one file
+	// with spaces in its name or several files separated by spaces, so the whole argument is tried first.
+	filesystem::path directory = filesystem::path(path).parent_path();
+	for (const string& library : objMaterialLibraries(source.data(), source.size())) {
+		hash = HashBytes(library.data(), library.size(), hash);
+		bool found;
+		hash = hashFile(directory / library, hash, found);
+		if (found)
+			continue;
+		size_t start = 0;
+		while ((start = library.find_first_not_of(" \t", start)) != string::npos) {
+			size_t end = library.find_first_of(" \t", start);
+			string name = library.substr(start, end == string::npos ? string::npos : end - start);
+			hash = hashFile(directory / name, hash, found);
+			start = end;
+		}
+	}
+
+	// Different cook versions must never share a hash
+	return HashBytes(&SCENE_PACK_VERSION, sizeof(SCENE_PACK_VERSION), hash);
+}
+
+// ScenePack
+// ---------
+namespace {
+	bool inRange(size_t fileSize, uint64_t offset, uint64_t bytes) {
+		return offset <= fileSize && bytes <= fileSize - offset;
+	}
+
+	uint64_t align16(uint64_t value) {
+		return (value + 15) & ~uint64_t(15);
+	}
+}
+
+bool ScenePack::open(const string& path, uint64_t expectedSourceHash) {
+	packMeshes.clear();
+	packNodes.clear();
+	if (expectedSourceHash == 0 || !file.open(path))
+		return false;
+
+	const unsigned char* base = file.data();
+	size_t size = file.size();
+
+	PackHeader header;
+	if (size < sizeof(PackHeader))
+		return false;
+	memcpy(&header, base, sizeof(PackHeader));
+	if (header.magic != SCENE_PACK_MAGIC || header.version != SCENE_PACK_VERSION
+		|| header.vertexSize != sizeof(Vertex) || header.sourceHash != expectedSourceHash) {
+		file.close();
+		return false;
+	}
+
+	uint64_t meshTable = sizeof(PackHeader);
+	uint64_t textureTable = meshTable + uint64_t(header.meshCount) * sizeof(PackMeshRecord);
+	uint64_t lodTable = textureTable + uint64_t(header.textureCount) * sizeof(PackTextureRecord);
+	uint64_t nodeTable = lodTable + uint64_t(header.lodCount) * sizeof(PackLodRecord);
+	if (!inRange(size, meshTable, uint64_t(header.meshCount) * sizeof(PackMeshRecord))
+		|| !inRange(size, textureTable, uint64_t(header.textureCount) * sizeof(PackTextureRecord))
+		|| !inRange(size, lodTable, uint64_t(header.lodCount) * sizeof(PackLodRecord))
+		|| !inRange(size, nodeTable, uint64_t(header.nodeCount) * sizeof(PackNodeRecord)) || header.nodeCount == 0) {
+		cout << "ERROR::SCENE_PACK::CORRUPT_TABLES: " << path << endl;
+		file.close();
+		return false;
+	}
+	const PackMeshRecord* meshRecords = reinterpret_cast<const PackMeshRecord*>(base + meshTable);
+	const PackTextureRecord* textureRecords = reinterpret_cast<const PackTextureRecord*>(base + textureTable);
+	const PackLodRecord* lodRecords = reinterpret_cast<const PackLodRecord*>(base + lodTable);
+	const PackNodeRecord* nodeRecords = reinterpret_cast<const PackNodeRecord*>(base + nodeTable);
+
+	auto readString = [&](const PackString& str, string& out) {
+		if (!inRange(size, str.offset, str.length))
+			return false;
+		out.assign(reinterpret_cast<const char*>(base + str.offset), str.length);
+		return true;
+	};
+
+	packNodes.resize(header.nodeCount);
+	for (uint32_t i = 0; i < header.nodeCount; i++) {
+		const PackNodeRecord& record = nodeRecords[i];
+		ModelNode& node = packNodes[i];
+		// Parents come first, so every node's parent is already known
+		if (!readString(record.name, node.name) || record.parent >= static_cast<int32_t>(i) || (record.parent < 0) != (i == 0)) {
+			cout << "ERROR::SCENE_PACK::CORRUPT_NODE: " << path << endl;
+			packNodes.clear();
+			file.close();
+			return false;
+		}
+		node.parent = record.parent;
+		memcpy(&node.transform[0][0], record.transform, sizeof(record.transform));
+	}
+
+	packMeshes.resize(header.meshCount);
+	for (uint32_t i = 0; i < header.meshCount; i++) {
+		const PackMeshRecord& record = meshRecords[i];
+		PackMesh& mesh = packMeshes[i];
+		bool valid = readString(record.name, mesh.name)
+			&& inRange(size, record.vertexOffset, uint64_t(record.vertexCount) * VertexStride(record.vertexLayout))
+			&& (record.indexSize == 2 || record.indexSize == 4)
+			&& inRange(size, record.indexOffset, uint64_t(record.indexCount) * record.indexSize)
+			&& uint64_t(record.textureFirst) + record.textureCount <= header.textureCount
+			&& record.lodCount > 0 && uint64_t(record.lodFirst) + record.lodCount <= header.lodCount
+			&& record.node < header.nodeCount;
+
+		for (uint32_t t = 0; valid && t < record.textureCount; t++) {
+			PackTexture texture;
+			const PackTextureRecord& textureRecord = textureRecords[record.textureFirst + t];
+			valid = readString(textureRecord.type, texture.type) && readString(textureRecord.path, texture.path);
+			mesh.textures.push_back(texture);
+		}
+		for (uint32_t l = 0; valid && l < record.lodCount; l++) {
+			const PackLodRecord& lodRecord = lodRecords[record.lodFirst + l];
+			valid = uint64_t(lodRecord.indexOffset) + lodRecord.indexCount <= record.indexCount;
+			MeshLod lod;
+			lod.indexOffset = lodRecord.indexOffset;
+			lod.indexCount = lodRecord.indexCount;
+			lod.error = lodRecord.error;
+			mesh.lods.push_back(lod);
+		}
+		if (!valid) {
+			cout << "ERROR::SCENE_PACK::CORRUPT_MESH: " << path << endl;
+			packMeshes.clear();
+			packNodes.clear();
+			file.close();
+			return false;
+		}
+
+		// Array data is used in place, straight from the mapping
+		mesh.vertexData = base + record.vertexOffset;
+		mesh.vertexCount = record.vertexCount;
+		mesh.vertexLayout = record.vertexLayout;
+		mesh.indexData = base + record.indexOffset;
+		mesh.indexCount = record.indexCount;
+		mesh.indexSize = record.indexSize;
+		mesh.shaderFeatures = record.shaderFeatures;
+		mesh.node = record.node;
+	}
+
+	cookTimeMs = header.cookMs;
+	return true;
+}
+
+bool ScenePack::write(const string& path, uint64_t sourceHash, double cookMs, const vector<PackMesh>& meshes,
+	const vector<ModelNode>& nodes)
+{
+	// 1. Lay out the tables and string data
+	vector<PackMeshRecord> meshRecords(meshes.size());
+	vector<PackTextureRecord> textureRecords;
+	vector<PackLodRecord> lodRecords;
+	vector<PackNodeRecord> nodeRecords(nodes.size());
+	string strings;
+
+	uint64_t textureCount = 0;
+	uint64_t lodCount = 0;
+	for (const PackMesh& mesh : meshes) {
+		textureCount += mesh.textures.size();
+		lodCount += mesh.lods.size();
+	}
+	uint64_t stringBase = sizeof(PackHeader) + meshes.size() * sizeof(PackMeshRecord) + textureCount * sizeof(PackTextureRecord)
+		+ lodCount * sizeof(PackLodRecord) + nodes.size() * sizeof(PackNodeRecord);
+
+	auto addString = [&](const string& str) {
+		PackString packString = { stringBase + strings.size(), static_cast<uint32_t>(str.size()), 0 };
+		strings += str;
+		return packString;
+	};
+
+	for (size_t i = 0; i < meshes.size(); i++) {
+		meshRecords[i].name = addString(meshes[i].name);
+		meshRecords[i].vertexCount = meshes[i].vertexCount;
+		meshRecords[i].vertexLayout = meshes[i].vertexLayout;
+		meshRecords[i].indexCount = meshes[i].indexCount;
+		meshRecords[i].indexSize = meshes[i].indexSize;
+		meshRecords[i].shaderFeatures = meshes[i].shaderFeatures;
+		meshRecords[i].node = meshes[i].node;
+		meshRecords[i].textureFirst = static_cast<uint32_t>(textureRecords.size());
+		meshRecords[i].textureCount = static_cast<uint32_t>(meshes[i].textures.size());
+		for (const PackTexture& texture : meshes[i].textures)
+			textureRecords.push_back({ addString(texture.type), addString(texture.path) });
+		meshRecords[i].lodFirst = static_cast<uint32_t>(lodRecords.size());
+		meshRecords[i].lodCount = static_cast<uint32_t>(meshes[i].lods.size());
+		for (const MeshLod& lod : meshes[i].lods)
+			lodRecords.push_back({ lod.indexOffset, lod.indexCount, lod.error, 0 });
+	}
+	for (size_t i = 0; i < nodes.size(); i++) {
+		nodeRecords[i].name = addString(nodes[i].name);
+		nodeRecords[i].parent = nodes[i].parent;
+		nodeRecords[i].reserved = 0;
+		memcpy(nodeRecords[i].transform, &nodes[i].transform[0][0], sizeof(nodeRecords[i].transform));
+	}
+
+	// 2. Place the arrays after the string data
+	uint64_t cursor = align16(stringBase + strings.size());
+	for (size_t i = 0; i < meshes.size(); i++) {
+		meshRecords[i].vertexOffset = cursor;
+		cursor = align16(cursor + uint64_t(meshes[i].vertexCount) * VertexStride(meshes[i].vertexLayout));
+		meshRecords[i].indexOffset = cursor;
+		cursor = align16(cursor + uint64_t(meshes[i].indexCount) * meshes[i].indexSize);
+	}
+
+	// 3. Write everything. Written to a temporary file first so a crash never leaves a half-written pack behind.
+	string tempPath = path + ".tmp";
+	ofstream out(tempPath, ios::binary | ios::trunc);
+	if (!out) {
+		cout << "ERROR::SCENE_PACK::FAILED_TO_WRITE: " << path << endl;
+		return false;
+	}
+
+	PackHeader header = {};
+	header.magic = SCENE_PACK_MAGIC;
+	header.version = SCENE_PACK_VERSION;
+	header.sourceHash = sourceHash;
+	header.vertexSize = sizeof(Vertex);
+	header.meshCount = static_cast<uint32_t>(meshes.size());
+	header.textureCount = static_cast<uint32_t>(textureRecords.size());
+	header.lodCount = static_cast<uint32_t>(lodRecords.size());
+	header.nodeCount = static_cast<uint32_t>(nodeRecords.size());
+	header.cookMs = cookMs;
+
+	auto padTo = [&](uint64_t offset) {
+		static const char zeros[16] = {};
+		uint64_t position = static_cast<uint64_t>(out.tellp());
+		if (offset > position)
+			out.write(zeros, static_cast<streamsize>(offset - position));
+	};
+
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	out.write(reinterpret_cast<const char*>(meshRecords.data()), meshRecords.size() * sizeof(PackMeshRecord));
+	out.write(reinterpret_cast<const char*>(textureRecords.data()), textureRecords.size() * sizeof(PackTextureRecord));
+	out.write(reinterpret_cast<const char*>(lodRecords.data()), lodRecords.size() * sizeof(PackLodRecord));
+	out.write(reinterpret_cast<const char*>(nodeRecords.data()), nodeRecords.size() * sizeof(PackNodeRecord));
+	out.write(strings.data(), strings.size());
+	for (size_t i = 0; i < meshes.size(); i++) {
+		padTo(meshRecords[i].vertexOffset);
+		out.write(reinterpret_cast<const char*>(meshes[i].vertexData), uint64_t(meshes[i].vertexCount) * VertexStride(meshes[i].vertexLayout));
+		padTo(meshRecords[i].indexOffset);
+		out.write(reinterpret_cast<const char*>(meshes[i].indexData), uint64_t(meshes[i].indexCount) * meshes[i].indexSize);
+	}
+	out.close();
+	if (!out) {
+		cout << "ERROR::SCENE_PACK::FAILED_TO_WRITE: " << path << endl;
+		return false;
+	}
+
+	error_code ec;
+	filesystem::rename(tempPath, path, ec);
+	if (ec) {
+		cout << "ERROR::SCENE_PACK::FAILED_TO_WRITE: " << path << " (" << ec.message() << ")" << endl;
+		return false;
+	}
+	return true;
+}
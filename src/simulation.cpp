@@ -0,0 +1,176 @@
+#include <simulation.h>
+#include <profiler.h>
+
+#include <algorithm>
+#include <cmath>
+using namespace std;
+
+namespace {
+	bool simulationThread = false;
+	SimulationStats simulationStats;
+
+	// Interpolate angles in degrees the short way round
+	float lerpDegrees(float from, float to, float t) {
+		float delta = fmod(to - from + 540.0f, 360.0f) - 180.0f;
+		return from + delta * t;
+	}
+}
+
+void SetSimulationThread(bool enabled) {
+	simulationThread = enabled;
+}
+
+bool SimulationThreadEnabled() {
+	return simulationThread;
+}
+
+const SimulationStats& GetSimulationStats() {
+	return simulationStats;
+}
+
+Simulation::Simulation(const Camera& camera, const BlimpPath (&blimps)[SIMULATION_BLIMPS], float tickSeconds,
+	function<void(Camera&, float)> cameraScript)
+	: camera(camera), tickSeconds(tickSeconds), cameraScript(std::move(cameraScript))
+{
+	copy(begin(blimps), end(blimps), begin(this->blimps));
+	capture(current);
+	previous = current;
+	snapshots.back() = current;
+}
+
+Simulation::~Simulation() {
+	stop();
+}
+
+void Simulation::start() {
+	if (running)
+		return;
+	running = true;
+	simulationStats.threaded = true;
+	worker = thread([this] { run(); });
+}
+
+void Simulation::stop() {
+	running = false;
+	if (worker.joinable())
+		worker.join();
+}
+
+void Simulation::setMovement(bool forward, bool backward, bool left, bool right) {
+	lock_guard<mutex> lock(inputMutex);
+	input.forward = forward;
+	input.backward = backward;
+	input.left = left;
+	input.right = right;
+}
+
+void Simulation::addLook(float xoffset, float yoffset) {
+	lock_guard<mutex> lock(inputMutex);
+	input.lookX += xoffset;
+	input.lookY += yoffset;
+}
+
+void Simulation::addZoom(float yoffset) {
+	lock_guard<mutex> lock(inputMutex);
+	input.zoom += yoffset;
+}
+
+void Simulation::run() {
+	SetProfilerThreadName("Simulation");
+	auto tickDuration = chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(tickSeconds));
+	auto next = chrono::steady_clock::now();
+	while (running.load(memory_order_acquire)) {
+		this_thread::sleep_until(next);
+
+		auto start = chrono::steady_clock::now();
+		step();
+		simulationStats.tickMs += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+		simulationStats.ticks++;
+
+		// Catch up on missed ticks, unless so many were missed that the simulation would never get back in step
+		next += tickDuration;
+		auto now = chrono::steady_clock::now();
+		if (now - next > tickDuration * SIMULATION_MAX_CATCH_UP) {
+			next = now;
+			simulationStats.skips++;
+		}
+	}
+}
+
+void Simulation::step() {
+	PROFILE_ZONE("Simulation::step");
+	Input frameInput;
+	{
+		lock_guard<mutex> lock(inputMutex);
+		frameInput = input;
+		input.lookX = input.lookY = input.zoom = 0.0f;
+	}
+
+	tick++;
+	if (cameraScript) {
+		cameraScript(camera, tick * tickSeconds);
+	}
+	else {
+		if (frameInput.forward)
+			camera.ProcessKeyboard(FORWARD, tickSeconds);
+		if (frameInput.backward)
+			camera.ProcessKeyboard(BACKWARD, tickSeconds);
+		if (frameInput.left)
+			camera.ProcessKeyboard(LEFT, tickSeconds);
+		if (frameInput.right)
+			camera.ProcessKeyboard(RIGHT, tickSeconds);
+		if (frameInput.lookX != 0.0f || frameInput.lookY != 0.0f)
+			camera.ProcessMouseMovement(frameInput.lookX, frameInput.lookY);
+		if (frameInput.zoom != 0.0f)
+			camera.ProcessMouseScroll(frameInput.zoom);
+	}
+	for (BlimpPath& blimp : blimps)
+		blimp.advance(tickSeconds);
+
+	SimSnapshot& snapshot = snapshots.back();
+	capture(snapshot);
+	snapshots.publish();
+}
+
+void Simulation::capture(SimSnapshot& snapshot) const {
+	snapshot.tick = tick;
+	snapshot.published = chrono::steady_clock::now();
+	snapshot.cameraPosition = camera.Position;
+	snapshot.cameraYaw = camera.Yaw;
+	snapshot.cameraPitch = camera.Pitch;
+	snapshot.cameraZoom = camera.Zoom;
+	for (int i = 0; i < SIMULATION_BLIMPS; i++) {
+		snapshot.blimpPositions[i] = blimps[i].position();
+		snapshot.blimpYaws[i] = blimps[i].yaw();
+	}
+}
+
+SimSnapshot Simulation::sample() {
+	if (snapshots.update()) {
+		previous = current;
+		current = snapshots.front();
+	}
+	else {
+		simulationStats.staleFrames++;
+	}
+
+	// How far into the tick after 'current' we are, rendered as the same fraction between 'previous' and 'current'
+	float t = 1.0f;
+	if (current.tick > previous.tick) {
+		double sinceCurrent = chrono::duration<double>(chrono::steady_clock::now() - current.published).count();
+		double ticks = static_cast<double>(current.tick - previous.tick);
+		t = static_cast<float>(glm::clamp(sinceCurrent / (tickSeconds * ticks), 0.0, 1.0));
+	}
+
+	SimSnapshot state = current;
+	state.cameraPosition = glm::mix(previous.cameraPosition, current.cameraPosition, t);
+	// The camera yaw accumulates without wrapping, the scripted one comes from atan2 and wraps
+	state.cameraYaw = cameraScript ? lerpDegrees(previous.cameraYaw, current.cameraYaw, t) : glm::mix(previous.cameraYaw, current.cameraYaw, t);
+	state.cameraPitch = glm::mix(previous.cameraPitch, current.cameraPitch, t);
+	state.cameraZoom = glm::mix(previous.cameraZoom, current.cameraZoom, t);
+	for (int i = 0; i < SIMULATION_BLIMPS; i++) {
+		state.blimpPositions[i] = glm::mix(previous.blimpPositions[i], current.blimpPositions[i], t);
+		state.blimpYaws[i] = lerpDegrees(previous.blimpYaws[i], current.blimpYaws[i], t);
+	}
+	return state;
+}
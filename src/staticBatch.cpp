@@ -0,0 +1,320 @@
+#include <staticBatch.h>
+#include <model.h>
+#include <profiler.h>
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <tuple>
+#include <utility>
+using namespace std;
+
+namespace {
+	bool staticBatching = true;
+
+	// A mesh with its transform applied, before it is merged into a group
+	struct BakedMesh {
+		vector<Vertex> vertices;
+		vector<unsigned int> indices;		// All LODs
+		vector<MeshLod> lods;
+		glm::u8vec4 layers = glm::u8vec4(0);	// Texture array layers of the diffuse, specular and normal map
+	};
+
+	// Material of a mesh drawn from texture arrays: the arrays on the units of the sampled textures and the layer
+	// of each. Returns false if the mesh has no diffuse texture or one of its textures is not in an array.
+	bool arrayMaterial(const Mesh& mesh, const TextureArrays& arrays, uint32_t& materialId, glm::u8vec4& layers) {
+		static const char* const types[3] = { "texture_diffuse", "texture_specular", "texture_normal" };
+		vector<TextureBinding> bindings;
+		for (int type = 0; type < 3; type++) {
+			// Only the first texture of every type is sampled (texture_diffuse1, ...)
+			for (const Texture& texture : mesh.textures) {
+				if (texture.type != types[type])
+					continue;
+				TextureArraySlot slot;
+				if (!arrays.find(texture.id, slot))
+					return false;
+				bindings.push_back({ static_cast<GLuint>(Shader::MaterialSamplerUnit(texture.type + "1")), slot.array, GL_TEXTURE_2D_ARRAY });
+				layers[type] = static_cast<uint8_t>(slot.layer);
+				break;
+			}
+			if (type == 0 && bindings.empty())
+				return false;
+		}
+		materialId = InternMaterial(bindings);
+		return true;
+	}
+
+	void appendBytes(vector<unsigned char>& out, const vector<unsigned char>& bytes) {
+		out.insert(out.end(), bytes.begin(), bytes.end());
+	}
+}
+
+void SetStaticBatching(bool enabled) {
+	staticBatching = enabled;
+}
+
+bool StaticBatchingEnabled() {
+	return staticBatching;
+}
+
+StaticBatch::~StaticBatch() {
+	release();
+}
+
+void StaticBatch::release() {
+	for (Buffer& buffer : buffers) {
+		glDeleteVertexArrays(1, &buffer.VAO);
+		glDeleteBuffers(1, &buffer.VBO);
+		glDeleteBuffers(1, &buffer.EBO);
+		glDeleteVertexArrays(1, &buffer.depthVAO);
+		glDeleteBuffers(1, &buffer.positionVBO);
+		glDeleteBuffers(1, &buffer.layerVBO);
+	}
+	buffers.clear();
+	textureArrays.release();
+	groups.clear();
+	bvh = Bvh();
+	bvhParts.clear();
+}
+
+void StaticBatch::build(const vector<const Model*>& models) {
+	PROFILE_ZONE("StaticBatch::build");
+	release();
+
+	if (TextureArraysEnabled()) {
+		vector<GLuint> textures;
+		for (const Model* model : models) {
+			for (const Mesh& mesh : model->asset->meshes) {
+				for (const Texture& texture : mesh.textures)
+					textures.push_back(texture.id);
+			}
+		}
+		textureArrays.build(textures);
+	}
+
+	// 1. Bake the transforms into the vertices and sort the meshes by vertex layout, material, shader features
+	// and pre-pass
+	map<tuple<uint32_t, uint32_t, uint32_t, bool>, vector<BakedMesh>> sorted;
+	for (const Model* model : models) {
+		bool depthPrepass = model->depthPrepass;
+		for (size_t i = 0; i < model->asset->meshes.size(); i++) {
+			const Mesh& mesh = model->asset->meshes[i];
+			const glm::mat4& transform = model->meshTransform(i);
+			glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(transform)));
+
+			vector<unsigned char> vertexData;
+			BakedMesh baked;
+			mesh.readBack(vertexData, baked.indices);
+			baked.vertices = UnpackVertices(vertexData.data(), vertexData.size() / VertexStride(mesh.layout), mesh.layout);
+			baked.lods = mesh.lods;
+
+			for (Vertex& vertex : baked.vertices) {
+				vertex.Position = glm::vec3(transform * glm::vec4(vertex.Position, 1.0f));
+				vertex.Normal = glm::normalize(normalMatrix * vertex.Normal);
+				vertex.Tangent = glm::mat3(transform) * vertex.Tangent;
+				vertex.Bitangent = glm::mat3(transform) * vertex.Bitangent;
+			}
+			bool prepass = depthPrepass && !(mesh.shaderFeatures & SHADER_FEATURE_ALPHA_TEST);
+			uint32_t materialId = mesh.materialId;
+			uint32_t shaderFeatures = mesh.shaderFeatures;
+			if (textureArrays.size() > 0 && arrayMaterial(mesh, textureArrays, materialId, baked.layers))
+				shaderFeatures |= SHADER_FEATURE_TEXTURE_ARRAY;
+			sorted[make_tuple(mesh.layout, materialId, shaderFeatures, prepass)].push_back(std::move(baked));
+		}
+	}
+
+	// 2. Merge every layout into one buffer, with one vertex/index range per material group
+	for (auto it = sorted.begin(); it != sorted.end();) {
+		uint32_t layout = get<0>(it->first);
+		Buffer buffer;
+		buffer.layout = layout;
+		size_t bufferIndex = buffers.size();
+		vector<unsigned char> vertexBytes, indexBytes;
+		vector<glm::vec3> positions;
+		vector<glm::u8vec4> layers;
+		bool bufferPrepass = false;
+		bool bufferLayers = false;
+		size_t bufferVertices = 0;
+
+		for (; it != sorted.end() && get<0>(it->first) == layout; ++it) {
+			Group group;
+			group.buffer = bufferIndex;
+			group.materialId = get<1>(it->first);
+			group.shaderFeatures = get<2>(it->first);
+			group.depthPrepass = get<3>(it->first);
+			bufferPrepass = bufferPrepass || group.depthPrepass;
+			bufferLayers = bufferLayers || (group.shaderFeatures & SHADER_FEATURE_TEXTURE_ARRAY);
+			group.baseVertex = static_cast<GLint>(bufferVertices);
+
+			size_t groupVertices = 0;
+			for (const BakedMesh& baked : it->second)
+				groupVertices += baked.vertices.size();
+			size_t indexSize = IndexSize(groupVertices);
+			group.indexType = indexSize == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+
+			// Index ranges are 4-byte aligned so 16 and 32-bit groups can share the buffer
+			indexBytes.resize((indexBytes.size() + 3) & ~size_t(3), 0);
+			group.indexByteOffset = indexBytes.size();
+
+			vector<unsigned int> groupIndices;
+			size_t partVertexOffset = 0;
+			for (const BakedMesh& baked : it->second) {
+				Part part;
+				part.lods = baked.lods;
+				for (MeshLod& lod : part.lods)
+					lod.indexOffset += static_cast<uint32_t>(groupIndices.size());
+				for (unsigned int index : baked.indices)
+					groupIndices.push_back(static_cast<unsigned int>(index + partVertexOffset));
+
+				// World space bounding sphere
+				glm::vec3 minimum(0.0f), maximum(0.0f);
+				for (size_t v = 0; v < baked.vertices.size(); v++) {
+					minimum = v ? glm::min(minimum, baked.vertices[v].Position) : baked.vertices[v].Position;
+					maximum = v ? glm::max(maximum, baked.vertices[v].Position) : baked.vertices[v].Position;
+				}
+				part.bounds.min = minimum;
+				part.bounds.max = maximum;
+				part.boundsCenter = (minimum + maximum) * 0.5f;
+				part.boundsRadius = 0.0f;
+				for (const Vertex& vertex : baked.vertices)
+					part.boundsRadius = glm::max(part.boundsRadius, glm::length(vertex.Position - part.boundsCenter));
+
+				appendBytes(vertexBytes, PackVertices(baked.vertices.data(), baked.vertices.size(), layout));
+				for (const Vertex& vertex : baked.vertices)
+					positions.push_back(vertex.Position);
+				layers.insert(layers.end(), baked.vertices.size(), baked.layers);
+				partVertexOffset += baked.vertices.size();
+				group.parts.push_back(std::move(part));
+			}
+			appendBytes(indexBytes, PackIndices(groupIndices.data(), groupIndices.size(), indexSize));
+
+			bufferVertices += groupVertices;
+			groups.push_back(std::move(group));
+		}
+
+		// Upload the merged buffer
+		glGenVertexArrays(1, &buffer.VAO);
+		glGenBuffers(1, &buffer.VBO);
+		glGenBuffers(1, &buffer.EBO);
+		glBindVertexArray(buffer.VAO);
+		glBindBuffer(GL_ARRAY_BUFFER, buffer.VBO);
+		glBufferData(GL_ARRAY_BUFFER, vertexBytes.size(), vertexBytes.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer.EBO);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytes.size(), indexBytes.data(), GL_STATIC_DRAW);
+		SetupVertexAttributes(layout);
+		if (bufferLayers) {
+			glGenBuffers(1, &buffer.layerVBO);
+			glBindBuffer(GL_ARRAY_BUFFER, buffer.layerVBO);
+			glBufferData(GL_ARRAY_BUFFER, layers.size() * sizeof(glm::u8vec4), layers.data(), GL_STATIC_DRAW);
+			glEnableVertexAttribArray(TEXTURE_LAYER_ATTRIBUTE);
+			glVertexAttribPointer(TEXTURE_LAYER_ATTRIBUTE, 3, GL_UNSIGNED_BYTE, GL_FALSE, sizeof(glm::u8vec4), (void*)0);
+		}
+		glBindVertexArray(0);
+		RecordMeshUpload(bufferVertices, layout, indexBytes.size());
+
+		// Position-only stream for the depth pre-pass, sharing the index buffer. Every layout stores the
+		// position as 3 floats, so both streams give bit-identical positions.
+		if (bufferPrepass) {
+			glGenVertexArrays(1, &buffer.depthVAO);
+			glGenBuffers(1, &buffer.positionVBO);
+			glBindVertexArray(buffer.depthVAO);
+			glBindBuffer(GL_ARRAY_BUFFER, buffer.positionVBO);
+			glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(glm::vec3), positions.data(), GL_STATIC_DRAW);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer.EBO);
+			glEnableVertexAttribArray(0);
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+			glBindVertexArray(0);
+		}
+
+		buffers.push_back(buffer);
+	}
+
+	// 3. Index the parts for culling
+	vector<Aabb> boxes;
+	for (uint32_t g = 0; g < groups.size(); g++) {
+		for (uint32_t p = 0; p < groups[g].parts.size(); p++) {
+			boxes.push_back(groups[g].parts[p].bounds);
+			bvhParts.push_back({ g, p });
+		}
+	}
+	bvh.build(boxes);
+	size_t parts = boxes.size();
+	cout << "Static batch: " << parts << " meshes of " << models.size() << " models merged into " << groups.size()
+		<< " material groups in " << buffers.size() << " buffers" << endl;
+}
+
+void StaticBatch::compileShaders(ShaderVariants& shaders, uint32_t shaderFeatureMask) const {
+	for (const Group& group : groups)
+		shaders.get(group.shaderFeatures & shaderFeatureMask);
+}
+
+void StaticBatch::submit(RenderQueue& queue, ShaderVariants& shaders, const FrameInfo& frame, RenderStats& stats, uint32_t objectOffset) {
+	// Find the parts in the frustum, then drop those behind the occluders
+	visibleItems.clear();
+	if (frame.frustumCulling) {
+		bvh.query(frame.frustum, stats.culling, [&](uint32_t item) { visibleItems.push_back(item); });
+	}
+	else {
+		for (uint32_t item = 0; item < bvhParts.size(); item++)
+			visibleItems.push_back(item);
+		stats.culling.drawn += bvhParts.size();
+	}
+	visibleFlags.assign(visibleItems.size(), 1);
+	if (frame.occlusion) {
+		visibleBoxes.resize(visibleItems.size());
+		for (size_t i = 0; i < visibleItems.size(); i++)
+			visibleBoxes[i] = partOf(visibleItems[i]).bounds;
+		size_t occluded = frame.occlusion->cull(visibleBoxes.data(), visibleBoxes.size(), visibleFlags.data());
+		stats.culling.occluded += occluded;
+		stats.culling.drawn -= occluded;
+	}
+
+	// Mark the survivors
+	frameCounter++;
+	for (size_t i = 0; i < visibleItems.size(); i++) {
+		if (visibleFlags[i])
+			partOf(visibleItems[i]).visibleFrame = frameCounter;
+	}
+
+	for (Group& group : groups) {
+		size_t indexSize = group.indexType == GL_UNSIGNED_SHORT ? 2 : 4;
+		counts.clear();
+		offsets.clear();
+		float nearest = frame.farPlane;
+
+		for (Part& part : group.parts) {
+			if (part.visibleFrame != frameCounter)
+				continue;
+			float centerDistance = glm::length(part.boundsCenter - frame.viewPos);
+			float distance = glm::max(centerDistance - part.boundsRadius, 0.1f);
+			part.currentLod = SelectLod(part.lods, frame.pixelsPerUnit(distance), frame.lodPixelError, part.currentLod);
+			nearest = glm::min(nearest, centerDistance);
+
+			const MeshLod& lod = part.lods[part.currentLod];
+			counts.push_back(static_cast<GLsizei>(lod.indexCount));
+			offsets.push_back(group.indexByteOffset + size_t(lod.indexOffset) * indexSize);
+			stats.trianglesSubmitted += lod.indexCount / 3;
+			stats.trianglesAvailable += part.lods[0].indexCount / 3;
+		}
+
+		DrawItem item;
+		item.program = shaders.get(group.shaderFeatures & frame.shaderFeatureMask).ID;
+		item.materialId = group.materialId;
+		item.vao = buffers[group.buffer].VAO;
+		item.indexType = group.indexType;
+		item.indexCount = 0;
+		item.indexOffset = 0;
+		item.objectOffset = objectOffset;
+		item.baseVertex = group.baseVertex;
+		if (group.depthPrepass && frame.depthShader) {
+			DrawItem depthItem = item;
+			depthItem.program = frame.depthShader->ID;
+			depthItem.materialId = EmptyMaterial();
+			depthItem.vao = buffers[group.buffer].depthVAO;
+			depthItem.pass = RENDER_PASS_DEPTH;
+			queue.submitMultiDraw(depthItem, counts.data(), offsets.data(), static_cast<GLsizei>(counts.size()), nearest, frame.farPlane);
+			item.pass = RENDER_PASS_DEPTH_EQUAL;
+		}
+		queue.submitMultiDraw(item, counts.data(), offsets.data(), static_cast<GLsizei>(counts.size()), nearest, frame.farPlane);
+	}
+}
@@ -0,0 +1,169 @@
+#include <streamBuffer.h>
+
+#include <algorithm>
+#include <chrono>
+using namespace std;
+
+namespace {
+	bool persistentMappingEnabled = true;
+	StreamBufferStats streamStats;
+
+	const GLbitfield PERSISTENT_FLAGS = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+}
+
+void SetPersistentMapping(bool enabled) {
+	persistentMappingEnabled = enabled;
+}
+
+bool PersistentMappingEnabled() {
+	return persistentMappingEnabled;
+}
+
+bool PersistentMappingSupported() {
+	return GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+}
+
+const StreamBufferStats& GetStreamBufferStats() {
+	return streamStats;
+}
+
+StreamBuffer::StreamBuffer(GLenum target, size_t segmentSize, size_t alignment)
+	: target(target), alignment(max(alignment, size_t(1)))
+{
+	create(max(segmentSize, this->alignment));
+	map(true);
+}
+
+StreamBuffer::~StreamBuffer() {
+	unmap();
+	if (persistentBase) {
+		glBindBuffer(target, id);
+		glUnmapBuffer(target);
+		glBindBuffer(target, 0);
+	}
+	deleteFences();
+	glDeleteBuffers(1, &id);
+}
+
+void StreamBuffer::create(size_t newSegmentSize) {
+	segmentSize = (newSegmentSize + alignment - 1) / alignment * alignment;
+	size_t totalSize = segmentSize * STREAM_BUFFER_FRAMES;
+
+	glGenBuffers(1, &id);
+	glBindBuffer(target, id);
+	persistentMapping = PersistentMappingEnabled() && PersistentMappingSupported();
+	if (persistentMapping) {
+		glBufferStorage(target, totalSize, nullptr, PERSISTENT_FLAGS);
+		persistentBase = static_cast<unsigned char*>(glMapBufferRange(target, 0, totalSize, PERSISTENT_FLAGS));
+		if (!persistentBase) {
+			// Immutable storage cannot be respecified: start over with a mutable buffer
+			glBindBuffer(target, 0);
+			glDeleteBuffers(1, &id);
+			glGenBuffers(1, &id);
+			glBindBuffer(target, id);
+			persistentMapping = false;
+		}
+	}
+	if (!persistentMapping)
+		glBufferData(target, totalSize, nullptr, GL_STREAM_DRAW);
+	glBindBuffer(target, 0);
+	streamStats.persistent = streamStats.persistent || persistentMapping;
+}
+
+void StreamBuffer::map(bool invalidate) {
+	if (persistentMapping) {
+		mapped = persistentBase + segmentOffset();
+		return;
+	}
+	GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | (invalidate ? GL_MAP_INVALIDATE_RANGE_BIT : 0);
+	glBindBuffer(target, id);
+	mapped = static_cast<unsigned char*>(glMapBufferRange(target, segmentOffset(), segmentSize, access));
+	glBindBuffer(target, 0);
+}
+
+void StreamBuffer::unmap() {
+	if (persistentMapping || !mapped)
+		return;
+	glBindBuffer(target, id);
+	glUnmapBuffer(target);
+	glBindBuffer(target, 0);
+	mapped = nullptr;
+}
+
+void StreamBuffer::deleteFences() {
+	for (GLsync& fence : fences) {
+		if (fence)
+			glDeleteSync(fence);
+		fence = nullptr;
+	}
+}
+
+void StreamBuffer::beginFrame() {
+	// Everything that reads the current segment has been issued by now
+	unmap();
+	if (fences[segment])
+		glDeleteSync(fences[segment]);
+	fences[segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	segment = (segment + 1) % STREAM_BUFFER_FRAMES;
+	used = 0;
+	if (GLsync fence = fences[segment]) {
+		GLenum status = glClientWaitSync(fence, 0, 0);
+		if (status == GL_TIMEOUT_EXPIRED) {
+			auto start = chrono::steady_clock::now();
+			do {
+				status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+			} while (status == GL_TIMEOUT_EXPIRED);
+			streamStats.fenceWaits++;
+			streamStats.fenceWaitMs += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+		}
+		glDeleteSync(fence);
+		fences[segment] = nullptr;
+	}
+	map(true);
+}
+
+void* StreamBuffer::allocate(size_t size, size_t alignment, size_t& offset) {
+	size_t start = (used + alignment - 1) / alignment * alignment;
+	if (start + size > segmentSize)
+		grow(start + size);
+	if (!mapped)
+		map(false);		// Written to again after flush()
+
+	offset = start;
+	used = start + size;
+	streamStats.bytesWritten += size;
+	return mapped + start;
+}
+
+void StreamBuffer::flush() {
+	// Coherent persistent writes are visible to the GPU as they are made
+	unmap();
+}
+
+void StreamBuffer::grow(size_t required) {
+	GLuint old = id;
+	size_t oldOffset = segmentOffset();
+	unmap();
+	if (persistentBase) {
+		glBindBuffer(target, old);
+		glUnmapBuffer(target);
+		glBindBuffer(target, 0);
+		persistentBase = nullptr;
+	}
+	mapped = nullptr;
+	// The old buffer is only freed by GL once the GPU is done with it, and nothing has used the new one yet
+	deleteFences();
+
+	create(max(required, segmentSize * 2));
+	if (used > 0) {
+		glBindBuffer(GL_COPY_READ_BUFFER, old);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, id);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, oldOffset, segmentOffset(), used);
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+	glDeleteBuffers(1, &old);
+	map(false);
+	streamStats.grows++;
+}
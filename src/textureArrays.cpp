@@ -0,0 +1,249 @@
+#include <textureArrays.h>
+#include <jobSystem.h>
+#include <textureCache.h>
+#include <profiler.h>
+#include <textureLoader.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <tuple>
+using namespace std;
+
+namespace {
+	bool textureArrays = true;
+	TextureArrayStats arrayStats;
+
+	// A source texture read back from the GPU, then scaled to its bucket and cooked on a worker
+	struct PackedTexture {
+		GLuint source = 0;
+		int width = 0, height = 0;		// Source size
+		int components = 0;
+		bool srgb = false;
+		vector<unsigned char> pixels;
+		int bucketWidth = 0, bucketHeight = 0;
+		CookedTexture cooked;
+	};
+
+	int bucketSize(int size) {
+		int bucket = 4;		// One compression block
+		while (bucket < size && bucket < TEXTURE_ARRAY_MAX_SIZE)
+			bucket *= 2;
+		return bucket;
+	}
+
+	bool isSrgb(GLint internalFormat) {
+		switch (internalFormat) {
+		case GL_SRGB8: case GL_SRGB8_ALPHA8:
+		case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT: case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	// Bilinear scaling with wrapped edges, matching how the texture is sampled with GL_REPEAT
+	vector<unsigned char> resample(const unsigned char* pixels, int width, int height, int components, int newWidth, int newHeight) {
+		vector<unsigned char> result(size_t(newWidth) * newHeight * components);
+		for (int y = 0; y < newHeight; y++) {
+			float sourceY = (y + 0.5f) * height / newHeight - 0.5f;
+			int y0 = static_cast<int>(floor(sourceY));
+			float fy = sourceY - y0;
+			int rows[2] = { (y0 % height + height) % height, ((y0 + 1) % height + height) % height };
+			for (int x = 0; x < newWidth; x++) {
+				float sourceX = (x + 0.5f) * width / newWidth - 0.5f;
+				int x0 = static_cast<int>(floor(sourceX));
+				float fx = sourceX - x0;
+				int columns[2] = { (x0 % width + width) % width, ((x0 + 1) % width + width) % width };
+				for (int c = 0; c < components; c++) {
+					auto texel = [&](int row, int column) { return float(pixels[(size_t(rows[row]) * width + columns[column]) * components + c]); };
+					float top = texel(0, 0) + (texel(0, 1) - texel(0, 0)) * fx;
+					float bottom = texel(1, 0) + (texel(1, 1) - texel(1, 0)) * fx;
+					result[(size_t(y) * newWidth + x) * components + c] = static_cast<unsigned char>(min(255.0f, max(0.0f, top + (bottom - top) * fy + 0.5f)));
+				}
+			}
+		}
+		return result;
+	}
+
+	// Bytes of a full mip chain in a cooked format
+	size_t chainBytes(CookedFormat format, int width, int height) {
+		size_t bytes = 0;
+		for (;;) {
+			switch (format) {
+			case CookedFormat::BC1: bytes += size_t((width + 3) / 4) * ((height + 3) / 4) * 8; break;
+			case CookedFormat::BC3: bytes += size_t((width + 3) / 4) * ((height + 3) / 4) * 16; break;
+			case CookedFormat::R8: bytes += size_t(width) * height; break;
+			case CookedFormat::RGB8: bytes += size_t(width) * height * 3; break;
+			case CookedFormat::RGBA8: bytes += size_t(width) * height * 4; break;
+			}
+			if (width == 1 && height == 1)
+				break;
+			width = max(1, width / 2);
+			height = max(1, height / 2);
+		}
+		return bytes;
+	}
+
+	// Read level 0 of a 2D texture as 8-bit R, RGB or RGBA. Compressed textures are decompressed by the driver.
+	bool readBack(PackedTexture& texture) {
+		GLint width = 0, height = 0, internalFormat = 0, greenSize = 0, alphaSize = 0;
+		glBindTexture(GL_TEXTURE_2D, texture.source);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &internalFormat);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_GREEN_SIZE, &greenSize);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_ALPHA_SIZE, &alphaSize);
+		if (width <= 0 || height <= 0)
+			return false;
+
+		texture.width = width;
+		texture.height = height;
+		texture.components = greenSize == 0 ? 1 : alphaSize > 0 ? 4 : 3;
+		texture.srgb = isSrgb(internalFormat);
+		GLenum format = texture.components == 1 ? GL_RED : texture.components == 3 ? GL_RGB : GL_RGBA;
+		texture.pixels.resize(size_t(width) * height * texture.components);
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glGetTexImage(GL_TEXTURE_2D, 0, format, GL_UNSIGNED_BYTE, texture.pixels.data());
+		glPixelStorei(GL_PACK_ALIGNMENT, 4);
+		return true;
+	}
+
+	void setArraySamplerParameters(GLint maxLevel) {
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, maxLevel);
+	}
+}
+
+void SetTextureArrays(bool enabled) {
+	textureArrays = enabled;
+}
+
+bool TextureArraysEnabled() {
+	return textureArrays;
+}
+
+const TextureArrayStats& GetTextureArrayStats() {
+	return arrayStats;
+}
+
+TextureArrays::~TextureArrays() {
+	release();
+}
+
+void TextureArrays::release() {
+	if (!arrays.empty())
+		glDeleteTextures(static_cast<GLsizei>(arrays.size()), arrays.data());
+	arrays.clear();
+	slots.clear();
+}
+
+bool TextureArrays::find(GLuint texture, TextureArraySlot& slot) const {
+	auto it = slots.find(texture);
+	if (it == slots.end())
+		return false;
+	slot = it->second;
+	return true;
+}
+
+void TextureArrays::build(const vector<GLuint>& textures) {
+	PROFILE_ZONE("TextureArrays::build");
+	release();
+	auto start = chrono::steady_clock::now();
+
+	// 1. Read the sources back on the GL thread
+	vector<GLuint> sources(textures);
+	sort(sources.begin(), sources.end());
+	sources.erase(unique(sources.begin(), sources.end()), sources.end());
+	vector<PackedTexture> packed;
+	for (GLuint source : sources) {
+		PackedTexture texture;
+		texture.source = source;
+		if (source != 0 && glIsTexture(source) && readBack(texture))
+			packed.push_back(std::move(texture));
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+	if (packed.empty())
+		return;
+
+	// 2. Scale to the buckets and cook on the workers
+	bool s3tc = GLEW_EXT_texture_compression_s3tc;
+	bool s3tcSrgb = s3tc && GLEW_EXT_texture_sRGB;
+	JobSystem& jobs = JobSystem::shared();
+	JobCounter cooked;
+	for (PackedTexture& texture : packed) {
+		bool compress = texture.srgb ? s3tcSrgb : s3tc;
+		jobs.run([&texture, compress] {
+			texture.bucketWidth = bucketSize(texture.width);
+			texture.bucketHeight = bucketSize(texture.height);
+			if (texture.bucketWidth != texture.width || texture.bucketHeight != texture.height)
+				texture.pixels = resample(texture.pixels.data(), texture.width, texture.height, texture.components, texture.bucketWidth, texture.bucketHeight);
+			texture.cooked = CookTexture(texture.pixels.data(), texture.bucketWidth, texture.bucketHeight, texture.components, compress, texture.srgb);
+			texture.pixels.clear();
+			texture.pixels.shrink_to_fit();
+		}, &cooked);
+	}
+	jobs.wait(cooked);
+
+	// 3. Group by bucket, format and colour space; full arrays are split
+	GLint maxLayers = 0;
+	glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+	size_t layersPerArray = min(size_t(TEXTURE_ARRAY_MAX_LAYERS), size_t(max(maxLayers, 1)));
+	map<tuple<int, int, CookedFormat, bool>, vector<const PackedTexture*>> buckets;
+	for (const PackedTexture& texture : packed)
+		buckets[make_tuple(texture.bucketWidth, texture.bucketHeight, texture.cooked.format, texture.srgb)].push_back(&texture);
+
+	// 4. Upload every array level by level, one layer at a time
+	for (const auto& bucket : buckets) {
+		const vector<const PackedTexture*>& members = bucket.second;
+		for (size_t first = 0; first < members.size(); first += layersPerArray) {
+			size_t layers = min(layersPerArray, members.size() - first);
+			const CookedTexture& shape = members[first]->cooked;
+			GLenum internalFormat = CookedInternalFormat(shape.format, get<3>(bucket.first));
+			GLenum format = CookedPixelFormat(shape.format);
+
+			GLuint array;
+			glGenTextures(1, &array);
+			glBindTexture(GL_TEXTURE_2D_ARRAY, array);
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+			for (size_t level = 0; level < shape.levels.size(); level++) {
+				const CookedLevel& mip = shape.levels[level];
+				if (shape.compressed())
+					glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, GLint(level), internalFormat, mip.width, mip.height, GLsizei(layers), 0, GLsizei(mip.size * layers), nullptr);
+				else
+					glTexImage3D(GL_TEXTURE_2D_ARRAY, GLint(level), internalFormat, mip.width, mip.height, GLsizei(layers), 0, format, GL_UNSIGNED_BYTE, nullptr);
+
+				for (size_t layer = 0; layer < layers; layer++) {
+					const CookedTexture& cooked = members[first + layer]->cooked;
+					const unsigned char* pixels = cooked.data.data() + cooked.levels[level].offset;
+					if (shape.compressed())
+						glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, GLint(level), 0, 0, GLint(layer), mip.width, mip.height, 1, internalFormat, GLsizei(mip.size), pixels);
+					else
+						glTexSubImage3D(GL_TEXTURE_2D_ARRAY, GLint(level), 0, 0, GLint(layer), mip.width, mip.height, 1, format, GL_UNSIGNED_BYTE, pixels);
+				}
+			}
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+			setArraySamplerParameters(GLint(shape.levels.size()) - 1);
+
+			for (size_t layer = 0; layer < layers; layer++) {
+				const PackedTexture& texture = *members[first + layer];
+				slots[texture.source] = { array, static_cast<uint32_t>(layer) };
+				arrayStats.gpuBytes += texture.cooked.data.size();
+				arrayStats.sourceBytes += chainBytes(texture.cooked.format, texture.width, texture.height);
+			}
+			arrays.push_back(array);
+			arrayStats.arrays++;
+			arrayStats.layers += static_cast<unsigned int>(layers);
+		}
+	}
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	arrayStats.buildMs += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+	cout << "Texture arrays: " << packed.size() << " textures packed into " << arrays.size() << " arrays, "
+		<< arrayStats.paddingBytes() / 1024 << " KiB padding" << endl;
+}
@@ -0,0 +1,365 @@
+#include <textureCache.h>
+#include <scenePack.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+using namespace std;
+
+namespace {
+	struct CacheHeader {
+		uint32_t magic;
+		uint32_t version;
+		uint64_t sourceHash;
+		uint32_t format;
+		uint32_t width;
+		uint32_t height;
+		uint32_t levelCount;
+	};
+
+	// sRGB <-> linear conversion used for gamma-correct mip filtering
+	// ---------------------------------------------------------------
+	struct SrgbTable {
+		float toLinear[256];
+		SrgbTable() {
+			for (int i = 0; i < 256; i++) {
+				float c = i / 255.0f;
+				toLinear[i] = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+			}
+		}
+	};
+
+	const float* srgbToLinearTable() {
+		static const SrgbTable table;	// Thread-safe initialization: cooking runs on the worker threads
+		return table.toLinear;
+	}
+
+	unsigned char linearToSrgb(float c) {
+		c = c <= 0.0031308f ? c * 12.92f : 1.055f * powf(c, 1.0f / 2.4f) - 0.055f;
+		return static_cast<unsigned char>(min(max(c, 0.0f), 1.0f) * 255.0f + 0.5f);
+	}
+
+	// Mip generation: 2x2 box filter, edges clamped for odd sizes
+	// -------------------------------------------------------------
+	vector<unsigned char> downsample(const unsigned char* src, int width, int height, int components, bool srgb, int& outWidth, int& outHeight) {
+		outWidth = max(1, width / 2);
+		outHeight = max(1, height / 2);
+		vector<unsigned char> dst(size_t(outWidth) * outHeight * components);
+		const float* toLinear = srgbToLinearTable();
+
+		for (int y = 0; y < outHeight; y++) {
+			int y0 = min(y * 2, height - 1);
+			int y1 = min(y * 2 + 1, height - 1);
+			for (int x = 0; x < outWidth; x++) {
+				int x0 = min(x * 2, width - 1);
+				int x1 = min(x * 2 + 1, width - 1);
+				const unsigned char* p[4] = {
+					src + (size_t(y0) * width + x0) * components,
+					src + (size_t(y0) * width + x1) * components,
+					src + (size_t(y1) * width + x0) * components,
+					src + (size_t(y1) * width + x1) * components
+				};
+				unsigned char* out = &dst[(size_t(y) * outWidth + x) * components];
+				for (int c = 0; c < components; c++) {
+					bool colorChannel = srgb && c < 3 && components >= 3;
+					if (colorChannel) {
+						float sum = toLinear[p[0][c]] + toLinear[p[1][c]] + toLinear[p[2][c]] + toLinear[p[3][c]];
+						out[c] = linearToSrgb(sum * 0.25f);
+					}
+					else {
+						out[c] = static_cast<unsigned char>((p[0][c] + p[1][c] + p[2][c] + p[3][c] + 2) / 4);
+					}
+				}
+			}
+		}
+		return dst;
+	}
+
+	// BC1/BC3 block compression
+	// -------------------------
+	uint16_t to565(int r, int g, int b) {
+		return static_cast<uint16_t>(((r * 31 + 127) / 255) << 11 | ((g * 63 + 127) / 255) << 5 | ((b * 31 + 127) / 255));
+	}
+
+	void from565(uint16_t c, int rgb[3]) {
+		int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+		rgb[0] = (r << 3) | (r >> 2);
+		rgb[1] = (g << 2) | (g >> 4);
+		rgb[2] = (b << 3) | (b >> 2);
+	}
+
+	// Colour endpoints from the inset bounding box, with the diagonal chosen from the sign of the
+	// red/green and blue/green covariance (van Waveren, "Real-Time DXT Compression").
+	void encodeColorBlock(const unsigned char block[16][4], unsigned char out[8]) {
+		int minC[3] = { 255, 255, 255 }, maxC[3] = { 0, 0, 0 };
+		int mean[3] = { 0, 0, 0 };
+		for (int i = 0; i < 16; i++) {
+			for (int c = 0; c < 3; c++) {
+				minC[c] = min(minC[c], int(block[i][c]));
+				maxC[c] = max(maxC[c], int(block[i][c]));
+				mean[c] += block[i][c];
+			}
+		}
+		for (int c = 0; c < 3; c++) {
+			mean[c] = (mean[c] + 8) / 16;
+			int inset = (maxC[c] - minC[c]) >> 4;
+			minC[c] += inset;
+			maxC[c] -= inset;
+		}
+
+		int covRG = 0, covBG = 0;
+		for (int i = 0; i < 16; i++) {
+			int g = block[i][1] - mean[1];
+			covRG += (block[i][0] - mean[0]) * g;
+			covBG += (block[i][2] - mean[2]) * g;
+		}
+		if (covRG < 0)
+			swap(minC[0], maxC[0]);
+		if (covBG < 0)
+			swap(minC[2], maxC[2]);
+
+		uint16_t c0 = to565(maxC[0], maxC[1], maxC[2]);
+		uint16_t c1 = to565(minC[0], minC[1], minC[2]);
+		if (c0 < c1)
+			swap(c0, c1);	// c0 > c1 selects the 4-colour mode
+
+		uint32_t indices = 0;
+		if (c0 != c1) {
+			int palette[4][3];
+			from565(c0, palette[0]);
+			from565(c1, palette[1]);
+			for (int c = 0; c < 3; c++) {
+				palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+				palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+			}
+			for (int i = 0; i < 16; i++) {
+				int best = 0, bestDistance = INT32_MAX;
+				for (int p = 0; p < 4; p++) {
+					int dr = block[i][0] - palette[p][0], dg = block[i][1] - palette[p][1], db = block[i][2] - palette[p][2];
+					int distance = dr * dr + dg * dg + db * db;
+					if (distance < bestDistance) {
+						bestDistance = distance;
+						best = p;
+					}
+				}
+				indices |= uint32_t(best) << (2 * i);
+			}
+		}
+
+		out[0] = c0 & 0xFF;
+		out[1] = c0 >> 8;
+		out[2] = c1 & 0xFF;
+		out[3] = c1 >> 8;
+		memcpy(out + 4, &indices, 4);	// Little endian
+	}
+
+	void encodeAlphaBlock(const unsigned char block[16][4], unsigned char out[8]) {
+		int a0 = 0, a1 = 255;
+		for (int i = 0; i < 16; i++) {
+			a0 = max(a0, int(block[i][3]));
+			a1 = min(a1, int(block[i][3]));
+		}
+
+		uint64_t indices = 0;
+		if (a0 != a1) {
+			// a0 > a1: 8-value mode, six interpolated values
+			int palette[8] = { a0, a1 };
+			for (int i = 1; i <= 6; i++)
+				palette[i + 1] = ((7 - i) * a0 + i * a1) / 7;
+			for (int i = 0; i < 16; i++) {
+				int best = 0, bestDistance = INT32_MAX;
+				for (int p = 0; p < 8; p++) {
+					int distance = abs(block[i][3] - palette[p]);
+					if (distance < bestDistance) {
+						bestDistance = distance;
+						best = p;
+					}
+				}
+				indices |= uint64_t(best) << (3 * i);
+			}
+		}
+
+		out[0] = static_cast<unsigned char>(a0);
+		out[1] = static_cast<unsigned char>(a1);
+		for (int i = 0; i < 6; i++)
+			out[2 + i] = static_cast<unsigned char>(indices >> (8 * i));
+	}
+
+	// Compress one RGBA level. Blocks on the right/bottom edge repeat the last row/column.
+	vector<unsigned char> compressLevel(const unsigned char* rgba, int width, int height, bool alpha) {
+		int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+		size_t blockBytes = alpha ? 16 : 8;
+		vector<unsigned char> out(size_t(blocksX) * blocksY * blockBytes);
+		unsigned char block[16][4];
+
+		for (int by = 0; by < blocksY; by++) {
+			for (int bx = 0; bx < blocksX; bx++) {
+				for (int i = 0; i < 16; i++) {
+					int x = min(bx * 4 + (i & 3), width - 1);
+					int y = min(by * 4 + (i >> 2), height - 1);
+					memcpy(block[i], rgba + (size_t(y) * width + x) * 4, 4);
+				}
+				unsigned char* dst = &out[(size_t(by) * blocksX + bx) * blockBytes];
+				if (alpha) {
+					encodeAlphaBlock(block, dst);
+					encodeColorBlock(block, dst + 8);
+				}
+				else {
+					encodeColorBlock(block, dst);
+				}
+			}
+		}
+		return out;
+	}
+}
+
+CookedTexture CookTexture(const unsigned char* pixels, int width, int height, int components, bool compress, bool srgb) {
+	CookedTexture texture;
+	texture.width = width;
+	texture.height = height;
+
+	// Work on 1 (grey), 3 (RGB) or 4 (RGBA) channels; grey+alpha is expanded to RGBA
+	vector<unsigned char> level;
+	int channels = components;
+	if (components == 2) {
+		channels = 4;
+		level.resize(size_t(width) * height * 4);
+		for (size_t i = 0; i < size_t(width) * height; i++) {
+			level[i * 4 + 0] = level[i * 4 + 1] = level[i * 4 + 2] = pixels[i * 2];
+			level[i * 4 + 3] = pixels[i * 2 + 1];
+		}
+	}
+	else {
+		level.assign(pixels, pixels + size_t(width) * height * components);
+	}
+
+	bool hasAlpha = false;
+	if (channels == 4) {
+		for (size_t i = 0; i < size_t(width) * height && !hasAlpha; i++)
+			hasAlpha = level[i * 4 + 3] != 255;
+	}
+
+	// Single channel textures stay raw, everything else is compressed when the driver supports it
+	bool blockCompress = compress && channels >= 3;
+	if (blockCompress)
+		texture.format = hasAlpha ? CookedFormat::BC3 : CookedFormat::BC1;
+	else
+		texture.format = channels == 1 ? CookedFormat::R8 : channels == 3 ? CookedFormat::RGB8 : CookedFormat::RGBA8;
+
+	int levelWidth = width, levelHeight = height;
+	for (;;) {
+		vector<unsigned char> encoded;
+		if (blockCompress) {
+			if (channels == 4) {
+				encoded = compressLevel(level.data(), levelWidth, levelHeight, hasAlpha);
+			}
+			else {
+				vector<unsigned char> rgba(size_t(levelWidth) * levelHeight * 4, 255);
+				for (size_t i = 0; i < size_t(levelWidth) * levelHeight; i++)
+					memcpy(&rgba[i * 4], &level[i * 3], 3);
+				encoded = compressLevel(rgba.data(), levelWidth, levelHeight, false);
+			}
+		}
+		else {
+			encoded = level;
+		}
+
+		CookedLevel cooked = { uint32_t(levelWidth), uint32_t(levelHeight), texture.data.size(), encoded.size() };
+		texture.levels.push_back(cooked);
+		texture.data.insert(texture.data.end(), encoded.begin(), encoded.end());
+
+		if (levelWidth == 1 && levelHeight == 1)
+			break;
+		int nextWidth, nextHeight;
+		level = downsample(level.data(), levelWidth, levelHeight, channels, srgb, nextWidth, nextHeight);
+		levelWidth = nextWidth;
+		levelHeight = nextHeight;
+	}
+
+	return texture;
+}
+
+uint64_t TextureSourceHash(const string& imagePath, bool gamma) {
+	MappedFile file;
+	if (!file.open(imagePath))
+		return 0;
+	uint64_t hash = HashBytes(file.data(), file.size());
+	hash = HashBytes(&gamma, sizeof(gamma), hash);
+	return HashBytes(&TEXTURE_CACHE_VERSION, sizeof(TEXTURE_CACHE_VERSION), hash);
+}
+
+string TextureCachePath(const string& imagePath) {
+	return imagePath + ".ctex";
+}
+
+bool ReadTextureCache(const string& cachePath, uint64_t sourceHash, CookedTexture& texture) {
+	if (sourceHash == 0)
+		return false;
+	ifstream in(cachePath, ios::binary);
+	if (!in)
+		return false;
+
+	CacheHeader header;
+	if (!in.read(reinterpret_cast<char*>(&header), sizeof(header))
+		|| header.magic != TEXTURE_CACHE_MAGIC || header.version != TEXTURE_CACHE_VERSION
+		|| header.sourceHash != sourceHash || header.format > uint32_t(CookedFormat::BC3)
+		|| header.levelCount == 0 || header.levelCount > 32)
+		return false;
+
+	texture.format = static_cast<CookedFormat>(header.format);
+	texture.width = header.width;
+	texture.height = header.height;
+	texture.levels.resize(header.levelCount);
+	if (!in.read(reinterpret_cast<char*>(texture.levels.data()), header.levelCount * sizeof(CookedLevel)))
+		return false;
+
+	uint64_t dataSize = 0;
+	for (const CookedLevel& level : texture.levels) {
+		if (level.offset != dataSize)
+			return false;
+		dataSize += level.size;
+	}
+	texture.data.resize(dataSize);
+	return static_cast<bool>(in.read(reinterpret_cast<char*>(texture.data.data()), dataSize));
+}
+
+bool WriteTextureCache(const string& cachePath, uint64_t sourceHash, const CookedTexture& texture) {
+	// Written to a temporary file first so a crash never leaves a half-written cache entry behind
+	string tempPath = cachePath + ".tmp";
+	{
+		ofstream out(tempPath, ios::binary | ios::trunc);
+		if (!out)
+			return false;
+		CacheHeader header = { TEXTURE_CACHE_MAGIC, TEXTURE_CACHE_VERSION, sourceHash, uint32_t(texture.format),
+			texture.width, texture.height, uint32_t(texture.levels.size()) };
+		out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		out.write(reinterpret_cast<const char*>(texture.levels.data()), texture.levels.size() * sizeof(CookedLevel));
+		out.write(reinterpret_cast<const char*>(texture.data.data()), texture.data.size());
+		if (!out)
+			return false;
+	}
+
+	error_code ec;
+	filesystem::rename(tempPath, cachePath, ec);
+	if (ec) {
+		cout << "ERROR::TEXTURE_CACHE::FAILED_TO_WRITE: " << cachePath << " (" << ec.message() << ")" << endl;
+		return false;
+	}
+	return true;
+}
+
+size_t UncompressedTextureBytes(int width, int height, int components) {
+	size_t bytes = 0;
+	for (;;) {
+		bytes += size_t(width) * height * components;
+		if (width == 1 && height == 1)
+			break;
+		width = max(1, width / 2);
+		height = max(1, height / 2);
+	}
+	return bytes;
+}
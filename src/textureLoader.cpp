@@ -2,50 +2,256 @@
 #include <GL/glew.h>
 #include <stb_image.h>
 
+#include <profiler.h>
 #include <textureLoader.h>
+#include <textureCache.h>
+#include <jobSystem.h>
 
 #include <string>
 #include <iostream>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
 using namespace std;
 
-unsigned int TextureFromFile(const char* path, const string& directory, bool gamme) {
+namespace {
+	// A decoded (or cooked) image waiting for its upload
+	struct DecodedImage {
+		unsigned int id = 0;
+		string filename;
+		unsigned char* data = nullptr;
+		int width = 0;
+		int height = 0;
+		int nrComponents = 0;
+		// Cooked mip chain, either read from the cache or cooked from 'data' on the worker
+		bool hasCooked = false;
+		bool fromCache = false;
+		CookedTexture cooked;
+	};
+
+	bool textureCacheEnabled = true;
+	TextureLoadStats loadStats;
+
+	void setSamplerParameters() {
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	}
+
+	// Upload a cooked mip chain level by level
+	void uploadCooked(DecodedImage& image, bool gamma) {
+		const CookedTexture& cooked = image.cooked;
+		GLenum internalFormat = CookedInternalFormat(cooked.format, gamma);
+		GLenum format = CookedPixelFormat(cooked.format);
+
+		glBindTexture(GL_TEXTURE_2D, image.id);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);	// Raw RGB/R rows of the small mips are not 4-byte aligned
+		for (size_t level = 0; level < cooked.levels.size(); level++) {
+			const CookedLevel& mip = cooked.levels[level];
+			const unsigned char* pixels = cooked.data.data() + mip.offset;
+			if (cooked.compressed())
+				glCompressedTexImage2D(GL_TEXTURE_2D, GLint(level), internalFormat, mip.width, mip.height, 0, GLsizei(mip.size), pixels);
+			else
+				glTexImage2D(GL_TEXTURE_2D, GLint(level), internalFormat, mip.width, mip.height, 0, format, GL_UNSIGNED_BYTE, pixels);
+		}
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, GLint(cooked.levels.size()) - 1);
+		setSamplerParameters();
+
+		loadStats.gpuBytes += cooked.data.size();
+		loadStats.uncompressedBytes += UncompressedTextureBytes(cooked.width, cooked.height, cooked.format == CookedFormat::R8 ? 1 : cooked.format == CookedFormat::RGB8 || cooked.format == CookedFormat::BC1 ? 3 : 4);
+		if (image.fromCache)
+			loadStats.fromCache++;
+		else
+			loadStats.cooked++;
+	}
+
+	// Upload a decoded image into its reserved texture name. Must run on the GL thread.
+	void uploadTexture(DecodedImage& image, bool gamma) {
+		PROFILE_ZONE("Upload texture");
+		loadStats.textures++;
+		if (image.hasCooked) {
+			uploadCooked(image, gamma);
+		}
+		else if (image.data) {
+
+			GLenum format = GL_RGB;
+			GLenum internalFormat = GL_RGB;
+			if (image.nrComponents == 1)
+				format = internalFormat = GL_RED;
+			else if (image.nrComponents == 2)
+				format = internalFormat = GL_RG;
+			else if (image.nrComponents == 3) {
+				format = GL_RGB;
+				internalFormat = gamma ? GL_SRGB8 : GL_RGB8;
+			}
+			else if (image.nrComponents == 4) {
+				format = GL_RGBA;
+				internalFormat = gamma ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+			}
+
+			glBindTexture(GL_TEXTURE_2D, image.id);
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+			glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.data);
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+			glGenerateMipmap(GL_TEXTURE_2D);
+			setSamplerParameters();
+
+			size_t bytes = UncompressedTextureBytes(image.width, image.height, image.nrComponents);
+			loadStats.gpuBytes += bytes;
+			loadStats.uncompressedBytes += bytes;
+			loadStats.fromImage++;
+
+			stbi_image_free(image.data);
+			image.data = nullptr;
+		}
+		else {
+			cout << "Texture failed to load at path: " << image.filename << endl;
+		}
+	}
+
+	// Worker side: use the cooked cache if it is up to date, otherwise decode the image and cook it
+	void decodeTexture(DecodedImage& image, bool gamma, bool useCache, bool compress) {
+		PROFILE_ZONE("Decode texture");
+		uint64_t sourceHash = 0;
+		string cachePath;
+		if (useCache) {
+			sourceHash = TextureSourceHash(image.filename, gamma);
+			cachePath = TextureCachePath(image.filename);
+			if (ReadTextureCache(cachePath, sourceHash, image.cooked) && (compress || !image.cooked.compressed())) {
+				image.hasCooked = true;
+				image.fromCache = true;
+				return;
+			}
+		}
+
+		image.data = stbi_load(image.filename.c_str(), &image.width, &image.height, &image.nrComponents, 0);
+		if (!image.data || !useCache || sourceHash == 0)
+			return;
+
+		image.cooked = CookTexture(image.data, image.width, image.height, image.nrComponents, compress, gamma);
+		image.hasCooked = true;
+		stbi_image_free(image.data);
+		image.data = nullptr;
+		WriteTextureCache(cachePath, sourceHash, image.cooked);
+	}
+}
+
+void SetTextureCacheEnabled(bool enabled) {
+	textureCacheEnabled = enabled;
+}
+
+const TextureLoadStats& GetTextureLoadStats() {
+	return loadStats;
+}
+
+unsigned int CookedInternalFormat(CookedFormat format, bool gamma) {
+	switch (format) {
+	case CookedFormat::R8: return GL_R8;
+	case CookedFormat::RGB8: return gamma ? GL_SRGB8 : GL_RGB8;
+	case CookedFormat::RGBA8: return gamma ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+	case CookedFormat::BC1: return gamma ? GL_COMPRESSED_SRGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	case CookedFormat::BC3: return gamma ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	}
+	return GL_RGBA8;
+}
+
+unsigned int CookedPixelFormat(CookedFormat format) {
+	return format == CookedFormat::R8 ? GL_RED : format == CookedFormat::RGB8 ? GL_RGB : GL_RGBA;
+}
+
+unsigned int WhiteTexture() {
+	static unsigned int textureID = 0;
+	if (textureID == 0) {
+		const unsigned char white[4] = { 255, 255, 255, 255 };
+		glGenTextures(1, &textureID);
+		glBindTexture(GL_TEXTURE_2D, textureID);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, white);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	}
+	return textureID;
+}
+
+string TextureFilename(const char* path, const string& directory) {
 	/*string filenme = string(path);
 	filename = (std::filesystem::path(directory) / path).string();*/
 	string filename = string(path);
 	// filename = directory + '/' + filename;
 	filename = directory + "/textures/" + filename;
+	return filename;
+}
+
+unsigned int TextureFromFile(const char* path, const string& directory, bool gamma) {
+	PROFILE_ZONE("TextureFromFile");
+	TextureBatch batch;
+	unsigned int textureID = batch.add(path, directory, gamma);
+	batch.load();
+	return textureID;
+}
+
+unsigned int TextureBatch::add(const char* path, const string& directory, bool gamma) {
+	string filename = TextureFilename(path, directory);
 	cout << "path: " << path << endl;
 	cout << "filename: " << filename << endl;
+
 	unsigned int textureID;
 	glGenTextures(1, &textureID);
+	requests.push_back({ textureID, filename, gamma });
+	return textureID;
+}
 
-	int width, height, nrComponents;
-	unsigned char* data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
+void TextureBatch::load() {
+	if (requests.empty())
+		return;
+	PROFILE_ZONE("TextureBatch::load");
 
-	if (data) {
-		
-		GLenum format;
-		if (nrComponents == 1)
-			format = GL_RED;
-		else if (nrComponents == 3)
-			format = GL_RGB;
-		else if (nrComponents == 4)
-			format = GL_RGBA;
+	// Finished decodes, handed from the workers to the GL thread
+	struct Completion {
+		mutex lock;
+		condition_variable ready;
+		deque<size_t> finished;
+	};
+	Completion completion;
+	vector<DecodedImage> images(requests.size());
 
-		glBindTexture(GL_TEXTURE_2D, textureID);
-		glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
+	auto loadStart = chrono::steady_clock::now();
 
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	// Block compression needs S3TC (and its sRGB variants for gamma corrected textures)
+	bool s3tc = GLEW_EXT_texture_compression_s3tc;
+	bool s3tcSrgb = s3tc && GLEW_EXT_texture_sRGB;
+	bool useCache = textureCacheEnabled;
 
-		stbi_image_free(data);
+	// Decode everything on the workers
+	JobSystem& jobs = JobSystem::shared();
+	for (size_t i = 0; i < requests.size(); i++) {
+		bool compress = requests[i].gamma ? s3tcSrgb : s3tc;
+		jobs.run([this, i, &images, &completion, useCache, compress] {
+			DecodedImage& image = images[i];
+			image.id = requests[i].id;
+			image.filename = requests[i].filename;
+			decodeTexture(image, requests[i].gamma, useCache, compress);
+			// Notify under the lock: once the last index is taken 'completion' goes out of scope with load()
+			lock_guard<mutex> guard(completion.lock);
+			completion.finished.push_back(i);
+			completion.ready.notify_one();
+		});
 	}
-	else {
-		cout << "Texture failed to load at path: " << path << endl;
+
+	// Upload in completion order while the remaining images are still being decoded
+	for (size_t uploaded = 0; uploaded < requests.size(); uploaded++) {
+		size_t index;
+		{
+			unique_lock<mutex> guard(completion.lock);
+			completion.ready.wait(guard, [&completion] { return !completion.finished.empty(); });
+			index = completion.finished.front();
+			completion.finished.pop_front();
+		}
+		uploadTexture(images[index], requests[index].gamma);
 	}
 
-	return textureID;
-}
\ No newline at end of file
+	loadStats.loadMs += chrono::duration<double, milli>(chrono::steady_clock::now() - loadStart).count();
+	requests.clear();
+}
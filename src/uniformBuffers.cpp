@@ -0,0 +1,72 @@
+#include <uniformBuffers.h>
+
+#include <cmath>
+#include <cstring>
+using namespace std;
+
+namespace {
+	size_t UniformOffsetAlignment() {
+		static size_t alignment = 0;
+		if (alignment == 0) {
+			GLint value = 256;
+			glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &value);
+			alignment = value > 0 ? size_t(value) : 256;
+		}
+		return alignment;
+	}
+}
+
+GpuSpotLight ToGpuSpotLight(const SpotLight& light) {
+	GpuSpotLight gpu;
+	gpu.position = glm::vec4(light.position, 1.0f);
+	gpu.direction = glm::vec4(light.direction, 0.0f);
+	gpu.ambient = glm::vec4(light.ambient, 0.0f);
+	gpu.diffuse = glm::vec4(light.diffuse, 0.0f);
+	gpu.specular = glm::vec4(light.specular, 0.0f);
+	gpu.cone = glm::vec4(cos(glm::radians(light.cutOff)), cos(glm::radians(light.outerCutOff)), 0.0f, 0.0f);
+	gpu.attenuation = glm::vec4(light.constant, light.linear, light.quadratic, 0.0f);
+	return gpu;
+}
+
+// UniformBuffer
+// -------------
+UniformBuffer::UniformBuffer(GLuint binding, size_t size)
+	: binding(binding), size(size), stream(GL_UNIFORM_BUFFER, size, UniformOffsetAlignment())
+{
+}
+
+void UniformBuffer::update(const void* data) {
+	size_t offset;
+	stream.beginFrame();
+	memcpy(stream.allocate(size, 1, offset), data, size);
+	stream.flush();
+	glBindBufferRange(GL_UNIFORM_BUFFER, binding, stream.buffer(), stream.segmentOffset() + offset, size);
+}
+
+// UniformRing
+// -----------
+UniformRing::UniformRing(GLuint binding, size_t blockSize, size_t objectsPerFrame)
+	: binding(binding)
+	, blockSize(blockSize)
+	, stride((blockSize + UniformOffsetAlignment() - 1) / UniformOffsetAlignment() * UniformOffsetAlignment())
+	, stream(GL_UNIFORM_BUFFER, objectsPerFrame * stride, UniformOffsetAlignment())
+{
+}
+
+void UniformRing::beginFrame() {
+	stream.beginFrame();
+}
+
+uint32_t UniformRing::push(const void* data) {
+	size_t offset;
+	memcpy(stream.allocate(stride, stride, offset), data, blockSize);
+	return static_cast<uint32_t>(offset);
+}
+
+void UniformRing::flush() {
+	stream.flush();
+}
+
+void UniformRing::bind(uint32_t offset) const {
+	glBindBufferRange(GL_UNIFORM_BUFFER, binding, stream.buffer(), stream.segmentOffset() + offset, blockSize);
+}
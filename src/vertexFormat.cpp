@@ -0,0 +1,203 @@
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+#include <vertexFormat.h>
+#include <mesh.h>
+
+#include <glm/packing.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include <cmath>
+#include <cstring>
+using namespace std;
+
+namespace {
+	bool compactVertices = true;
+	GeometryMemoryStats geometryStats;
+
+	// Largest |uv| stored as half float. Half floats have an 11 bit significand, so up to 1.0 the step is
+	// at most 1/2048; tiled texture coordinates beyond that keep full floats.
+	const float HALF_UV_LIMIT = 1.001f;
+
+	size_t uvBytes(uint32_t layout) {
+		return (layout & VERTEX_LAYOUT_HALF_UV) ? 4 : 8;
+	}
+
+	uint32_t packUnitVector(glm::vec3 v, float w) {
+		float length = glm::length(v);
+		if (length > 0.0f)
+			v /= length;
+		return glm::packSnorm3x10_1x2(glm::vec4(v, w));
+	}
+}
+
+void SetCompactVertices(bool enabled) {
+	compactVertices = enabled;
+}
+
+bool CompactVerticesEnabled() {
+	return compactVertices;
+}
+
+uint32_t ChooseVertexLayout(const Vertex* vertices, size_t count, bool hasNormalMap) {
+	if (!compactVertices)
+		return VERTEX_LAYOUT_FULL;
+
+	uint32_t layout = VERTEX_LAYOUT_COMPACT | VERTEX_LAYOUT_HALF_UV;
+	for (size_t i = 0; i < count; i++) {
+		if (fabs(vertices[i].TexCoords.x) > HALF_UV_LIMIT || fabs(vertices[i].TexCoords.y) > HALF_UV_LIMIT) {
+			layout &= ~VERTEX_LAYOUT_HALF_UV;
+			break;
+		}
+	}
+	if (hasNormalMap)
+		layout |= VERTEX_LAYOUT_TANGENT;
+	return layout;
+}
+
+size_t VertexStride(uint32_t layout) {
+	if (!(layout & VERTEX_LAYOUT_COMPACT))
+		return sizeof(Vertex);
+	return 12 + 4 + uvBytes(layout) + ((layout & VERTEX_LAYOUT_TANGENT) ? 4 : 0);
+}
+
+vector<unsigned char> PackVertices(const Vertex* vertices, size_t count, uint32_t layout) {
+	size_t stride = VertexStride(layout);
+	vector<unsigned char> bytes(count * stride);
+	if (!(layout & VERTEX_LAYOUT_COMPACT)) {
+		if (count > 0)
+			memcpy(bytes.data(), vertices, count * sizeof(Vertex));
+		return bytes;
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		const Vertex& vertex = vertices[i];
+		unsigned char* out = bytes.data() + i * stride;
+
+		memcpy(out, &vertex.Position, 12);
+		out += 12;
+
+		uint32_t normal = packUnitVector(vertex.Normal, 0.0f);
+		memcpy(out, &normal, 4);
+		out += 4;
+
+		if (layout & VERTEX_LAYOUT_HALF_UV) {
+			uint32_t uv = glm::packHalf2x16(vertex.TexCoords);
+			memcpy(out, &uv, 4);
+		}
+		else {
+			memcpy(out, &vertex.TexCoords, 8);
+		}
+		out += uvBytes(layout);
+
+		if (layout & VERTEX_LAYOUT_TANGENT) {
+			// Handedness of the tangent frame, so the bitangent can be rebuilt in the shader
+			float sign = glm::dot(glm::cross(vertex.Normal, vertex.Tangent), vertex.Bitangent) < 0.0f ? -1.0f : 1.0f;
+			uint32_t tangent = packUnitVector(vertex.Tangent, sign);
+			memcpy(out, &tangent, 4);
+		}
+	}
+	return bytes;
+}
+
+vector<Vertex> UnpackVertices(const unsigned char* bytes, size_t count, uint32_t layout) {
+	vector<Vertex> vertices(count);
+	if (!(layout & VERTEX_LAYOUT_COMPACT)) {
+		if (count > 0)
+			memcpy(vertices.data(), bytes, count * sizeof(Vertex));
+		return vertices;
+	}
+
+	size_t stride = VertexStride(layout);
+	for (size_t i = 0; i < count; i++) {
+		Vertex& vertex = vertices[i];
+		const unsigned char* in = bytes + i * stride;
+
+		memcpy(&vertex.Position, in, 12);
+		in += 12;
+
+		uint32_t normal;
+		memcpy(&normal, in, 4);
+		vertex.Normal = glm::vec3(glm::unpackSnorm3x10_1x2(normal));
+		in += 4;
+
+		if (layout & VERTEX_LAYOUT_HALF_UV) {
+			uint32_t uv;
+			memcpy(&uv, in, 4);
+			vertex.TexCoords = glm::unpackHalf2x16(uv);
+		}
+		else {
+			memcpy(&vertex.TexCoords, in, 8);
+		}
+		in += uvBytes(layout);
+
+		if (layout & VERTEX_LAYOUT_TANGENT) {
+			uint32_t tangent;
+			memcpy(&tangent, in, 4);
+			glm::vec4 frame = glm::unpackSnorm3x10_1x2(tangent);
+			vertex.Tangent = glm::vec3(frame);
+			vertex.Bitangent = glm::cross(vertex.Normal, vertex.Tangent) * (frame.w < 0.0f ? -1.0f : 1.0f);
+		}
+		else {
+			vertex.Tangent = glm::vec3(0.0f);
+			vertex.Bitangent = glm::vec3(0.0f);
+		}
+	}
+	return vertices;
+}
+
+void SetupVertexAttributes(uint32_t layout) {
+	if (!(layout & VERTEX_LAYOUT_COMPACT)) {
+		// Vertex positions
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+		// Vertex normals
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+		// Vertex texture coordinates
+		glEnableVertexAttribArray(2);
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+		// Vertex tangent
+		glEnableVertexAttribArray(3);
+		glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
+		// Vertex bitangent
+		glEnableVertexAttribArray(4);
+		glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+		return;
+	}
+
+	GLsizei stride = static_cast<GLsizei>(VertexStride(layout));
+	size_t offset = 0;
+	// Vertex positions
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)offset);
+	offset += 12;
+	// Vertex normals
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, (void*)offset);
+	offset += 4;
+	// Vertex texture coordinates
+	glEnableVertexAttribArray(2);
+	if (layout & VERTEX_LAYOUT_HALF_UV)
+		glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, stride, (void*)offset);
+	else
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)offset);
+	offset += uvBytes(layout);
+	// Vertex tangent (xyz) and bitangent sign (w)
+	if (layout & VERTEX_LAYOUT_TANGENT) {
+		glEnableVertexAttribArray(3);
+		glVertexAttribPointer(3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, (void*)offset);
+	}
+}
+
+void RecordMeshUpload(size_t vertexCount, uint32_t layout, size_t indexBytes) {
+	geometryStats.meshes++;
+	geometryStats.vertices += vertexCount;
+	geometryStats.fullVertexBytes += vertexCount * sizeof(Vertex);
+	geometryStats.vertexBytes += vertexCount * VertexStride(layout);
+	geometryStats.indexBytes += indexBytes;
+}
+
+const GeometryMemoryStats& GetGeometryMemoryStats() {
+	return geometryStats;
+}